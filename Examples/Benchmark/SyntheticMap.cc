@@ -0,0 +1,474 @@
+/**
+* This file is part of ORB-SLAM2.
+*
+* Copyright (C) 2014-2016 Raúl Mur-Artal <raulmur at unizar dot es> (University of Zaragoza)
+* For more information see <https://github.com/raulmur/ORB_SLAM2>
+*
+* ORB-SLAM2 is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM2 is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with ORB-SLAM2. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "SyntheticMap.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace ORB_SLAM2
+{
+
+static double ReadParameter(cv::FileStorage &fSettings, const string &name, const double defaultValue)
+{
+    cv::FileNode node = fSettings[name];
+    return node.empty() ? defaultValue : (double)node;
+}
+
+SyntheticMap::SyntheticMap(const string &strSettingPath, ORBVocabulary* pVoc, Map* pMap, KeyFrameDatabase* pKFDB):
+    mpVocabulary(pVoc), mpMap(pMap), mpKeyFrameDB(pKFDB), mLandmarksEnd(0), mpPendingKF(NULL), mnMapPoints(0),
+    mnObservations(0)
+{
+    cv::FileStorage fSettings(strSettingPath, cv::FileStorage::READ);
+
+    float fx = fSettings["Camera.fx"];
+    float fy = fSettings["Camera.fy"];
+    float cx = fSettings["Camera.cx"];
+    float cy = fSettings["Camera.cy"];
+
+    mK = cv::Mat::eye(3,3,CV_32F);
+    mK.at<float>(0,0) = fx;
+    mK.at<float>(1,1) = fy;
+    mK.at<float>(0,2) = cx;
+    mK.at<float>(1,2) = cy;
+
+    // Keypoints are generated undistorted
+    mDistCoef = cv::Mat::zeros(4,1,CV_32F);
+
+    mnWidth = ReadParameter(fSettings,"Camera.width",2*cx+1);
+    mnHeight = ReadParameter(fSettings,"Camera.height",2*cy+1);
+
+    mbf = ReadParameter(fSettings,"Camera.bf",0);
+    mThDepth = mbf*ReadParameter(fSettings,"ThDepth",35)/fx;
+    mbStereo = mbf>0 && ReadParameter(fSettings,"Synthetic.stereo",0)!=0;
+
+    mnLevels = fSettings["ORBextractor.nLevels"];
+    mfScaleFactor = fSettings["ORBextractor.scaleFactor"];
+    mvScaleFactors.resize(mnLevels);
+    mvInvScaleFactors.resize(mnLevels);
+    mvLevelSigma2.resize(mnLevels);
+    mvInvLevelSigma2.resize(mnLevels);
+    mvScaleFactors[0] = 1.0f;
+    for(int i=1; i<mnLevels; i++)
+        mvScaleFactors[i] = mvScaleFactors[i-1]*mfScaleFactor;
+    for(int i=0; i<mnLevels; i++)
+    {
+        mvInvScaleFactors[i] = 1.0f/mvScaleFactors[i];
+        mvLevelSigma2[i] = mvScaleFactors[i]*mvScaleFactors[i];
+        mvInvLevelSigma2[i] = 1.0f/mvLevelSigma2[i];
+    }
+
+    string strTrajectory = fSettings["Synthetic.trajectory"];
+    mTrajectory = strTrajectory=="corridor" ? CORRIDOR : CIRCUIT;
+    mLapLength = ReadParameter(fSettings,"Synthetic.lapLength",200);
+    mKeyFrameSpacing = ReadParameter(fSettings,"Synthetic.keyFrameSpacing",0.25);
+    mLandmarksPerMeter = ReadParameter(fSettings,"Synthetic.landmarksPerMeter",600);
+    mCorridorWidth = ReadParameter(fSettings,"Synthetic.corridorWidth",4);
+    mMaxDepth = ReadParameter(fSettings,"Synthetic.maxDepth",12);
+    mnFeatures = ReadParameter(fSettings,"Synthetic.features",ReadParameter(fSettings,"ORBextractor.nFeatures",1000));
+    mnDescriptorNoise = ReadParameter(fSettings,"Synthetic.descriptorNoise",10);
+    mbCloseLoops = ReadParameter(fSettings,"Synthetic.closeLoops",1)!=0;
+    mDrift = ReadParameter(fSettings,"Synthetic.drift",0.01);
+    mRng = cv::RNG(ReadParameter(fSettings,"Synthetic.seed",1));
+
+    // Frames are not built from images, the bounds and the grid are those of the image
+    Frame::fx = fx;
+    Frame::fy = fy;
+    Frame::cx = cx;
+    Frame::cy = cy;
+    Frame::invfx = 1.0f/fx;
+    Frame::invfy = 1.0f/fy;
+    Frame::mnMinX = 0.0f;
+    Frame::mnMaxX = mnWidth;
+    Frame::mnMinY = 0.0f;
+    Frame::mnMaxY = mnHeight;
+    Frame::mfGridElementWidthInv = static_cast<float>(FRAME_GRID_COLS)/static_cast<float>(mnWidth);
+    Frame::mfGridElementHeightInv = static_cast<float>(FRAME_GRID_ROWS)/static_cast<float>(mnHeight);
+    Frame::mbInitialComputations = false;
+}
+
+void SyntheticMap::PathFrame(const double s, cv::Point3f &p, cv::Point3f &x, cv::Point3f &z) const
+{
+    if(mTrajectory==CIRCUIT)
+    {
+        const double R = mLapLength/(2*M_PI);
+        const double theta = s/R;
+        const float c = cos(theta);
+        const float sn = sin(theta);
+        p = cv::Point3f(R*c,0,R*sn);
+        x = cv::Point3f(c,0,sn);
+        z = cv::Point3f(-sn,0,c);
+    }
+    else
+    {
+        p = cv::Point3f(0,0,s);
+        x = cv::Point3f(1,0,0);
+        z = cv::Point3f(0,0,1);
+    }
+}
+
+cv::Mat SyntheticMap::TruePose(const double s) const
+{
+    cv::Point3f p, x, z;
+    PathFrame(s,p,x,z);
+    const cv::Point3f y(0,1,0);
+
+    // Rows of Rcw are the axes of the camera
+    cv::Mat Tcw = cv::Mat::eye(4,4,CV_32F);
+    const cv::Point3f axes[3] = {x, y, z};
+    for(int i=0; i<3; i++)
+    {
+        Tcw.at<float>(i,0) = axes[i].x;
+        Tcw.at<float>(i,1) = axes[i].y;
+        Tcw.at<float>(i,2) = axes[i].z;
+        Tcw.at<float>(i,3) = -axes[i].dot(p);
+    }
+    return Tcw;
+}
+
+cv::Point3f SyntheticMap::Drift(const double s) const
+{
+    if(mbCloseLoops)
+        return cv::Point3f(0,0,0);
+    return cv::Point3f(0,mDrift*s,0);
+}
+
+cv::Mat SyntheticMap::EstimatedPose(const double s) const
+{
+    cv::Mat Tcw = TruePose(s);
+    const cv::Point3f d = Drift(s);
+    cv::Mat dw = (cv::Mat_<float>(3,1) << d.x, d.y, d.z);
+    cv::Mat tcw = Tcw.rowRange(0,3).col(3) - Tcw.rowRange(0,3).colRange(0,3)*dw;
+    tcw.copyTo(Tcw.rowRange(0,3).col(3));
+    return Tcw;
+}
+
+void SyntheticMap::CreateLandmarks(const double s)
+{
+    double end = mTrajectory==CIRCUIT ? mLapLength : s;
+    if(mLandmarksEnd>=end)
+        return;
+
+    // One meter at a time, so that the landmarks stay sorted
+    while(mLandmarksEnd<end)
+    {
+        const int n = mLandmarksPerMeter;
+        vector<double> vS(n);
+        for(int i=0; i<n; i++)
+            vS[i] = mLandmarksEnd+mRng.uniform(0.0,1.0);
+        sort(vS.begin(),vS.end());
+
+        for(int i=0; i<n; i++)
+        {
+            cv::Point3f p, x, z;
+            PathFrame(vS[i],p,x,z);
+            const float side = mRng.uniform(0,2) ? 1.0f : -1.0f;
+            const cv::Point3f Pw = p + side*(0.5f*mCorridorWidth+mRng.uniform(0.0f,1.5f))*x +
+                                   cv::Point3f(0,mRng.uniform(-1.5f,1.5f),0);
+
+            Landmark lm;
+            lm.Pw = (cv::Mat_<float>(3,1) << Pw.x, Pw.y, Pw.z);
+            lm.descriptor = cv::Mat(1,32,CV_8U);
+            mRng.fill(lm.descriptor,cv::RNG::UNIFORM,0,256);
+            lm.angle = mRng.uniform(0.0f,360.0f);
+            lm.refDistance = mRng.uniform(1.0f,(float)mMaxDepth);
+            lm.pMP = static_cast<MapPoint*>(NULL);
+            lm.nLap = -1;
+            mvLandmarks.push_back(lm);
+            mvLandmarkS.push_back(vS[i]);
+        }
+
+        mLandmarksEnd += 1.0;
+    }
+}
+
+vector<size_t> SyntheticMap::VisibleLandmarks(const double s, vector<cv::KeyPoint> &vKeys, vector<float> &vDepths)
+{
+    const cv::Mat Tcw = TruePose(s);
+    const cv::Mat Rcw = Tcw.rowRange(0,3).colRange(0,3);
+    const cv::Mat tcw = Tcw.rowRange(0,3).col(3);
+
+    // Landmarks from slightly behind the camera to the maximum depth
+    const size_t nLandmarks = mvLandmarks.size();
+    const double s0 = mTrajectory==CIRCUIT ? fmod(s,mLapLength) : s;
+    size_t i0 = lower_bound(mvLandmarkS.begin(),mvLandmarkS.end(),s0-1.0)-mvLandmarkS.begin();
+    const size_t nMax = min(nLandmarks,size_t(mLandmarksPerMeter*(mMaxDepth+mCorridorWidth+1)));
+
+    vector<size_t> vCandidates;
+    vector<cv::Point3f> vProj;
+    for(size_t n=0; n<nMax; n++)
+    {
+        size_t i = i0+n;
+        if(i>=nLandmarks)
+        {
+            if(mTrajectory!=CIRCUIT)
+                break;
+            i -= nLandmarks;
+        }
+
+        cv::Mat Pc = Rcw*mvLandmarks[i].Pw+tcw;
+        const float z = Pc.at<float>(2);
+        if(z<0.3f || z>mMaxDepth)
+            continue;
+
+        const float u = Frame::fx*Pc.at<float>(0)/z+Frame::cx;
+        const float v = Frame::fy*Pc.at<float>(1)/z+Frame::cy;
+        if(u<0 || u>=mnWidth || v<0 || v>=mnHeight)
+            continue;
+
+        vCandidates.push_back(i);
+        vProj.push_back(cv::Point3f(u,v,z));
+    }
+
+    // The detector keeps a subset of the visible landmarks
+    vector<size_t> vOrder(vCandidates.size());
+    for(size_t i=0; i<vOrder.size(); i++)
+        vOrder[i] = i;
+    for(size_t i=vOrder.size(); i>1; i--)
+        swap(vOrder[i-1],vOrder[mRng.uniform(0,(int)i)]);
+    if((int)vOrder.size()>mnFeatures)
+        vOrder.resize(mnFeatures);
+
+    const float logScale = log(mfScaleFactor);
+
+    vector<size_t> vIndices;
+    vIndices.reserve(vOrder.size());
+    vKeys.clear();
+    vKeys.reserve(vOrder.size());
+    vDepths.clear();
+    vDepths.reserve(vOrder.size());
+    for(size_t j=0; j<vOrder.size(); j++)
+    {
+        const size_t i = vCandidates[vOrder[j]];
+        const cv::Point3f &proj = vProj[vOrder[j]];
+        const Landmark &lm = mvLandmarks[i];
+
+        // Closer than the reference distance is detected at a coarser level
+        int level = 0;
+        if(proj.z<lm.refDistance)
+            level = min(mnLevels-1,(int)round(log(lm.refDistance/proj.z)/logScale));
+
+        const float sigma = 0.5f*mvScaleFactors[level];
+        cv::KeyPoint kp;
+        kp.pt.x = min(max(proj.x+(float)mRng.gaussian(sigma),0.0f),mnWidth-1.0f);
+        kp.pt.y = min(max(proj.y+(float)mRng.gaussian(sigma),0.0f),mnHeight-1.0f);
+        kp.octave = level;
+        kp.size = 31*mvScaleFactors[level];
+        kp.angle = lm.angle;
+
+        vIndices.push_back(i);
+        vKeys.push_back(kp);
+        vDepths.push_back(proj.z);
+    }
+
+    return vIndices;
+}
+
+Frame SyntheticMap::BuildFrame(const double s, const vector<size_t> &vIndices, const vector<cv::KeyPoint> &vKeys,
+                               const vector<float> &vDepths)
+{
+    Frame F;
+    F.mpORBvocabulary = mpVocabulary;
+    F.mpORBextractorLeft = F.mpORBextractorRight = static_cast<ORBextractor*>(NULL);
+    F.mTimeStamp = s;
+    F.mK = mK.clone();
+    F.mDistCoef = mDistCoef.clone();
+    F.mbf = mbf;
+    F.mb = mbf/Frame::fx;
+    F.mThDepth = mThDepth;
+    F.mnId = Frame::nNextId++;
+    F.mpReferenceKF = static_cast<KeyFrame*>(NULL);
+
+    F.mnScaleLevels = mnLevels;
+    F.mfScaleFactor = mfScaleFactor;
+    F.mfLogScaleFactor = log(mfScaleFactor);
+    F.mvScaleFactors = mvScaleFactors;
+    F.mvInvScaleFactors = mvInvScaleFactors;
+    F.mvLevelSigma2 = mvLevelSigma2;
+    F.mvInvLevelSigma2 = mvInvLevelSigma2;
+
+    const int N = vKeys.size();
+    F.N = N;
+    F.mvKeys = vKeys;
+    F.mvKeysUn = vKeys;
+    F.mvuRight = vector<float>(N,-1);
+    F.mvDepth = vector<float>(N,-1);
+    F.mDescriptors = cv::Mat(N,32,CV_8U);
+    F.mvpMapPoints = vector<MapPoint*>(N,static_cast<MapPoint*>(NULL));
+    F.mvbOutlier = vector<bool>(N,false);
+
+    for(int i=0; i<N; i++)
+    {
+        const Landmark &lm = mvLandmarks[vIndices[i]];
+
+        // The descriptor of the landmark with a few bits flipped
+        cv::Mat d = F.mDescriptors.row(i);
+        lm.descriptor.copyTo(d);
+        for(int b=0; b<mnDescriptorNoise; b++)
+        {
+            const int bit = mRng.uniform(0,256);
+            d.at<unsigned char>(bit/8) ^= (1 << (bit%8));
+        }
+
+        if(mbStereo)
+        {
+            F.mvDepth[i] = vDepths[i];
+            F.mvuRight[i] = vKeys[i].pt.x-mbf/vDepths[i];
+        }
+
+        const int nGridPosX = round((vKeys[i].pt.x-Frame::mnMinX)*Frame::mfGridElementWidthInv);
+        const int nGridPosY = round((vKeys[i].pt.y-Frame::mnMinY)*Frame::mfGridElementHeightInv);
+        if(nGridPosX>=0 && nGridPosX<FRAME_GRID_COLS && nGridPosY>=0 && nGridPosY<FRAME_GRID_ROWS)
+            F.mGrid[nGridPosX][nGridPosY].push_back(i);
+    }
+
+    F.SetPose(EstimatedPose(s));
+    F.ComputeBoW();
+
+    return F;
+}
+
+KeyFrame* SyntheticMap::AddKeyFrame()
+{
+    if(mpPendingKF)
+    {
+        mpKeyFrameDB->add(mpPendingKF);
+        mpPendingKF = static_cast<KeyFrame*>(NULL);
+    }
+
+    const double s = mvpKeyFrames.size()*mKeyFrameSpacing;
+    CreateLandmarks(s+mMaxDepth+mCorridorWidth+1);
+
+    vector<cv::KeyPoint> vKeys;
+    vector<float> vDepths;
+    const vector<size_t> vIndices = VisibleLandmarks(s,vKeys,vDepths);
+    Frame F = BuildFrame(s,vIndices,vKeys,vDepths);
+
+    KeyFrame* pKF = new KeyFrame(F,mpMap,mpKeyFrameDB);
+    pKF->ComputeBoW();
+
+    const int nLap = mTrajectory==CIRCUIT ? int(s/mLapLength) : 0;
+    const cv::Point3f d = Drift(s);
+    const cv::Mat dw = (cv::Mat_<float>(3,1) << d.x, d.y, d.z);
+
+    // Landmarks seen for the first time (or in a new lap if loops are not closed) are new MapPoints
+    vector<MapPoint*> vpObserved;
+    vpObserved.reserve(vIndices.size());
+    for(size_t i=0; i<vIndices.size(); i++)
+    {
+        Landmark &lm = mvLandmarks[vIndices[i]];
+        if(!lm.pMP || lm.pMP->isBad() || (!mbCloseLoops && lm.nLap!=nLap))
+        {
+            cv::Mat Pw = lm.Pw+dw;
+            lm.pMP = new MapPoint(Pw,pKF,mpMap);
+            lm.nLap = nLap;
+            mpMap->AddMapPoint(lm.pMP);
+            mnMapPoints++;
+        }
+
+        lm.pMP->AddObservation(pKF,i);
+        pKF->AddMapPoint(lm.pMP,i);
+        vpObserved.push_back(lm.pMP);
+        mnObservations++;
+    }
+
+    for(size_t i=0; i<vpObserved.size(); i++)
+    {
+        vpObserved[i]->UpdateNormalAndDepth();
+        vpObserved[i]->ComputeDistinctiveDescriptors();
+    }
+
+    if(mvpKeyFrames.empty())
+    {
+        pKF->SetOrigin(true);
+        mpMap->mvpKeyFrameOrigins.push_back(pKF);
+    }
+
+    pKF->UpdateConnections();
+    mpMap->AddKeyFrame(pKF);
+    mpMap->SetReferenceMapPoints(vpObserved);
+
+    mvpKeyFrames.push_back(pKF);
+
+    // A loop edge where each lap starts, as the loop closure would have added
+    if(mbCloseLoops && nLap>0 && int((s-mKeyFrameSpacing)/mLapLength)<nLap)
+    {
+        KeyFrame* pLoopKF = GetPreviousLapKeyFrame(pKF);
+        if(pLoopKF)
+        {
+            pLoopKF->AddLoopEdge(pKF);
+            pKF->AddLoopEdge(pLoopKF);
+        }
+    }
+
+    mpPendingKF = pKF;
+
+    return pKF;
+}
+
+Frame SyntheticMap::CreateFrame(const double s)
+{
+    CreateLandmarks(s+mMaxDepth+mCorridorWidth+1);
+
+    vector<cv::KeyPoint> vKeys;
+    vector<float> vDepths;
+    const vector<size_t> vIndices = VisibleLandmarks(s,vKeys,vDepths);
+    return BuildFrame(s,vIndices,vKeys,vDepths);
+}
+
+KeyFrame* SyntheticMap::GetPreviousLapKeyFrame(KeyFrame* pKF)
+{
+    if(mTrajectory!=CIRCUIT || mvpKeyFrames.empty() || pKF->mnId<mvpKeyFrames.front()->mnId)
+        return static_cast<KeyFrame*>(NULL);
+
+    const long idx = pKF->mnId-mvpKeyFrames.front()->mnId;
+    const long nPerLap = round(mLapLength/mKeyFrameSpacing);
+    if(idx>=(long)mvpKeyFrames.size() || idx<nPerLap)
+        return static_cast<KeyFrame*>(NULL);
+
+    return mvpKeyFrames[idx-nPerLap];
+}
+
+int SyntheticMap::KeyFramesAdded() const
+{
+    return mvpKeyFrames.size();
+}
+
+long SyntheticMap::MapPointsCreated() const
+{
+    return mnMapPoints;
+}
+
+long SyntheticMap::Observations() const
+{
+    return mnObservations;
+}
+
+double SyntheticMap::TrajectoryLength() const
+{
+    return mvpKeyFrames.size()*mKeyFrameSpacing;
+}
+
+bool SyntheticMap::LoopsClosed() const
+{
+    return mbCloseLoops;
+}
+
+} //namespace ORB_SLAM
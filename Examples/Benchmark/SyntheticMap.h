@@ -0,0 +1,159 @@
+/**
+* This file is part of ORB-SLAM2.
+*
+* Copyright (C) 2014-2016 Raúl Mur-Artal <raulmur at unizar dot es> (University of Zaragoza)
+* For more information see <https://github.com/raulmur/ORB_SLAM2>
+*
+* ORB-SLAM2 is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM2 is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with ORB-SLAM2. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SYNTHETICMAP_H
+#define SYNTHETICMAP_H
+
+#include <string>
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+
+#include "Map.h"
+#include "KeyFrame.h"
+#include "MapPoint.h"
+#include "Frame.h"
+#include "KeyFrameDatabase.h"
+#include "ORBVocabulary.h"
+
+namespace ORB_SLAM2
+{
+
+// Builds a map as the mapping threads would, through the KeyFrame, MapPoint, Map and
+// KeyFrameDatabase interfaces, without images. The camera moves along a circuit (closed laps,
+// so the same places are revisited) or a straight corridor, looking forward. Landmarks are
+// scattered on the walls at each side of the path and keep a descriptor, so that the
+// observations of a landmark are similar and its revisits are found by the BoW queries.
+//
+// If loops are closed the landmarks of previous laps are observed again by the same MapPoints,
+// as after loop closing and fusion. Otherwise every lap creates new MapPoints and the estimated
+// poses drift, as before a loop is detected.
+class SyntheticMap
+{
+public:
+
+    enum eTrajectory
+    {
+        CIRCUIT=0,
+        CORRIDOR=1
+    };
+
+    // Camera and ORB parameters are read as in Tracking, the generator from the Synthetic.* keys
+    SyntheticMap(const std::string &strSettingPath, ORBVocabulary* pVoc, Map* pMap, KeyFrameDatabase* pKFDB);
+
+    // Adds the next keyframe of the trajectory with its observations. The previous keyframe is
+    // inserted in the database first, as LoopClosing queries the database before inserting.
+    KeyFrame* AddKeyFrame();
+
+    // Frame at the given distance along the trajectory, with keypoints and BoW but no matches
+    Frame CreateFrame(const double s);
+
+    // Keyframe of a previous lap closest to the place of pKF, NULL if it is the first lap
+    KeyFrame* GetPreviousLapKeyFrame(KeyFrame* pKF);
+
+    int KeyFramesAdded() const;
+    long MapPointsCreated() const;
+    long Observations() const;
+    double TrajectoryLength() const;
+    bool LoopsClosed() const;
+
+protected:
+
+    struct Landmark
+    {
+        cv::Mat Pw;
+        cv::Mat descriptor;
+        float angle;
+        // Distance at which it is detected in the first level of the pyramid
+        float refDistance;
+        MapPoint* pMP;
+        int nLap;
+    };
+
+    // Position on the path, lateral direction (camera x) and direction of motion (camera z)
+    void PathFrame(const double s, cv::Point3f &p, cv::Point3f &x, cv::Point3f &z) const;
+
+    // True pose of the camera (world to camera) at a distance s along the trajectory
+    cv::Mat TruePose(const double s) const;
+
+    // Pose estimated by the map, with drift if loops are not closed
+    cv::Mat EstimatedPose(const double s) const;
+    cv::Point3f Drift(const double s) const;
+
+    // Creates the landmarks of the path up to s (corridor) or of the whole lap (circuit)
+    void CreateLandmarks(const double s);
+
+    // Indices of the landmarks projecting in the image at s, at most the features per keyframe
+    std::vector<size_t> VisibleLandmarks(const double s, std::vector<cv::KeyPoint> &vKeys, std::vector<float> &vDepths);
+
+    Frame BuildFrame(const double s, const std::vector<size_t> &vIndices, const std::vector<cv::KeyPoint> &vKeys,
+                     const std::vector<float> &vDepths);
+
+protected:
+
+    ORBVocabulary* mpVocabulary;
+    Map* mpMap;
+    KeyFrameDatabase* mpKeyFrameDB;
+
+    // Calibration
+    cv::Mat mK;
+    cv::Mat mDistCoef;
+    float mbf;
+    float mThDepth;
+    int mnWidth;
+    int mnHeight;
+    bool mbStereo;
+
+    // Scale pyramid
+    int mnLevels;
+    float mfScaleFactor;
+    std::vector<float> mvScaleFactors;
+    std::vector<float> mvInvScaleFactors;
+    std::vector<float> mvLevelSigma2;
+    std::vector<float> mvInvLevelSigma2;
+
+    // Generator parameters
+    int mTrajectory;
+    double mLapLength;
+    double mKeyFrameSpacing;
+    double mLandmarksPerMeter;
+    double mCorridorWidth;
+    double mMaxDepth;
+    int mnFeatures;
+    int mnDescriptorNoise;
+    bool mbCloseLoops;
+    double mDrift;
+
+    cv::RNG mRng;
+
+    // Landmarks sorted by their position along the path
+    std::vector<Landmark> mvLandmarks;
+    std::vector<double> mvLandmarkS;
+    double mLandmarksEnd;
+
+    std::vector<KeyFrame*> mvpKeyFrames;
+    KeyFrame* mpPendingKF;
+    long mnMapPoints;
+    long mnObservations;
+};
+
+} //namespace ORB_SLAM
+
+#endif // SYNTHETICMAP_H
@@ -0,0 +1,658 @@
+/**
+* This file is part of ORB-SLAM2.
+*
+* Copyright (C) 2014-2016 Raúl Mur-Artal <raulmur at unizar dot es> (University of Zaragoza)
+* For more information see <https://github.com/raulmur/ORB_SLAM2>
+*
+* ORB-SLAM2 is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM2 is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with ORB-SLAM2. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Microbenchmarks of the matching kernels: descriptor distance, grid search, BoW transform and
+// score, every ORBmatcher search and the KeyFrameDatabase queries. Frames are extracted from a
+// TUM sequence or from synthetic images, keyframes are given a pose and one MapPoint per keypoint.
+// Synthetic images are views of a plane, so poses and depths follow from the known motion. A
+// sequence has no ground truth and is given nominal poses. Results are printed to stdout as JSON,
+// progress to stderr.
+
+#include<iostream>
+#include<algorithm>
+#include<fstream>
+#include<sstream>
+#include<chrono>
+#include<iomanip>
+#include<cmath>
+
+#include<opencv2/core/core.hpp>
+#include<opencv2/imgproc/imgproc.hpp>
+#include<opencv2/highgui/highgui.hpp>
+
+#include"Frame.h"
+#include"KeyFrame.h"
+#include"MapPoint.h"
+#include"Map.h"
+#include"KeyFrameDatabase.h"
+#include"ORBmatcher.h"
+#include"ORBextractor.h"
+#include"ORBVocabulary.h"
+#include"Converter.h"
+
+using namespace std;
+using namespace ORB_SLAM2;
+
+struct BenchResult
+{
+    string kernel;
+    int nFeatures;
+    string param;
+    long nCalls;
+    double meanUs;
+    double medianUs;
+    double minUs;
+    double throughput;
+    string unit;
+};
+
+vector<BenchResult> gvResults;
+
+// Minimum measured time per kernel and configuration
+double gMinSeconds = 0.5;
+
+// Keeps the results of the kernels alive
+volatile long gSink = 0;
+
+void LoadImages(const string &strFile, vector<string> &vstrImageFilenames);
+
+// Textured plane at the given depth and a camera sliding over it and rotating around its optical
+// axis. Returns the images and the poses (world to camera, world is the first camera).
+void GenerateImages(const int w, const int h, const int nImages, const cv::Mat &K, const float depth,
+                    vector<cv::Mat> &vIms, vector<cv::Mat> &vTcw);
+
+cv::Mat ComputeF12(KeyFrame* pKF1, KeyFrame* pKF2);
+
+// Runs f in batches sized to take at least 1ms. Per call latency is taken from the batches and
+// the throughput is items per second, where items is the work done by one call.
+template<typename Func>
+void Measure(const string &kernel, const int nFeatures, const string &param, const double items, const string &unit, Func f)
+{
+    typedef chrono::steady_clock Clock;
+
+    long nBatch = 1;
+    double tBatch = 0;
+    while(true)
+    {
+        Clock::time_point t1 = Clock::now();
+        for(long i=0; i<nBatch; i++)
+            gSink += f();
+        Clock::time_point t2 = Clock::now();
+        tBatch = chrono::duration_cast<chrono::duration<double> >(t2-t1).count();
+        if(tBatch>=1e-3 || nBatch>=(1<<24))
+            break;
+        nBatch*=2;
+    }
+
+    vector<double> vTimes;
+    double total = 0;
+    while(vTimes.size()<5 || (total<gMinSeconds && vTimes.size()<10000))
+    {
+        Clock::time_point t1 = Clock::now();
+        for(long i=0; i<nBatch; i++)
+            gSink += f();
+        Clock::time_point t2 = Clock::now();
+        const double t = chrono::duration_cast<chrono::duration<double> >(t2-t1).count();
+        vTimes.push_back(t/nBatch);
+        total += t;
+    }
+
+    sort(vTimes.begin(),vTimes.end());
+
+    BenchResult r;
+    r.kernel = kernel;
+    r.nFeatures = nFeatures;
+    r.param = param;
+    r.nCalls = nBatch*vTimes.size();
+    r.meanUs = 1e6*total/r.nCalls;
+    r.medianUs = 1e6*vTimes[vTimes.size()/2];
+    r.minUs = 1e6*vTimes.front();
+    r.throughput = r.meanUs>0 ? items*1e6/r.meanUs : 0;
+    r.unit = unit;
+    gvResults.push_back(r);
+
+    cerr << "  " << kernel << " " << param << ": " << r.medianUs << " us" << endl;
+}
+
+int main(int argc, char **argv)
+{
+    if(argc < 3 || argc > 5)
+    {
+        cerr << endl << "Usage: ./bench_matching path_to_vocabulary path_to_settings [path_to_sequence|synthetic] [max_frames]" << endl;
+        return 1;
+    }
+
+    string strSequence = argc>3 ? string(argv[3]) : string("synthetic");
+    int nMaxFrames = argc>4 ? atoi(argv[4]) : 20;
+    if(nMaxFrames<3)
+        nMaxFrames = 3;
+
+    cv::FileStorage fSettings(argv[2], cv::FileStorage::READ);
+    if(!fSettings.isOpened())
+    {
+        cerr << "Failed to open settings file at: " << argv[2] << endl;
+        return 1;
+    }
+
+    float fx = fSettings["Camera.fx"];
+    float fy = fSettings["Camera.fy"];
+    float cx = fSettings["Camera.cx"];
+    float cy = fSettings["Camera.cy"];
+
+    cv::Mat K = cv::Mat::eye(3,3,CV_32F);
+    K.at<float>(0,0) = fx;
+    K.at<float>(1,1) = fy;
+    K.at<float>(0,2) = cx;
+    K.at<float>(1,2) = cy;
+
+    cv::Mat DistCoef(4,1,CV_32F);
+    DistCoef.at<float>(0) = fSettings["Camera.k1"];
+    DistCoef.at<float>(1) = fSettings["Camera.k2"];
+    DistCoef.at<float>(2) = fSettings["Camera.p1"];
+    DistCoef.at<float>(3) = fSettings["Camera.p2"];
+
+    float bf = fSettings["Camera.bf"];
+    cv::FileNode thDepthNode = fSettings["ThDepth"];
+    float thDepth = bf*(thDepthNode.empty() ? 35.0f : (float)thDepthNode)/fx;
+
+    float fScaleFactor = fSettings["ORBextractor.scaleFactor"];
+    int nLevels = fSettings["ORBextractor.nLevels"];
+    int fIniThFAST = fSettings["ORBextractor.iniThFAST"];
+    int fMinThFAST = fSettings["ORBextractor.minThFAST"];
+
+    // Input images, poses and depth of the scene
+    vector<cv::Mat> vIms;
+    vector<cv::Mat> vTcw;
+    const float sceneDepth = 3.0f;
+    if(strSequence=="synthetic")
+    {
+        int w = fSettings["Camera.width"];
+        int h = fSettings["Camera.height"];
+        if(w<=0 || h<=0)
+        {
+            w = 2*cx+1;
+            h = 2*cy+1;
+        }
+        GenerateImages(w,h,nMaxFrames,K,sceneDepth,vIms,vTcw);
+    }
+    else
+    {
+        vector<string> vstrImageFilenames;
+        LoadImages(strSequence+"/rgb.txt",vstrImageFilenames);
+        for(size_t i=0; i<vstrImageFilenames.size() && (int)vIms.size()<nMaxFrames; i++)
+        {
+            cv::Mat im = cv::imread(strSequence+"/"+vstrImageFilenames[i],CV_LOAD_IMAGE_GRAYSCALE);
+            if(im.empty())
+            {
+                cerr << "Failed to load image at: " << strSequence << "/" << vstrImageFilenames[i] << endl;
+                return 1;
+            }
+            vIms.push_back(im);
+
+            // Nominal pose, the camera moves 2cm to the right between frames
+            cv::Mat Tcw = cv::Mat::eye(4,4,CV_32F);
+            Tcw.at<float>(0,3) = -0.02f*vTcw.size();
+            vTcw.push_back(Tcw);
+        }
+    }
+
+    if(vIms.size()<3)
+    {
+        cerr << "At least 3 images are needed" << endl;
+        return 1;
+    }
+
+    cerr << "Loading ORB Vocabulary..." << endl;
+    ORBVocabulary voc;
+    if(!voc.loadFromTextFile(argv[1]))
+    {
+        cerr << "Failed to open vocabulary at: " << argv[1] << endl;
+        return 1;
+    }
+
+    const int nFrames = vIms.size();
+    const int vnFeatures[] = {500, 1000, 2000};
+
+    for(int iF=0; iF<3; iF++)
+    {
+        const int nFeatures = vnFeatures[iF];
+        cerr << "Features: " << nFeatures << endl;
+
+        ORBextractor extractor(nFeatures,fScaleFactor,nLevels,fIniThFAST,fMinThFAST);
+
+        vector<Frame> vFrames;
+        vFrames.reserve(nFrames);
+        for(int i=0; i<nFrames; i++)
+        {
+            vFrames.push_back(Frame(vIms[i],0.033*i,&extractor,&voc,K,DistCoef,bf,thDepth));
+            vFrames.back().SetPose(vTcw[i]);
+            vFrames.back().ComputeFeatVec();
+        }
+
+        // Keyframes with a MapPoint for each keypoint, on the plane of the scene
+        Map* pMap = new Map();
+        KeyFrameDatabase* pKFDB = new KeyFrameDatabase(voc);
+        vector<KeyFrame*> vpKFs;
+        for(int i=0; i<nFrames; i++)
+        {
+            Frame &F = vFrames[i];
+            KeyFrame* pKF = new KeyFrame(F,pMap,pKFDB);
+            pKF->ComputeBoW();
+            pMap->AddKeyFrame(pKF);
+
+            cv::Mat Twc = F.mTcw.inv();
+            for(int j=0; j<F.N; j++)
+            {
+                const float z = sceneDepth;
+                cv::Mat x3Dc = (cv::Mat_<float>(4,1) << (F.mvKeysUn[j].pt.x-cx)*z/fx, (F.mvKeysUn[j].pt.y-cy)*z/fy, z, 1.0f);
+                cv::Mat x3Dw = (Twc*x3Dc).rowRange(0,3);
+
+                MapPoint* pMP = new MapPoint(x3Dw,pKF,pMap);
+                pMP->AddObservation(pKF,j);
+                pKF->AddMapPoint(pMP,j);
+                pMP->ComputeDistinctiveDescriptors();
+                pMP->UpdateNormalAndDepth();
+                pMap->AddMapPoint(pMP);
+                F.mvpMapPoints[j] = pMP;
+            }
+            vpKFs.push_back(pKF);
+        }
+
+        long nPairs = 0;
+        for(int i=0; i+1<nFrames; i++)
+            nPairs += min(vFrames[i].N,vFrames[i+1].N);
+        const double avgN = double(nPairs)/(nFrames-1);
+
+        ORBmatcher matcher(0.75,true);
+        ORBmatcher matcherBoW(0.7,true);
+        int idx = 0;
+
+        // Descriptor distance
+        {
+            const cv::Mat &D1 = vFrames[0].mDescriptors;
+            const cv::Mat &D2 = vFrames[1].mDescriptors;
+            const int n = min(D1.rows,D2.rows);
+            Measure("DescriptorDistance",nFeatures,"mat",1,"distances/s",[&]()
+            {
+                idx = (idx+1)%n;
+                return ORBmatcher::DescriptorDistance(D1.row(idx),D2.row(n-1-idx));
+            });
+
+            const uint64_t* p1 = D1.ptr<uint64_t>();
+            const uint64_t* p2 = D2.ptr<uint64_t>();
+            Measure("DescriptorDistance",nFeatures,"u64",1,"distances/s",[&]()
+            {
+                idx = (idx+1)%n;
+                return ORBmatcher::DescriptorDistance(p1+4*idx,p2+4*(n-1-idx));
+            });
+        }
+
+        // Grid search at the positions of the keypoints of the next frame
+        const float vRadius[] = {10, 25, 50, 100};
+        for(int ir=0; ir<4; ir++)
+        {
+            const float r = vRadius[ir];
+            const Frame &F1 = vFrames[0];
+            const Frame &F2 = vFrames[1];
+            stringstream ss;
+            ss << "r=" << r;
+            Measure("Frame::GetFeaturesInArea",nFeatures,ss.str(),1,"queries/s",[&]()
+            {
+                idx = (idx+1)%F2.N;
+                return (long)F1.GetFeaturesInArea(F2.mvKeysUn[idx].pt.x,F2.mvKeysUn[idx].pt.y,r).size();
+            });
+        }
+
+        // Vocabulary
+        {
+            vector<vector<cv::Mat> > vvDesc(nFrames);
+            for(int i=0; i<nFrames; i++)
+                vvDesc[i] = Converter::toDescriptorVector(vFrames[i].mDescriptors);
+
+            double avgFeatures = 0;
+            for(int i=0; i<nFrames; i++)
+                avgFeatures += vFrames[i].N;
+            avgFeatures /= nFrames;
+
+            Measure("ORBVocabulary::transform",nFeatures,"words",avgFeatures,"features/s",[&]()
+            {
+                idx = (idx+1)%nFrames;
+                DBoW2::BowVector bow;
+                vector<DBoW2::WordId> vWords;
+                voc.transform(vvDesc[idx],bow,vWords);
+                return (long)bow.size();
+            });
+
+            Measure("ORBVocabulary::transform",nFeatures,"words+featvec",avgFeatures,"features/s",[&]()
+            {
+                idx = (idx+1)%nFrames;
+                DBoW2::BowVector bow;
+                DBoW2::FeatureVector fv;
+                voc.transform(vvDesc[idx],bow,fv,4);
+                return (long)fv.size();
+            });
+
+            Measure("ORBVocabulary::getFeatureVector",nFeatures,"levelsup=4",avgFeatures,"features/s",[&]()
+            {
+                idx = (idx+1)%nFrames;
+                DBoW2::FeatureVector fv;
+                voc.getFeatureVector(vpKFs[idx]->mvBowWords,fv,4);
+                return (long)fv.size();
+            });
+
+            Measure("ORBVocabulary::score",nFeatures,"",1,"scores/s",[&]()
+            {
+                idx = (idx+1)%nFrames;
+                const int j = (idx+nFrames/2)%nFrames;
+                return (long)(1e6*voc.score(vpKFs[idx]->mBowVec,vpKFs[j]->mBowVec));
+            });
+        }
+
+        // Searches between consecutive keyframes and frames. Outputs that are also inputs are
+        // restored before each call.
+        Measure("ORBmatcher::SearchByBoW",nFeatures,"KF-F",avgN,"features/s",[&]()
+        {
+            idx = (idx+1)%(nFrames-1);
+            vector<MapPoint*> vpMatches;
+            return matcherBoW.SearchByBoW(vpKFs[idx],vFrames[idx+1],vpMatches);
+        });
+
+        Measure("ORBmatcher::SearchByBoW",nFeatures,"KF-KF",avgN,"features/s",[&]()
+        {
+            idx = (idx+1)%(nFrames-1);
+            vector<MapPoint*> vpMatches;
+            return matcher.SearchByBoW(vpKFs[idx],vpKFs[idx+1],vpMatches);
+        });
+
+        {
+            vector<vector<MapPoint*> > vvpMatches(nFrames-1);
+            vector<cv::Mat> vF12(nFrames-1), vR12(nFrames-1), vt12(nFrames-1);
+            for(int i=0; i+1<nFrames; i++)
+            {
+                matcher.SearchByBoW(vpKFs[i],vpKFs[i+1],vvpMatches[i]);
+                vF12[i] = ComputeF12(vpKFs[i],vpKFs[i+1]);
+                cv::Mat R1w = vpKFs[i]->GetRotation();
+                cv::Mat t1w = vpKFs[i]->GetTranslation();
+                cv::Mat R2w = vpKFs[i+1]->GetRotation();
+                cv::Mat t2w = vpKFs[i+1]->GetTranslation();
+                vR12[i] = R1w*R2w.t();
+                vt12[i] = -vR12[i]*t2w+t1w;
+            }
+
+            Measure("ORBmatcher::SearchForTriangulation",nFeatures,"",avgN,"features/s",[&]()
+            {
+                idx = (idx+1)%(nFrames-1);
+                vector<pair<size_t,size_t> > vMatchedPairs;
+                return matcher.SearchForTriangulation(vpKFs[idx],vpKFs[idx+1],vF12[idx],vMatchedPairs,false);
+            });
+
+            Measure("ORBmatcher::SearchBySim3",nFeatures,"th=7.5",avgN,"features/s",[&]()
+            {
+                idx = (idx+1)%(nFrames-1);
+                vector<MapPoint*> vpMatches = vvpMatches[idx];
+                return matcher.SearchBySim3(vpKFs[idx],vpKFs[idx+1],vpMatches,1.0f,vR12[idx],vt12[idx],7.5);
+            });
+
+            Measure("ORBmatcher::SearchByProjection",nFeatures,"loop th=10",avgN,"points/s",[&]()
+            {
+                idx = (idx+1)%(nFrames-1);
+                vector<MapPoint*> vpMatched(vvpMatches[idx].size(),static_cast<MapPoint*>(NULL));
+                return matcher.SearchByProjection(vpKFs[idx+1],vpKFs[idx+1]->GetPose(),vpKFs[idx]->GetMapPointMatches(),vpMatched,10);
+            });
+        }
+
+        Measure("ORBmatcher::SearchByProjection",nFeatures,"last frame th=7",avgN,"points/s",[&]()
+        {
+            idx = (idx+1)%(nFrames-1);
+            Frame &F = vFrames[idx+1];
+            vector<MapPoint*> vpBackup(F.N,static_cast<MapPoint*>(NULL));
+            F.mvpMapPoints.swap(vpBackup);
+            const int nmatches = matcher.SearchByProjection(F,vFrames[idx],7,true);
+            F.mvpMapPoints.swap(vpBackup);
+            return nmatches;
+        });
+
+        Measure("ORBmatcher::SearchByProjection",nFeatures,"relocalization th=10",avgN,"points/s",[&]()
+        {
+            idx = (idx+1)%(nFrames-1);
+            Frame &F = vFrames[idx+1];
+            vector<MapPoint*> vpBackup(F.N,static_cast<MapPoint*>(NULL));
+            F.mvpMapPoints.swap(vpBackup);
+            const int nmatches = matcher.SearchByProjection(F,vpKFs[idx],set<MapPoint*>(),10,100);
+            F.mvpMapPoints.swap(vpBackup);
+            return nmatches;
+        });
+
+        // Local map search of the middle frame against the points of the previous keyframes.
+        // The projection of each point is stored in the MapPoint, so the frame is fixed.
+        {
+            const int nMid = nFrames/2;
+            Frame &F = vFrames[nMid];
+            vector<MapPoint*> vpLocalMapPoints;
+            for(int i=max(0,nMid-3); i<nMid; i++)
+            {
+                const vector<MapPoint*> vpMPs = vpKFs[i]->GetMapPointMatches();
+                for(size_t j=0; j<vpMPs.size(); j++)
+                    if(vpMPs[j] && F.isInFrustum(vpMPs[j],0.5))
+                        vpLocalMapPoints.push_back(vpMPs[j]);
+            }
+
+            const float vTh[] = {1, 3, 5};
+            for(int it=0; it<3; it++)
+            {
+                const float th = vTh[it];
+                stringstream ss;
+                ss << "local map th=" << th;
+                Measure("ORBmatcher::SearchByProjection",nFeatures,ss.str(),vpLocalMapPoints.size(),"points/s",[&]()
+                {
+                    vector<MapPoint*> vpBackup(F.N,static_cast<MapPoint*>(NULL));
+                    F.mvpMapPoints.swap(vpBackup);
+                    const int nmatches = matcher.SearchByProjection(F,vpLocalMapPoints,th);
+                    F.mvpMapPoints.swap(vpBackup);
+                    return nmatches;
+                });
+            }
+        }
+
+        // Monocular initialization with the windows used by Tracking
+        const int vWindow[] = {10, 50, 100};
+        for(int iw=0; iw<3; iw++)
+        {
+            const int window = vWindow[iw];
+            vector<vector<cv::Point2f> > vvPrevMatched(nFrames-1);
+            for(int i=0; i+1<nFrames; i++)
+            {
+                vvPrevMatched[i].resize(vFrames[i].N);
+                for(int j=0; j<vFrames[i].N; j++)
+                    vvPrevMatched[i][j] = vFrames[i].mvKeysUn[j].pt;
+            }
+
+            ORBmatcher matcherIni(0.9,true);
+            stringstream ss;
+            ss << "window=" << window;
+            Measure("ORBmatcher::SearchForInitialization",nFeatures,ss.str(),avgN,"features/s",[&]()
+            {
+                idx = (idx+1)%(nFrames-1);
+                vector<cv::Point2f> vPrevMatched = vvPrevMatched[idx];
+                vector<int> vnMatches12;
+                return matcherIni.SearchForInitialization(vFrames[idx],vFrames[idx+1],vPrevMatched,vnMatches12,window);
+            });
+        }
+
+        // Database queries as the database grows
+        int nAdded = 0;
+        const int vSizes[] = {max(1,nFrames/4), max(1,nFrames/2), nFrames};
+        for(int is=0; is<3; is++)
+        {
+            if(is>0 && vSizes[is]==vSizes[is-1])
+                continue;
+
+            while(nAdded<vSizes[is])
+                pKFDB->add(vpKFs[nAdded++]);
+
+            stringstream ss;
+            ss << "keyframes=" << nAdded;
+            Measure("KeyFrameDatabase::DetectRelocalizationCandidates",nFeatures,ss.str(),nAdded,"keyframes/s",[&]()
+            {
+                idx = (idx+1)%nFrames;
+                return (long)pKFDB->DetectRelocalizationCandidates(&vFrames[idx]).size();
+            });
+
+            Measure("KeyFrameDatabase::DetectLoopCandidates",nFeatures,ss.str(),nAdded,"keyframes/s",[&]()
+            {
+                idx = (idx+1)%nFrames;
+                return (long)pKFDB->DetectLoopCandidates(vpKFs[idx],0.015).size();
+            });
+        }
+
+        pKFDB->clear();
+        delete pKFDB;
+        delete pMap;
+    }
+
+    // Results
+    cout << fixed;
+    cout << "{" << endl;
+    cout << "  \"sequence\": \"" << strSequence << "\"," << endl;
+    cout << "  \"frames\": " << nFrames << "," << endl;
+    cout << "  \"results\": [" << endl;
+    for(size_t i=0; i<gvResults.size(); i++)
+    {
+        const BenchResult &r = gvResults[i];
+        cout << "    {\"kernel\": \"" << r.kernel << "\", \"features\": " << r.nFeatures
+             << ", \"param\": \"" << r.param << "\", \"calls\": " << r.nCalls
+             << setprecision(3) << ", \"mean_us\": " << r.meanUs << ", \"median_us\": " << r.medianUs
+             << ", \"min_us\": " << r.minUs << setprecision(1) << ", \"throughput\": " << r.throughput
+             << ", \"unit\": \"" << r.unit << "\"}" << (i+1<gvResults.size() ? "," : "") << endl;
+    }
+    cout << "  ]" << endl;
+    cout << "}" << endl;
+
+    return 0;
+}
+
+void LoadImages(const string &strFile, vector<string> &vstrImageFilenames)
+{
+    ifstream f;
+    f.open(strFile.c_str());
+
+    // skip first three lines
+    string s0;
+    getline(f,s0);
+    getline(f,s0);
+    getline(f,s0);
+
+    while(!f.eof())
+    {
+        string s;
+        getline(f,s);
+        if(!s.empty())
+        {
+            stringstream ss;
+            ss << s;
+            double t;
+            string sRGB;
+            ss >> t;
+            ss >> sRGB;
+            vstrImageFilenames.push_back(sRGB);
+        }
+    }
+}
+
+void GenerateImages(const int w, const int h, const int nImages, const cv::Mat &K, const float depth,
+                    vector<cv::Mat> &vIms, vector<cv::Mat> &vTcw)
+{
+    const float fx = K.at<float>(0,0);
+    const float fy = K.at<float>(1,1);
+    const float cx = K.at<float>(0,2);
+    const float cy = K.at<float>(1,2);
+
+    cv::RNG rng(12345);
+
+    // Shapes of several sizes give corners at every pyramid level, smoothed noise fills the rest
+    const int W = 2*w;
+    const int H = 2*h;
+    cv::Mat scene(H,W,CV_8U,cv::Scalar(128));
+    for(int i=0; i<W*H/2000; i++)
+    {
+        const cv::Point c(rng.uniform(0,W),rng.uniform(0,H));
+        const int s = rng.uniform(3,60);
+        const cv::Scalar color(rng.uniform(0,256));
+        if(rng.uniform(0,2))
+            cv::rectangle(scene,c,c+cv::Point(s,rng.uniform(3,60)),color,-1);
+        else
+            cv::circle(scene,c,s/2,color,-1);
+    }
+
+    cv::Mat noise(H/8,W/8,CV_8U);
+    rng.fill(noise,cv::RNG::UNIFORM,0,256);
+    cv::resize(noise,noise,scene.size(),0,0,cv::INTER_CUBIC);
+    cv::addWeighted(scene,0.8,noise,0.2,0,scene);
+
+    for(int i=0; i<nImages; i++)
+    {
+        cv::Mat A = cv::getRotationMatrix2D(cv::Point2f(W/2,H/2),0.5*i,1.0);
+        A.at<double>(0,2) -= w/2+4*i;
+        A.at<double>(1,2) -= h/2+2*i;
+        cv::Mat im;
+        cv::warpAffine(scene,im,A,cv::Size(w,h),cv::INTER_LINEAR);
+        vIms.push_back(im);
+
+        // A point of the first image p0 is seen at p = M*(p0+o0)+a, with A = [M|a] and o0 the
+        // offset of the first image in the scene. Relative to the principal point c:
+        //   p-c = M*(p0-c) + M*(c+o0)+a-c
+        // The plane is at the same depth in every camera, M is a rotation around the optical axis
+        // and the image offset a translation parallel to the plane (square pixels assumed).
+        const float m00 = A.at<double>(0,0), m01 = A.at<double>(0,1);
+        const float m10 = A.at<double>(1,0), m11 = A.at<double>(1,1);
+        const float ox = cx+w/2, oy = cy+h/2;
+        const float bx = m00*ox+m01*oy+A.at<double>(0,2)-cx;
+        const float by = m10*ox+m11*oy+A.at<double>(1,2)-cy;
+
+        cv::Mat Tcw = cv::Mat::eye(4,4,CV_32F);
+        Tcw.at<float>(0,0) = m00;
+        Tcw.at<float>(0,1) = m01;
+        Tcw.at<float>(1,0) = m10;
+        Tcw.at<float>(1,1) = m11;
+        Tcw.at<float>(0,3) = bx*depth/fx;
+        Tcw.at<float>(1,3) = by*depth/fy;
+        vTcw.push_back(Tcw);
+    }
+}
+
+cv::Mat ComputeF12(KeyFrame* pKF1, KeyFrame* pKF2)
+{
+    cv::Mat R1w = pKF1->GetRotation();
+    cv::Mat t1w = pKF1->GetTranslation();
+    cv::Mat R2w = pKF2->GetRotation();
+    cv::Mat t2w = pKF2->GetTranslation();
+
+    cv::Mat R12 = R1w*R2w.t();
+    cv::Mat t12 = -R1w*R2w.t()*t2w+t1w;
+
+    cv::Mat t12x = (cv::Mat_<float>(3,3) <<             0, -t12.at<float>(2), t12.at<float>(1),
+                                              t12.at<float>(2),               0,-t12.at<float>(0),
+                                             -t12.at<float>(1),  t12.at<float>(0),              0);
+
+    const cv::Mat &K1 = pKF1->mK;
+    const cv::Mat &K2 = pKF2->mK;
+
+    return K1.t().inv()*t12x*R12*K2.inv();
+}
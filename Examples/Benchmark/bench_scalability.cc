@@ -0,0 +1,304 @@
+/**
+* This file is part of ORB-SLAM2.
+*
+* Copyright (C) 2014-2016 Raúl Mur-Artal <raulmur at unizar dot es> (University of Zaragoza)
+* For more information see <https://github.com/raulmur/ORB_SLAM2>
+*
+* ORB-SLAM2 is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM2 is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with ORB-SLAM2. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Grows a synthetic map keyframe by keyframe and, at increasing map sizes, measures the work of
+// the mapping, loop closing, relocalization and viewer paths on it: keyframe insertion, fusion
+// and local BA of the last keyframe, loop and relocalization queries, essential graph
+// optimization, the map traversal of MapDrawer and the resident memory. The series is printed
+// to stdout as JSON, one entry per map size, progress to stderr.
+
+#include<iostream>
+#include<fstream>
+#include<sstream>
+#include<iomanip>
+#include<chrono>
+#include<set>
+#include<cstdlib>
+
+#include<opencv2/core/core.hpp>
+
+#include"SyntheticMap.h"
+#include"Optimizer.h"
+#include"ORBmatcher.h"
+#include"Converter.h"
+
+using namespace std;
+using namespace ORB_SLAM2;
+
+typedef chrono::steady_clock Clock;
+
+double ElapsedMs(const Clock::time_point &t1)
+{
+    return chrono::duration_cast<chrono::duration<double,milli> >(Clock::now()-t1).count();
+}
+
+// Resident set size in MB, 0 where /proc is not available
+double ResidentMemoryMB()
+{
+    ifstream f("/proc/self/status");
+    string line;
+    while(getline(f,line))
+    {
+        if(line.compare(0,6,"VmRSS:")==0)
+            return atof(line.c_str()+6)/1024.0;
+    }
+    return 0;
+}
+
+// Same map accesses as MapDrawer::DrawMapPoints and DrawKeyFrames, without OpenGL
+double TraverseAsMapDrawer(Map* pMap)
+{
+    double sum = 0;
+
+    const vector<MapPoint*> vpMPs = pMap->GetAllMapPoints();
+    const vector<MapPoint*> vpRefMPs = pMap->GetReferenceMapPoints();
+    set<MapPoint*> spRefMPs(vpRefMPs.begin(), vpRefMPs.end());
+    for(size_t i=0; i<vpMPs.size(); i++)
+    {
+        if(vpMPs[i]->isBad() || spRefMPs.count(vpMPs[i]))
+            continue;
+        sum += vpMPs[i]->GetWorldPos().at<float>(2);
+    }
+    for(set<MapPoint*>::iterator sit=spRefMPs.begin(), send=spRefMPs.end(); sit!=send; sit++)
+    {
+        if((*sit)->isBad())
+            continue;
+        sum += (*sit)->GetWorldPos().at<float>(2);
+    }
+
+    const vector<KeyFrame*> vpKFs = pMap->GetAllKeyFrames();
+    for(size_t i=0; i<vpKFs.size(); i++)
+    {
+        sum += vpKFs[i]->GetPoseInverse().at<float>(2,3);
+
+        const vector<KeyFrame*> vCovKFs = vpKFs[i]->GetCovisiblesByWeight(100);
+        for(size_t j=0; j<vCovKFs.size(); j++)
+        {
+            if(vCovKFs[j]->mnId<vpKFs[i]->mnId)
+                continue;
+            sum += vCovKFs[j]->GetCameraCenter().at<float>(2);
+        }
+
+        KeyFrame* pParent = vpKFs[i]->GetParent();
+        if(pParent)
+            sum += pParent->GetCameraCenter().at<float>(2);
+
+        set<KeyFrame*> sLoopKFs = vpKFs[i]->GetLoopEdges();
+        for(set<KeyFrame*>::iterator sit=sLoopKFs.begin(), send=sLoopKFs.end(); sit!=send; sit++)
+        {
+            if((*sit)->mnId<vpKFs[i]->mnId)
+                continue;
+            sum += (*sit)->GetCameraCenter().at<float>(2);
+        }
+    }
+
+    return sum;
+}
+
+// Lowest BoW score to a covisible keyframe, as in LoopClosing::DetectLoop
+float LoopMinScore(KeyFrame* pKF, ORBVocabulary* pVoc)
+{
+    const vector<KeyFrame*> vpConnectedKeyFrames = pKF->GetVectorCovisibleKeyFrames();
+    float minScore = 1;
+    for(size_t i=0; i<vpConnectedKeyFrames.size(); i++)
+    {
+        if(vpConnectedKeyFrames[i]->isBad())
+            continue;
+        const float score = pVoc->score(pKF->mBowVec,vpConnectedKeyFrames[i]->mBowVec);
+        if(score<minScore)
+            minScore = score;
+    }
+    return minScore;
+}
+
+// Pose graph optimization of a loop between pCurKF and pLoopKF with no correction, so that the
+// map is not changed but the graph is built and solved as in LoopClosing::CorrectLoop
+void OptimizeLoop(Map* pMap, KeyFrame* pLoopKF, KeyFrame* pCurKF)
+{
+    LoopClosing::KeyFrameAndPose CorrectedSim3, NonCorrectedSim3;
+    vector<KeyFrame*> vpCurrentConnectedKFs = pCurKF->GetVectorCovisibleKeyFrames();
+    vpCurrentConnectedKFs.push_back(pCurKF);
+    for(size_t i=0; i<vpCurrentConnectedKFs.size(); i++)
+    {
+        KeyFrame* pKFi = vpCurrentConnectedKFs[i];
+        g2o::Sim3 Siw(Converter::toMatrix3d(pKFi->GetRotation()),Converter::toVector3d(pKFi->GetTranslation()),1.0);
+        CorrectedSim3[pKFi] = Siw;
+        NonCorrectedSim3[pKFi] = Siw;
+    }
+
+    map<KeyFrame*, set<KeyFrame*> > LoopConnections;
+    LoopConnections[pCurKF].insert(pLoopKF);
+
+    Optimizer::OptimizeEssentialGraph(pMap,pLoopKF,pCurKF,NonCorrectedSim3,CorrectedSim3,LoopConnections,false);
+}
+
+int main(int argc, char **argv)
+{
+    if(argc < 3 || argc > 4)
+    {
+        cerr << endl << "Usage: ./bench_scalability path_to_vocabulary path_to_settings [max_keyframes]" << endl;
+        return 1;
+    }
+
+    const int nMaxKFs = argc>3 ? atoi(argv[3]) : 10000;
+
+    cv::FileStorage fSettings(argv[2], cv::FileStorage::READ);
+    if(!fSettings.isOpened())
+    {
+        cerr << "Failed to open settings file at: " << argv[2] << endl;
+        return 1;
+    }
+    fSettings.release();
+
+    cerr << "Loading ORB Vocabulary..." << endl;
+    ORBVocabulary* pVoc = new ORBVocabulary();
+    if(!pVoc->loadFromTextFile(argv[1]))
+    {
+        cerr << "Failed to open vocabulary at: " << argv[1] << endl;
+        return 1;
+    }
+
+    // Baseline memory, the vocabulary included
+    const double baseMemory = ResidentMemoryMB();
+
+    Map* pMap = new Map();
+    KeyFrameDatabase* pKFDB = new KeyFrameDatabase(*pVoc);
+    SyntheticMap generator(argv[2],pVoc,pMap,pKFDB);
+
+    // Map sizes at which the subsystems are measured
+    vector<int> vCheckpoints;
+    const int vSteps[] = {1, 2, 5};
+    for(int scale=100; scale<nMaxKFs; scale*=10)
+        for(int i=0; i<3; i++)
+            if(vSteps[i]*scale<nMaxKFs)
+                vCheckpoints.push_back(vSteps[i]*scale);
+    vCheckpoints.push_back(nMaxKFs);
+
+    cv::RNG rng(7);
+    ORBmatcher matcher;
+
+    stringstream ssSeries;
+    ssSeries << fixed;
+
+    double tInsert = 0;
+    int nInserted = 0;
+    for(size_t ic=0; ic<vCheckpoints.size(); ic++)
+    {
+        // Grow the map
+        KeyFrame* pCurKF = static_cast<KeyFrame*>(NULL);
+        while(generator.KeyFramesAdded()<vCheckpoints[ic])
+        {
+            Clock::time_point t1 = Clock::now();
+            pCurKF = generator.AddKeyFrame();
+            tInsert += ElapsedMs(t1);
+            nInserted++;
+        }
+        if(!pCurKF)
+            continue;
+
+        // Fusion of the last keyframe in its neighbors, as in LocalMapping::SearchInNeighbors
+        Clock::time_point t1 = Clock::now();
+        const vector<KeyFrame*> vpNeighKFs = pCurKF->GetBestCovisibilityKeyFrames(20);
+        const vector<MapPoint*> vpMapPointMatches = pCurKF->GetMapPointMatches();
+        int nFused = 0;
+        for(size_t i=0; i<vpNeighKFs.size(); i++)
+            nFused += matcher.Fuse(vpNeighKFs[i],vpMapPointMatches);
+        const double tFuse = ElapsedMs(t1);
+
+        // Local BA of the last keyframe
+        bool bAbortBA = false;
+        t1 = Clock::now();
+        Optimizer::LocalBundleAdjustment(pCurKF,&bAbortBA,pMap);
+        const double tLocalBA = ElapsedMs(t1);
+
+        // Loop detection, before the keyframe is inserted in the database
+        t1 = Clock::now();
+        const float minScore = LoopMinScore(pCurKF,pVoc);
+        const vector<KeyFrame*> vpLoopCandidates = pKFDB->DetectLoopCandidates(pCurKF,minScore);
+        const double tLoopQuery = ElapsedMs(t1);
+
+        // Relocalization of frames at random places of the trajectory
+        const int nRelocQueries = 5;
+        double tRelocQuery = 0;
+        long nRelocCandidates = 0;
+        for(int i=0; i<nRelocQueries; i++)
+        {
+            Frame F = generator.CreateFrame(rng.uniform(0.0,generator.TrajectoryLength()));
+            t1 = Clock::now();
+            nRelocCandidates += pKFDB->DetectRelocalizationCandidates(&F).size();
+            tRelocQuery += ElapsedMs(t1);
+        }
+        tRelocQuery /= nRelocQueries;
+
+        // Essential graph optimization with a loop to the previous lap, or to the origin
+        KeyFrame* pLoopKF = generator.GetPreviousLapKeyFrame(pCurKF);
+        if(!pLoopKF)
+            pLoopKF = pMap->mvpKeyFrameOrigins.front();
+        t1 = Clock::now();
+        if(pLoopKF!=pCurKF)
+            OptimizeLoop(pMap,pLoopKF,pCurKF);
+        const double tEssentialGraph = ElapsedMs(t1);
+
+        // Viewer
+        t1 = Clock::now();
+        const double sum = TraverseAsMapDrawer(pMap);
+        const double tDrawer = ElapsedMs(t1);
+
+        const double memory = ResidentMemoryMB()-baseMemory;
+
+        ssSeries << (ic>0 ? ",\n" : "") << setprecision(3)
+                 << "    {\"keyframes\": " << pMap->KeyFramesInMap()
+                 << ", \"mappoints\": " << pMap->MapPointsInMap()
+                 << ", \"observations\": " << generator.Observations()
+                 << ", \"memory_mb\": " << memory
+                 << ", \"insert_ms\": " << (nInserted>0 ? tInsert/nInserted : 0)
+                 << ", \"fuse_ms\": " << tFuse
+                 << ", \"local_ba_ms\": " << tLocalBA
+                 << ", \"loop_query_ms\": " << tLoopQuery
+                 << ", \"loop_candidates\": " << vpLoopCandidates.size()
+                 << ", \"reloc_query_ms\": " << tRelocQuery
+                 << ", \"reloc_candidates\": " << double(nRelocCandidates)/nRelocQueries
+                 << ", \"essential_graph_ms\": " << tEssentialGraph
+                 << ", \"map_drawer_ms\": " << tDrawer << "}";
+
+        cerr << "KFs: " << pMap->KeyFramesInMap() << " MPs: " << pMap->MapPointsInMap() << " mem: " << memory
+             << " MB, local BA: " << tLocalBA << " ms, essential graph: " << tEssentialGraph << " ms, fused: "
+             << nFused << " (" << sum << ")" << endl;
+
+        tInsert = 0;
+        nInserted = 0;
+    }
+
+    cout << fixed;
+    cout << "{" << endl;
+    cout << "  \"trajectory_length\": " << setprecision(2) << generator.TrajectoryLength() << "," << endl;
+    cout << "  \"loops_closed\": " << (generator.LoopsClosed() ? "true" : "false") << "," << endl;
+    cout << "  \"series\": [" << endl;
+    cout << ssSeries.str() << endl;
+    cout << "  ]" << endl;
+    cout << "}" << endl;
+
+    pKFDB->clear();
+    delete pKFDB;
+    delete pMap;
+    delete pVoc;
+
+    return 0;
+}
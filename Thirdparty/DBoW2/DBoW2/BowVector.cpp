@@ -33,15 +33,18 @@ BowVector::~BowVector(void)
 
 void BowVector::addWeight(WordId id, WordValue v)
 {
-  BowVector::iterator vit = this->lower_bound(id);
+  std::vector<WordId>::iterator vit = 
+    std::lower_bound(m_ids.begin(), m_ids.end(), id);
+  const size_t i = vit - m_ids.begin();
   
-  if(vit != this->end() && !(this->key_comp()(id, vit->first)))
+  if(vit != m_ids.end() && *vit == id)
   {
-    vit->second += v;
+    m_values[i] += v;
   }
   else
   {
-    this->insert(vit, BowVector::value_type(id, v));
+    m_ids.insert(vit, id);
+    m_values.insert(m_values.begin() + i, v);
   }
 }
 
@@ -49,37 +52,85 @@ void BowVector::addWeight(WordId id, WordValue v)
 
 void BowVector::addIfNotExist(WordId id, WordValue v)
 {
-  BowVector::iterator vit = this->lower_bound(id);
+  std::vector<WordId>::iterator vit = 
+    std::lower_bound(m_ids.begin(), m_ids.end(), id);
   
-  if(vit == this->end() || (this->key_comp()(id, vit->first)))
+  if(vit == m_ids.end() || *vit != id)
   {
-    this->insert(vit, BowVector::value_type(id, v));
+    const size_t i = vit - m_ids.begin();
+    m_ids.insert(vit, id);
+    m_values.insert(m_values.begin() + i, v);
   }
 }
 
 // --------------------------------------------------------------------------
 
+static bool lessWordId(const std::pair<WordId, WordValue> &a, 
+  const std::pair<WordId, WordValue> &b)
+{
+  return a.first < b.first;
+}
+
+void BowVector::assign(std::vector<std::pair<WordId, WordValue> > &entries,
+  bool accumulate)
+{
+  m_ids.clear();
+  m_values.clear();
+  
+  if(entries.empty()) return;
+  
+  // stable so that addIfNotExist keeps the first value given for a word
+  std::stable_sort(entries.begin(), entries.end(), lessWordId);
+  
+  m_ids.reserve(entries.size());
+  m_values.reserve(entries.size());
+  
+  std::vector<std::pair<WordId, WordValue> >::const_iterator eit;
+  for(eit = entries.begin(); eit != entries.end(); ++eit)
+  {
+    if(!m_ids.empty() && m_ids.back() == eit->first)
+    {
+      if(accumulate) m_values.back() += eit->second;
+    }
+    else
+    {
+      m_ids.push_back(eit->first);
+      m_values.push_back(eit->second);
+    }
+  }
+}
+
+// --------------------------------------------------------------------------
+
+void BowVector::clear()
+{
+  m_ids.clear();
+  m_values.clear();
+}
+
+// --------------------------------------------------------------------------
+
 void BowVector::normalize(LNorm norm_type)
 {
   double norm = 0.0; 
-  BowVector::iterator it;
+  std::vector<WordValue>::iterator it;
 
   if(norm_type == DBoW2::L1)
   {
-    for(it = begin(); it != end(); ++it)
-      norm += fabs(it->second);
+    for(it = m_values.begin(); it != m_values.end(); ++it)
+      norm += fabs(*it);
   }
   else
   {
-    for(it = begin(); it != end(); ++it)
-      norm += it->second * it->second;
+    for(it = m_values.begin(); it != m_values.end(); ++it)
+      norm += (*it) * (*it);
 		norm = sqrt(norm);  
   }
 
   if(norm > 0.0)
   {
-    for(it = begin(); it != end(); ++it)
-      it->second /= norm;
+    for(it = m_values.begin(); it != m_values.end(); ++it)
+      *it /= norm;
   }
 }
 
@@ -87,13 +138,10 @@ void BowVector::normalize(LNorm norm_type)
 
 std::ostream& operator<< (std::ostream &out, const BowVector &v)
 {
-  BowVector::const_iterator vit;
-  std::vector<unsigned int>::const_iterator iit;
-  unsigned int i = 0; 
-  const unsigned int N = v.size();
-  for(vit = v.begin(); vit != v.end(); ++vit, ++i)
+  const size_t N = v.size();
+  for(size_t i = 0; i < N; ++i)
   {
-    out << "<" << vit->first << ", " << vit->second << ">";
+    out << "<" << v.wordId(i) << ", " << v.value(i) << ">";
     
     if(i < N-1) out << ", ";
   }
@@ -107,16 +155,15 @@ void BowVector::saveM(const std::string &filename, size_t W) const
   std::fstream f(filename.c_str(), std::ios::out);
   
   WordId last = 0;
-  BowVector::const_iterator bit;
-  for(bit = this->begin(); bit != this->end(); ++bit)
+  for(size_t i = 0; i < m_ids.size(); ++i)
   {
-    for(; last < bit->first; ++last)
+    for(; last < m_ids[i]; ++last)
     {
       f << "0 ";
     }
-    f << bit->second << " ";
+    f << m_values[i] << " ";
     
-    last = bit->first + 1;
+    last = m_ids[i] + 1;
   }
   for(; last < (WordId)W; ++last)
     f << "0 ";
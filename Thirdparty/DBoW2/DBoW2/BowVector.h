@@ -11,7 +11,8 @@
 #define __D_T_BOW_VECTOR__
 
 #include <iostream>
-#include <map>
+#include <string>
+#include <utility>
 #include <vector>
 
 namespace DBoW2 {
@@ -52,9 +53,10 @@ enum ScoringType
   DOT_PRODUCT,
 };
 
-/// Vector of words to represent images
-class BowVector: 
-	public std::map<WordId, WordValue>
+/// Vector of words to represent images.
+/// Word ids and weights are kept in two parallel arrays sorted by word id,
+/// so that scoring two vectors is a linear merge over contiguous memory
+class BowVector
 {
 public:
 
@@ -83,11 +85,60 @@ public:
 	 */
 	void addIfNotExist(WordId id, WordValue v);
 
+	/**
+	 * Replaces the content of the vector with the given unsorted entries.
+	 * Entries with the same word id are summed if accumulate is true, or 
+	 * only the first one is kept otherwise. The input is sorted in place
+	 * @param entries (in/out) word ids and values
+	 * @param accumulate behave as addWeight if true, as addIfNotExist if not
+	 */
+	void assign(std::vector<std::pair<WordId, WordValue> > &entries, 
+	  bool accumulate);
+
 	/**
 	 * L1-Normalizes the values in the vector 
 	 * @param norm_type norm used
 	 */
 	void normalize(LNorm norm_type);
+
+	/**
+	 * Returns the number of words in the vector
+	 */
+	inline size_t size() const { return m_ids.size(); }
+
+	/**
+	 * Returns whether the vector has no words
+	 */
+	inline bool empty() const { return m_ids.empty(); }
+
+	/**
+	 * Removes all the words
+	 */
+	void clear();
+
+	/**
+	 * Returns the id of the i-th word (in ascending order of ids)
+	 * @param i position in the vector
+	 */
+	inline WordId wordId(size_t i) const { return m_ids[i]; }
+
+	/**
+	 * Returns the value of the i-th word
+	 * @param i position in the vector
+	 */
+	inline WordValue value(size_t i) const { return m_values[i]; }
+	inline WordValue& value(size_t i) { return m_values[i]; }
+
+	/**
+	 * Returns the sorted array of word ids (size() elements)
+	 */
+	inline const WordId* ids() const { return m_ids.empty() ? NULL : &m_ids[0]; }
+
+	/**
+	 * Returns the array of values, parallel to ids() (size() elements)
+	 */
+	inline const WordValue* values() const 
+	  { return m_values.empty() ? NULL : &m_values[0]; }
 	
 	/**
 	 * Prints the content of the bow vector
@@ -102,6 +153,14 @@ public:
 	 * @param W number of words in the vocabulary
 	 */
 	void saveM(const std::string &filename, size_t W) const;
+
+protected:
+
+	/// Word ids, in ascending order
+	std::vector<WordId> m_ids;
+
+	/// Word values, parallel to m_ids
+	std::vector<WordValue> m_values;
 };
 
 } // namespace DBoW2
@@ -8,7 +8,7 @@
  */
 
 #include "FeatureVector.h"
-#include <map>
+#include <algorithm>
 #include <vector>
 #include <iostream>
 
@@ -30,18 +30,64 @@ FeatureVector::~FeatureVector(void)
 
 void FeatureVector::addFeature(NodeId id, unsigned int i_feature)
 {
-  FeatureVector::iterator vit = this->lower_bound(id);
+  if(m_offsets.empty()) m_offsets.push_back(0);
+
+  std::vector<NodeId>::iterator vit = 
+    std::lower_bound(m_nodes.begin(), m_nodes.end(), id);
+  const size_t i = vit - m_nodes.begin();
   
-  if(vit != this->end() && vit->first == id)
+  if(vit == m_nodes.end() || *vit != id)
   {
-    vit->second.push_back(i_feature);
+    const unsigned int start = m_offsets[i];
+    m_nodes.insert(vit, id);
+    m_offsets.insert(m_offsets.begin() + i + 1, start);
   }
-  else
+
+  m_features.insert(m_features.begin() + m_offsets[i+1], i_feature);
+  for(size_t j = i + 1; j < m_offsets.size(); ++j)
+    ++m_offsets[j];
+}
+
+// ---------------------------------------------------------------------------
+
+static bool lessNodeId(const std::pair<NodeId, unsigned int> &a, 
+  const std::pair<NodeId, unsigned int> &b)
+{
+  return a.first < b.first;
+}
+
+void FeatureVector::assign(
+  std::vector<std::pair<NodeId, unsigned int> > &entries)
+{
+  clear();
+  
+  if(entries.empty()) return;
+
+  std::stable_sort(entries.begin(), entries.end(), lessNodeId);
+
+  m_features.reserve(entries.size());
+  m_offsets.push_back(0);
+
+  std::vector<std::pair<NodeId, unsigned int> >::const_iterator eit;
+  for(eit = entries.begin(); eit != entries.end(); ++eit)
   {
-    vit = this->insert(vit, FeatureVector::value_type(id, 
-      std::vector<unsigned int>() ));
-    vit->second.push_back(i_feature);
+    if(m_nodes.empty() || m_nodes.back() != eit->first)
+    {
+      if(!m_nodes.empty()) m_offsets.push_back(m_features.size());
+      m_nodes.push_back(eit->first);
+    }
+    m_features.push_back(eit->second);
   }
+  m_offsets.push_back(m_features.size());
+}
+
+// ---------------------------------------------------------------------------
+
+void FeatureVector::clear()
+{
+  m_nodes.clear();
+  m_offsets.clear();
+  m_features.clear();
 }
 
 // ---------------------------------------------------------------------------
@@ -49,32 +95,19 @@ void FeatureVector::addFeature(NodeId id, unsigned int i_feature)
 std::ostream& operator<<(std::ostream &out, 
   const FeatureVector &v)
 {
-  if(!v.empty())
+  for(size_t i = 0; i < v.size(); ++i)
   {
-    FeatureVector::const_iterator vit = v.begin();
-    
-    const std::vector<unsigned int>* f = &vit->second;
+    const unsigned int *f = v.features(i);
+    const unsigned int n = v.featureCount(i);
 
-    out << "<" << vit->first << ": [";
-    if(!f->empty()) out << (*f)[0];
-    for(unsigned int i = 1; i < f->size(); ++i)
+    if(i > 0) out << ", ";
+    out << "<" << v.nodeId(i) << ": [";
+    if(n > 0) out << f[0];
+    for(unsigned int j = 1; j < n; ++j)
     {
-      out << ", " << (*f)[i];
+      out << ", " << f[j];
     }
     out << "]>";
-    
-    for(++vit; vit != v.end(); ++vit)
-    {
-      f = &vit->second;
-      
-      out << ", <" << vit->first << ": [";
-      if(!f->empty()) out << (*f)[0];
-      for(unsigned int i = 1; i < f->size(); ++i)
-      {
-        out << ", " << (*f)[i];
-      }
-      out << "]>";
-    }
   }
   
   return out;  
@@ -11,15 +11,16 @@
 #define __D_T_FEATURE_VECTOR__
 
 #include "BowVector.h"
-#include <map>
+#include <utility>
 #include <vector>
 #include <iostream>
 
 namespace DBoW2 {
 
-/// Vector of nodes with indexes of local features
-class FeatureVector: 
-  public std::map<NodeId, std::vector<unsigned int> >
+/// Vector of nodes with indexes of local features.
+/// Stored in compressed sparse row form: node ids sorted in ascending order,
+/// and the feature indexes of all the nodes packed in a single array
+class FeatureVector
 {
 public:
 
@@ -41,12 +42,78 @@ public:
    */
   void addFeature(NodeId id, unsigned int i_feature);
 
+  /**
+   * Replaces the content of the vector with the given (node, feature) pairs.
+   * The input is sorted in place. Features of the same node keep the order
+   * they had in the input
+   * @param entries (in/out) node ids and feature indexes
+   */
+  void assign(std::vector<std::pair<NodeId, unsigned int> > &entries);
+
+  /**
+   * Returns the number of nodes
+   */
+  inline size_t size() const { return m_nodes.size(); }
+
+  /**
+   * Returns whether there are no nodes
+   */
+  inline bool empty() const { return m_nodes.empty(); }
+
+  /**
+   * Removes all the nodes and features
+   */
+  void clear();
+
+  /**
+   * Returns the id of the i-th node (in ascending order of ids)
+   * @param i position of the node
+   */
+  inline NodeId nodeId(size_t i) const { return m_nodes[i]; }
+
+  /**
+   * Returns the number of features of the i-th node
+   * @param i position of the node
+   */
+  inline unsigned int featureCount(size_t i) const 
+    { return m_offsets[i+1] - m_offsets[i]; }
+
+  /**
+   * Returns the position of the first feature of the i-th node in the
+   * array of all the features
+   * @param i position of the node
+   */
+  inline unsigned int featureOffset(size_t i) const { return m_offsets[i]; }
+
+  /**
+   * Returns the feature indexes of the i-th node (featureCount(i) elements)
+   * @param i position of the node
+   */
+  inline const unsigned int* features(size_t i) const 
+    { return &m_features[0] + m_offsets[i]; }
+
+  /**
+   * Returns the total number of features in all the nodes
+   */
+  inline size_t totalFeatures() const { return m_features.size(); }
+
   /**
    * Sends a string versions of the feature vector through the stream
    * @param out stream
    * @param v feature vector
    */
   friend std::ostream& operator<<(std::ostream &out, const FeatureVector &v);
+
+protected:
+
+  /// Node ids, in ascending order
+  std::vector<NodeId> m_nodes;
+
+  /// Features of node i are m_features[m_offsets[i] .. m_offsets[i+1])
+  std::vector<unsigned int> m_offsets;
+
+  /// Feature indexes of all the nodes
+  std::vector<unsigned int> m_features;
     
 };
 
@@ -22,39 +22,34 @@ const double GeneralScoring::LOG_EPS = log(DBL_EPSILON); // FLT_EPSILON
 
 double L1Scoring::score(const BowVector &v1, const BowVector &v2) const
 {
-  BowVector::const_iterator v1_it, v2_it;
-  const BowVector::const_iterator v1_end = v1.end();
-  const BowVector::const_iterator v2_end = v2.end();
-  
-  v1_it = v1.begin();
-  v2_it = v2.begin();
+  const WordId *id1 = v1.ids(), *id2 = v2.ids();
+  const WordValue *w1 = v1.values(), *w2 = v2.values();
+  const size_t n1 = v1.size(), n2 = v2.size();
+  size_t i1 = 0, i2 = 0;
   
   double score = 0;
   
-  while(v1_it != v1_end && v2_it != v2_end)
+  while(i1 < n1 && i2 < n2)
   {
-    const WordValue& vi = v1_it->second;
-    const WordValue& wi = v2_it->second;
-    
-    if(v1_it->first == v2_it->first)
+    if(id1[i1] == id2[i2])
     {
+      const WordValue vi = w1[i1];
+      const WordValue wi = w2[i2];
       score += fabs(vi - wi) - fabs(vi) - fabs(wi);
       
       // move v1 and v2 forward
-      ++v1_it;
-      ++v2_it;
+      ++i1;
+      ++i2;
     }
-    else if(v1_it->first < v2_it->first)
+    else if(id1[i1] < id2[i2])
     {
       // move v1 forward
-      v1_it = v1.lower_bound(v2_it->first);
-      // v1_it = (first element >= v2_it.id)
+      ++i1;
     }
     else
     {
       // move v2 forward
-      v2_it = v2.lower_bound(v1_it->first);
-      // v2_it = (first element >= v1_it.id)
+      ++i2;
     }
   }
   
@@ -72,39 +67,32 @@ double L1Scoring::score(const BowVector &v1, const BowVector &v2) const
 
 double L2Scoring::score(const BowVector &v1, const BowVector &v2) const
 {
-  BowVector::const_iterator v1_it, v2_it;
-  const BowVector::const_iterator v1_end = v1.end();
-  const BowVector::const_iterator v2_end = v2.end();
-  
-  v1_it = v1.begin();
-  v2_it = v2.begin();
+  const WordId *id1 = v1.ids(), *id2 = v2.ids();
+  const WordValue *w1 = v1.values(), *w2 = v2.values();
+  const size_t n1 = v1.size(), n2 = v2.size();
+  size_t i1 = 0, i2 = 0;
   
   double score = 0;
   
-  while(v1_it != v1_end && v2_it != v2_end)
+  while(i1 < n1 && i2 < n2)
   {
-    const WordValue& vi = v1_it->second;
-    const WordValue& wi = v2_it->second;
-    
-    if(v1_it->first == v2_it->first)
+    if(id1[i1] == id2[i2])
     {
-      score += vi * wi;
+      score += w1[i1] * w2[i2];
       
       // move v1 and v2 forward
-      ++v1_it;
-      ++v2_it;
+      ++i1;
+      ++i2;
     }
-    else if(v1_it->first < v2_it->first)
+    else if(id1[i1] < id2[i2])
     {
       // move v1 forward
-      v1_it = v1.lower_bound(v2_it->first);
-      // v1_it = (first element >= v2_it.id)
+      ++i1;
     }
     else
     {
       // move v2 forward
-      v2_it = v2.lower_bound(v1_it->first);
-      // v2_it = (first element >= v1_it.id)
+      ++i2;
     }
   }
   
@@ -125,41 +113,39 @@ double L2Scoring::score(const BowVector &v1, const BowVector &v2) const
 double ChiSquareScoring::score(const BowVector &v1, const BowVector &v2) 
   const
 {
-  BowVector::const_iterator v1_it, v2_it;
-  const BowVector::const_iterator v1_end = v1.end();
-  const BowVector::const_iterator v2_end = v2.end();
-  
-  v1_it = v1.begin();
-  v2_it = v2.begin();
+  const WordId *id1 = v1.ids(), *id2 = v2.ids();
+  const WordValue *w1 = v1.values(), *w2 = v2.values();
+  const size_t n1 = v1.size(), n2 = v2.size();
+  size_t i1 = 0, i2 = 0;
   
   double score = 0;
   
   // all the items are taken into account
   
-  while(v1_it != v1_end && v2_it != v2_end)
+  while(i1 < n1 && i2 < n2)
   {
-    const WordValue& vi = v1_it->second;
-    const WordValue& wi = v2_it->second;
-    
-    if(v1_it->first == v2_it->first)
+    if(id1[i1] == id2[i2])
     {
+      const WordValue vi = w1[i1];
+      const WordValue wi = w2[i2];
+
       // (v-w)^2/(v+w) - v - w = -4 vw/(v+w)
       // we move the -4 out
       if(vi + wi != 0.0) score += vi * wi / (vi + wi);
       
       // move v1 and v2 forward
-      ++v1_it;
-      ++v2_it;
+      ++i1;
+      ++i2;
     }
-    else if(v1_it->first < v2_it->first)
+    else if(id1[i1] < id2[i2])
     {
       // move v1 forward
-      v1_it = v1.lower_bound(v2_it->first);
+      ++i1;
     }
     else
     {
       // move v2 forward
-      v2_it = v2.lower_bound(v1_it->first);
+      ++i2;
     }
   }
     
@@ -174,48 +160,45 @@ double ChiSquareScoring::score(const BowVector &v1, const BowVector &v2)
 
 double KLScoring::score(const BowVector &v1, const BowVector &v2) const
 { 
-  BowVector::const_iterator v1_it, v2_it;
-  const BowVector::const_iterator v1_end = v1.end();
-  const BowVector::const_iterator v2_end = v2.end();
-  
-  v1_it = v1.begin();
-  v2_it = v2.begin();
+  const WordId *id1 = v1.ids(), *id2 = v2.ids();
+  const WordValue *w1 = v1.values(), *w2 = v2.values();
+  const size_t n1 = v1.size(), n2 = v2.size();
+  size_t i1 = 0, i2 = 0;
   
   double score = 0;
   
   // all the items or v are taken into account
   
-  while(v1_it != v1_end && v2_it != v2_end)
+  while(i1 < n1 && i2 < n2)
   {
-    const WordValue& vi = v1_it->second;
-    const WordValue& wi = v2_it->second;
-    
-    if(v1_it->first == v2_it->first)
+    const WordValue vi = w1[i1];
+
+    if(id1[i1] == id2[i2])
     {
+      const WordValue wi = w2[i2];
       if(vi != 0 && wi != 0) score += vi * log(vi/wi);
       
       // move v1 and v2 forward
-      ++v1_it;
-      ++v2_it;
+      ++i1;
+      ++i2;
     }
-    else if(v1_it->first < v2_it->first)
+    else if(id1[i1] < id2[i2])
     {
       // move v1 forward
       score += vi * (log(vi) - LOG_EPS);
-      ++v1_it;
+      ++i1;
     }
     else
     {
-      // move v2_it forward, do not add any score
-      v2_it = v2.lower_bound(v1_it->first);
-      // v2_it = (first element >= v1_it.id)
+      // move v2 forward, do not add any score
+      ++i2;
     }
   }
   
   // sum rest of items of v
-  for(; v1_it != v1_end; ++v1_it) 
-    if(v1_it->second != 0)
-      score += v1_it->second * (log(v1_it->second) - LOG_EPS);
+  for(; i1 < n1; ++i1) 
+    if(w1[i1] != 0)
+      score += w1[i1] * (log(w1[i1]) - LOG_EPS);
   
   return score; // cannot be scaled
 }
@@ -226,39 +209,32 @@ double KLScoring::score(const BowVector &v1, const BowVector &v2) const
 double BhattacharyyaScoring::score(const BowVector &v1, 
   const BowVector &v2) const
 {
-  BowVector::const_iterator v1_it, v2_it;
-  const BowVector::const_iterator v1_end = v1.end();
-  const BowVector::const_iterator v2_end = v2.end();
-  
-  v1_it = v1.begin();
-  v2_it = v2.begin();
+  const WordId *id1 = v1.ids(), *id2 = v2.ids();
+  const WordValue *w1 = v1.values(), *w2 = v2.values();
+  const size_t n1 = v1.size(), n2 = v2.size();
+  size_t i1 = 0, i2 = 0;
   
   double score = 0;
   
-  while(v1_it != v1_end && v2_it != v2_end)
+  while(i1 < n1 && i2 < n2)
   {
-    const WordValue& vi = v1_it->second;
-    const WordValue& wi = v2_it->second;
-    
-    if(v1_it->first == v2_it->first)
+    if(id1[i1] == id2[i2])
     {
-      score += sqrt(vi * wi);
+      score += sqrt(w1[i1] * w2[i2]);
       
       // move v1 and v2 forward
-      ++v1_it;
-      ++v2_it;
+      ++i1;
+      ++i2;
     }
-    else if(v1_it->first < v2_it->first)
+    else if(id1[i1] < id2[i2])
     {
       // move v1 forward
-      v1_it = v1.lower_bound(v2_it->first);
-      // v1_it = (first element >= v2_it.id)
+      ++i1;
     }
     else
     {
       // move v2 forward
-      v2_it = v2.lower_bound(v1_it->first);
-      // v2_it = (first element >= v1_it.id)
+      ++i2;
     }
   }
 
@@ -271,39 +247,32 @@ double BhattacharyyaScoring::score(const BowVector &v1,
 double DotProductScoring::score(const BowVector &v1, 
   const BowVector &v2) const
 {
-  BowVector::const_iterator v1_it, v2_it;
-  const BowVector::const_iterator v1_end = v1.end();
-  const BowVector::const_iterator v2_end = v2.end();
-  
-  v1_it = v1.begin();
-  v2_it = v2.begin();
+  const WordId *id1 = v1.ids(), *id2 = v2.ids();
+  const WordValue *w1 = v1.values(), *w2 = v2.values();
+  const size_t n1 = v1.size(), n2 = v2.size();
+  size_t i1 = 0, i2 = 0;
   
   double score = 0;
   
-  while(v1_it != v1_end && v2_it != v2_end)
+  while(i1 < n1 && i2 < n2)
   {
-    const WordValue& vi = v1_it->second;
-    const WordValue& wi = v2_it->second;
-    
-    if(v1_it->first == v2_it->first)
+    if(id1[i1] == id2[i2])
     {
-      score += vi * wi;
+      score += w1[i1] * w2[i2];
       
       // move v1 and v2 forward
-      ++v1_it;
-      ++v2_it;
+      ++i1;
+      ++i2;
     }
-    else if(v1_it->first < v2_it->first)
+    else if(id1[i1] < id2[i2])
     {
       // move v1 forward
-      v1_it = v1.lower_bound(v2_it->first);
-      // v1_it = (first element >= v2_it.id)
+      ++i1;
     }
     else
     {
       // move v2 forward
-      v2_it = v2.lower_bound(v1_it->first);
-      // v2_it = (first element >= v1_it.id)
+      ++i2;
     }
   }
 
@@ -145,6 +145,28 @@ public:
   virtual void transform(const std::vector<TDescriptor>& features,
     BowVector &v, FeatureVector &fv, int levelsup) const;
 
+  /**
+   * Transforms a set of descriptors into a bow vector, keeping the word of
+   * each feature so that the feature vector can be built later without
+   * descending the tree again (see getFeatureVector)
+   * @param features
+   * @param v (out) bow vector
+   * @param words (out) word id of each feature
+   */
+  virtual void transform(const std::vector<TDescriptor>& features,
+    BowVector &v, std::vector<WordId> &words) const;
+
+  /**
+   * Builds the feature vector from the words of the features given by
+   * transform, going up the tree from each word. Features of stopped words
+   * are left out, as in transform
+   * @param words word id of each feature
+   * @param fv (out) feature vector of nodes and feature indexes
+   * @param levelsup levels to go up the vocabulary tree to get the node index
+   */
+  void getFeatureVector(const std::vector<WordId> &words, FeatureVector &fv,
+    int levelsup) const;
+
   /**
    * Transforms a single feature into a word (without weight)
    * @param feature
@@ -1079,43 +1101,38 @@ void TemplatedVocabulary<TDescriptor,F>::transform(
 
 	typename vector<TDescriptor>::const_iterator fit;
 
-  if(m_weighting == TF || m_weighting == TF_IDF)
+  // words are gathered unsorted and packed into v at once
+  std::vector<std::pair<WordId, WordValue> > words;
+  words.reserve(features.size());
+
+  for(fit = features.begin(); fit < features.end(); ++fit)
   {
-    for(fit = features.begin(); fit < features.end(); ++fit)
-    {
-      WordId id;
-      WordValue w; 
-      // w is the idf value if TF_IDF, 1 if TF
-      
-      transform(*fit, id, w);
-      
-      // not stopped
-      if(w > 0) v.addWeight(id, w);
-    }
+    WordId id;
+    WordValue w; 
+    // w is the idf value if TF_IDF or IDF, 1 if TF or BINARY
+    
+    transform(*fit, id, w);
     
+    // not stopped
+    if(w > 0) words.push_back(std::make_pair(id, w));
+  }
+
+  if(m_weighting == TF || m_weighting == TF_IDF)
+  {
+    v.assign(words, true);
+
     if(!v.empty() && !must)
     {
       // unnecessary when normalizing
       const double nd = v.size();
-      for(BowVector::iterator vit = v.begin(); vit != v.end(); vit++) 
-        vit->second /= nd;
+      for(size_t i = 0; i < v.size(); ++i) 
+        v.value(i) /= nd;
     }
     
   }
   else // IDF || BINARY
   {
-    for(fit = features.begin(); fit < features.end(); ++fit)
-    {
-      WordId id;
-      WordValue w;
-      // w is idf if IDF, or 1 if BINARY
-      
-      transform(*fit, id, w);
-      
-      // not stopped
-      if(w > 0) v.addIfNotExist(id, w);
-      
-    } // if add_features
+    v.assign(words, false);
   } // if m_weighting == ...
   
   if(must) v.normalize(norm);
@@ -1141,60 +1158,146 @@ void TemplatedVocabulary<TDescriptor,F>::transform(
   bool must = m_scoring_object->mustNormalize(norm);
   
   typename vector<TDescriptor>::const_iterator fit;
+
+  // words and node assignments are gathered unsorted and packed at once
+  std::vector<std::pair<WordId, WordValue> > words;
+  std::vector<std::pair<NodeId, unsigned int> > nodes;
+  words.reserve(features.size());
+  nodes.reserve(features.size());
   
-  if(m_weighting == TF || m_weighting == TF_IDF)
+  unsigned int i_feature = 0;
+  for(fit = features.begin(); fit < features.end(); ++fit, ++i_feature)
   {
-    unsigned int i_feature = 0;
-    for(fit = features.begin(); fit < features.end(); ++fit, ++i_feature)
-    {
-      WordId id;
-      NodeId nid;
-      WordValue w; 
-      // w is the idf value if TF_IDF, 1 if TF
-      
-      transform(*fit, id, w, &nid, levelsup);
-      
-      if(w > 0) // not stopped
-      { 
-        v.addWeight(id, w);
-        fv.addFeature(nid, i_feature);
-      }
-    }
+    WordId id;
+    NodeId nid;
+    WordValue w; 
+    // w is the idf value if TF_IDF or IDF, 1 if TF or BINARY
+    
+    transform(*fit, id, w, &nid, levelsup);
     
+    if(w > 0) // not stopped
+    { 
+      words.push_back(std::make_pair(id, w));
+      nodes.push_back(std::make_pair(nid, i_feature));
+    }
+  }
+
+  fv.assign(nodes);
+  
+  if(m_weighting == TF || m_weighting == TF_IDF)
+  {
+    v.assign(words, true);
+
     if(!v.empty() && !must)
     {
       // unnecessary when normalizing
       const double nd = v.size();
-      for(BowVector::iterator vit = v.begin(); vit != v.end(); vit++) 
-        vit->second /= nd;
+      for(size_t i = 0; i < v.size(); ++i) 
+        v.value(i) /= nd;
     }
   
   }
   else // IDF || BINARY
   {
-    unsigned int i_feature = 0;
-    for(fit = features.begin(); fit < features.end(); ++fit, ++i_feature)
+    v.assign(words, false);
+  } // if m_weighting == ...
+  
+  if(must) v.normalize(norm);
+}
+
+// --------------------------------------------------------------------------
+
+template<class TDescriptor, class F> 
+void TemplatedVocabulary<TDescriptor,F>::transform(
+  const std::vector<TDescriptor>& features,
+  BowVector &v, std::vector<WordId> &words) const
+{
+  v.clear();
+  words.clear();
+  
+  if(empty()) // safe for subclasses
+  {
+    return;
+  }
+  
+  // normalize 
+  LNorm norm;
+  bool must = m_scoring_object->mustNormalize(norm);
+
+  std::vector<std::pair<WordId, WordValue> > entries;
+  entries.reserve(features.size());
+  words.resize(features.size());
+
+  for(size_t i = 0; i < features.size(); ++i)
+  {
+    WordValue w;
+    transform(features[i], words[i], w);
+
+    if(w > 0) entries.push_back(std::make_pair(words[i], w));
+  }
+
+  if(m_weighting == TF || m_weighting == TF_IDF)
+  {
+    v.assign(entries, true);
+
+    if(!v.empty() && !must)
     {
-      WordId id;
-      NodeId nid;
-      WordValue w;
-      // w is idf if IDF, or 1 if BINARY
-      
-      transform(*fit, id, w, &nid, levelsup);
-      
-      if(w > 0) // not stopped
-      {
-        v.addIfNotExist(id, w);
-        fv.addFeature(nid, i_feature);
-      }
+      // unnecessary when normalizing
+      const double nd = v.size();
+      for(size_t i = 0; i < v.size(); ++i) 
+        v.value(i) /= nd;
     }
-  } // if m_weighting == ...
+  }
+  else // IDF || BINARY
+  {
+    v.assign(entries, false);
+  }
   
   if(must) v.normalize(norm);
 }
 
 // --------------------------------------------------------------------------
 
+template<class TDescriptor, class F> 
+void TemplatedVocabulary<TDescriptor,F>::getFeatureVector(
+  const std::vector<WordId> &words, FeatureVector &fv, int levelsup) const
+{
+  fv.clear();
+
+  if(empty())
+  {
+    return;
+  }
+
+  // level of the nodes, as stored by transform when descending the tree
+  const int nid_level = m_L - levelsup;
+
+  std::vector<std::pair<NodeId, unsigned int> > nodes;
+  nodes.reserve(words.size());
+
+  for(unsigned int i_feature = 0; i_feature < words.size(); ++i_feature)
+  {
+    const Node *word = m_words[words[i_feature]];
+    if(word->weight <= 0) continue; // stopped
+
+    NodeId nid = 0; // root
+    if(nid_level > 0)
+    {
+      int depth = 0;
+      for(NodeId n = word->id; n != 0; n = m_nodes[n].parent) ++depth;
+
+      nid = word->id;
+      for(; depth > nid_level; --depth) nid = m_nodes[nid].parent;
+    }
+
+    nodes.push_back(std::make_pair(nid, i_feature));
+  }
+
+  fv.assign(nodes);
+}
+
+// --------------------------------------------------------------------------
+
 template<class TDescriptor, class F> 
 inline double TemplatedVocabulary<TDescriptor,F>::score
   (const BowVector &v1, const BowVector &v2) const
@@ -29,6 +29,7 @@
 #include <Eigen/Core>
 #include "solver.h"
 #include "linear_solver.h"
+#include "optimizable_graph.h"
 #include "sparse_block_matrix.h"
 #include "sparse_block_matrix_diagonal.h"
 #include "openmp_mutex.h"
@@ -142,6 +143,19 @@ namespace g2o {
       virtual void multiplyHessian(double* dest, const double* src) const { _Hpp->multiplySymmetricUpperTriangle(dest, src);}
 
     protected:
+      /**
+       * \brief off-diagonal Hessian block of an edge, recorded while computing the pattern
+       */
+      struct HessianBlockMapping
+      {
+        enum BlockType { POSE_POSE, LANDMARK_LANDMARK, POSE_LANDMARK };
+        OptimizableGraph::Edge* edge;
+        int viIdx, vjIdx;
+        BlockType type;
+        int row, col;     ///< block position in _Hpp, _Hll or _Hpl
+        bool transposed;  ///< edge writes the transposed block
+      };
+
       void resize(int* blockPoseIndices, int numPoseBlocks, 
           int* blockLandmarkIndices, int numLandmarkBlocks, int totalDim);
 
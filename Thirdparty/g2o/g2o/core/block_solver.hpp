@@ -172,37 +172,20 @@ bool BlockSolver<Traits>::buildStructure(bool zeroBlocks)
   delete[] blockLandmarkIndices;
   delete[] blockPoseIndices;
 
-  // allocate the diagonal on Hpp and Hll
-  int poseIdx = 0;
-  int landmarkIdx = 0;
-  for (size_t i = 0; i < _optimizer->indexMapping().size(); ++i) {
-    OptimizableGraph::Vertex* v = _optimizer->indexMapping()[i];
-    if (! v->marginalized()){
-      //assert(poseIdx == v->hessianIndex());
-      PoseMatrixType* m = _Hpp->block(poseIdx, poseIdx, true);
-      if (zeroBlocks)
-        m->setZero();
-      v->mapHessianMemory(m->data());
-      ++poseIdx;
-    } else {
-      LandmarkMatrixType* m = _Hll->block(landmarkIdx, landmarkIdx, true);
-      if (zeroBlocks)
-        m->setZero();
-      v->mapHessianMemory(m->data());
-      ++landmarkIdx;
-    }
-  }
-  assert(poseIdx == _numPoses && landmarkIdx == _numLandmarks);
-
-  // temporary structures for building the pattern of the Schur complement
-  SparseBlockMatrixHashMap<PoseMatrixType>* schurMatrixLookup = 0;
-  if (_doSchur) {
-    schurMatrixLookup = new SparseBlockMatrixHashMap<PoseMatrixType>(_Hschur->rowBlockIndices(), _Hschur->colBlockIndices());
-    schurMatrixLookup->blockCols().resize(_Hschur->blockCols().size());
-  }
+  // compute the pattern of Hpp, Hll and Hpl first, the blocks of each matrix
+  // are then allocated at once and indexed directly by the vertices and edges
+  std::vector<std::vector<int> > poseBlockRows(_numPoses);
+  std::vector<std::vector<int> > landmarkBlockRows(_numLandmarks);
+  std::vector<std::vector<int> > poseLandmarkBlockRows(_numLandmarks);
+  for (int i = 0; i < _numPoses; ++i)
+    poseBlockRows[i].push_back(i);
+  for (int i = 0; i < _numLandmarks; ++i)
+    landmarkBlockRows[i].push_back(i);
+
+  std::vector<HessianBlockMapping> edgeBlocks;
+  edgeBlocks.reserve(_optimizer->activeEdges().size());
 
   // here we assume that the landmark indices start after the pose ones
-  // create the structure in Hpp, Hll and in Hpl
   for (SparseOptimizer::EdgeContainer::const_iterator it=_optimizer->activeEdges().begin(); it!=_optimizer->activeEdges().end(); ++it){
     OptimizableGraph::Edge* e = *it;
 
@@ -222,73 +205,112 @@ bool BlockSolver<Traits>::buildStructure(bool zeroBlocks)
         if (transposedBlock){ // make sure, we allocate the upper triangle block
           swap(ind1, ind2);
         }
+        HessianBlockMapping m;
+        m.edge = e;
+        m.viIdx = viIdx;
+        m.vjIdx = vjIdx;
         if (! v1->marginalized() && !v2->marginalized()){
-          PoseMatrixType* m = _Hpp->block(ind1, ind2, true);
-          if (zeroBlocks)
-            m->setZero();
-          e->mapHessianMemory(m->data(), viIdx, vjIdx, transposedBlock);
-          if (_Hschur) {// assume this is only needed in case we solve with the schur complement
-            schurMatrixLookup->addBlock(ind1, ind2);
-          }
+          m.type = HessianBlockMapping::POSE_POSE;
+          m.row = ind1;
+          m.col = ind2;
+          m.transposed = transposedBlock;
+          poseBlockRows[ind2].push_back(ind1);
         } else if (v1->marginalized() && v2->marginalized()){
           // RAINER hmm.... should we ever reach this here????
-          LandmarkMatrixType* m = _Hll->block(ind1-_numPoses, ind2-_numPoses, true);
-          if (zeroBlocks)
-            m->setZero();
-          e->mapHessianMemory(m->data(), viIdx, vjIdx, false);
+          m.type = HessianBlockMapping::LANDMARK_LANDMARK;
+          m.row = ind1-_numPoses;
+          m.col = ind2-_numPoses;
+          m.transposed = false;
+          landmarkBlockRows[m.col].push_back(m.row);
         } else { 
+          m.type = HessianBlockMapping::POSE_LANDMARK;
           if (v1->marginalized()){ 
-            PoseLandmarkMatrixType* m = _Hpl->block(v2->hessianIndex(),v1->hessianIndex()-_numPoses, true);
-            if (zeroBlocks)
-              m->setZero();
-            e->mapHessianMemory(m->data(), viIdx, vjIdx, true); // transpose the block before writing to it
+            m.row = v2->hessianIndex();
+            m.col = v1->hessianIndex()-_numPoses;
+            m.transposed = true; // transpose the block before writing to it
           } else {
-            PoseLandmarkMatrixType* m = _Hpl->block(v1->hessianIndex(),v2->hessianIndex()-_numPoses, true);
-            if (zeroBlocks)
-              m->setZero();
-            e->mapHessianMemory(m->data(), viIdx, vjIdx, false); // directly the block
+            m.row = v1->hessianIndex();
+            m.col = v2->hessianIndex()-_numPoses;
+            m.transposed = false; // directly the block
           }
+          poseLandmarkBlockRows[m.col].push_back(m.row);
         }
+        edgeBlocks.push_back(m);
       }
     }
   }
 
+  // freshly allocated blocks are zero, independently of zeroBlocks
+  _Hpp->setPattern(poseBlockRows);
+  if (_Hll)
+    _Hll->setPattern(landmarkBlockRows);
+  if (_Hpl)
+    _Hpl->setPattern(poseLandmarkBlockRows);
+
+  // map the diagonal on Hpp and Hll
+  int poseIdx = 0;
+  int landmarkIdx = 0;
+  for (size_t i = 0; i < _optimizer->indexMapping().size(); ++i) {
+    OptimizableGraph::Vertex* v = _optimizer->indexMapping()[i];
+    if (! v->marginalized()){
+      //assert(poseIdx == v->hessianIndex());
+      v->mapHessianMemory(_Hpp->block(poseIdx, poseIdx)->data());
+      ++poseIdx;
+    } else {
+      v->mapHessianMemory(_Hll->block(landmarkIdx, landmarkIdx)->data());
+      ++landmarkIdx;
+    }
+  }
+  assert(poseIdx == _numPoses && landmarkIdx == _numLandmarks);
+
+  // map the off-diagonal blocks of the edges
+  for (size_t i = 0; i < edgeBlocks.size(); ++i) {
+    const HessianBlockMapping& m = edgeBlocks[i];
+    double* data = 0;
+    switch (m.type) {
+      case HessianBlockMapping::POSE_POSE:
+        data = _Hpp->block(m.row, m.col)->data();
+        break;
+      case HessianBlockMapping::LANDMARK_LANDMARK:
+        data = _Hll->block(m.row, m.col)->data();
+        break;
+      case HessianBlockMapping::POSE_LANDMARK:
+        data = _Hpl->block(m.row, m.col)->data();
+        break;
+    }
+    m.edge->mapHessianMemory(data, m.viIdx, m.vjIdx, m.transposed);
+  }
+
   if (! _doSchur)
     return true;
 
   _DInvSchur->diagonal().resize(landmarkIdx);
   _Hpl->fillSparseBlockMatrixCCS(*_HplCCS);
 
-  for (size_t i = 0; i < _optimizer->indexMapping().size(); ++i) {
-    OptimizableGraph::Vertex* v = _optimizer->indexMapping()[i];
-    if (v->marginalized()){
-      const HyperGraph::EdgeSet& vedges=v->edges();
-      for (HyperGraph::EdgeSet::const_iterator it1=vedges.begin(); it1!=vedges.end(); ++it1){
-        for (size_t i=0; i<(*it1)->vertices().size(); ++i)
-        {
-          OptimizableGraph::Vertex* v1= (OptimizableGraph::Vertex*) (*it1)->vertex(i);
-          if (v1->hessianIndex()==-1 || v1==v)
-            continue;
-          for  (HyperGraph::EdgeSet::const_iterator it2=vedges.begin(); it2!=vedges.end(); ++it2){
-            for (size_t j=0; j<(*it2)->vertices().size(); ++j)
-            {
-              OptimizableGraph::Vertex* v2= (OptimizableGraph::Vertex*) (*it2)->vertex(j);
-              if (v2->hessianIndex()==-1 || v2==v)
-                continue;
-              int i1=v1->hessianIndex();
-              int i2=v2->hessianIndex();
-              if (i1<=i2) {
-                schurMatrixLookup->addBlock(i1, i2);
-              }
-            }
-          }
-        }
+  // the Schur complement has the pattern of Hpp plus a block for each pair of
+  // poses observing a common landmark. poseBlockRows is already sorted and
+  // unique, the columns are compacted whenever they grow too much.
+  std::vector<std::vector<int> >& schurBlockRows = poseBlockRows;
+  std::vector<size_t> compactedSize(_numPoses);
+  for (int i = 0; i < _numPoses; ++i)
+    compactedSize[i] = schurBlockRows[i].size();
+
+  for (int landmarkIndex = 0; landmarkIndex < _numLandmarks; ++landmarkIndex) {
+    const typename PoseLandmarkHessianType::SparseColumn& landmarkColumn = _Hpl->blockCols()[landmarkIndex];
+    for (typename PoseLandmarkHessianType::SparseColumn::const_iterator it2 = landmarkColumn.begin(); it2 != landmarkColumn.end(); ++it2) {
+      int i2 = it2->first;
+      std::vector<int>& rows = schurBlockRows[i2];
+      for (typename PoseLandmarkHessianType::SparseColumn::const_iterator it1 = landmarkColumn.begin(); it1 != it2; ++it1)
+        rows.push_back(it1->first);
+      if (rows.size() > 2 * compactedSize[i2] + 64) {
+        std::sort(rows.begin(), rows.end());
+        rows.erase(std::unique(rows.begin(), rows.end()), rows.end());
+        compactedSize[i2] = rows.size();
       }
     }
   }
 
-  _Hschur->takePatternFromHash(*schurMatrixLookup);
-  delete schurMatrixLookup;
+  _Hschur->setPattern(schurBlockRows);
   _Hschur->fillSparseBlockMatrixCCSTransposed(*_HschurTransposedCCS);
 
   return true;
@@ -305,7 +327,7 @@ bool BlockSolver<Traits>::updateStructure(const std::vector<HyperGraph::Vertex*>
       _sizePoses+=dim;
       _Hpp->rowBlockIndices().push_back(_sizePoses);
       _Hpp->colBlockIndices().push_back(_sizePoses);
-      _Hpp->blockCols().push_back(typename SparseBlockMatrix<PoseMatrixType>::IntBlockMap());
+      _Hpp->blockCols().push_back(typename SparseBlockMatrix<PoseMatrixType>::SparseColumn());
       ++_numPoses;
       int ind = v->hessianIndex();
       PoseMatrixType* m = _Hpp->block(ind, ind, true);
@@ -379,7 +401,7 @@ bool BlockSolver<Traits>::solve(){
 # pragma omp parallel for default (shared) schedule(dynamic, 10)
 # endif
   for (int landmarkIndex = 0; landmarkIndex < static_cast<int>(_Hll->blockCols().size()); ++landmarkIndex) {
-    const typename SparseBlockMatrix<LandmarkMatrixType>::IntBlockMap& marginalizeColumn = _Hll->blockCols()[landmarkIndex];
+    const typename SparseBlockMatrix<LandmarkMatrixType>::SparseColumn& marginalizeColumn = _Hll->blockCols()[landmarkIndex];
     assert(marginalizeColumn.size() == 1 && "more than one block in _Hll column");
 
     // calculate inverse block for the landmark
@@ -27,13 +27,15 @@
 #ifndef G2O_SPARSE_BLOCK_MATRIX_
 #define G2O_SPARSE_BLOCK_MATRIX_
 
-#include <map>
 #include <vector>
+#include <utility>
+#include <algorithm>
 #include <fstream>
 #include <iostream>
 #include <iomanip>
 #include <cassert>
 #include <Eigen/Core>
+#include <Eigen/StdVector>
 
 #include "sparse_block_matrix_ccs.h"
 #include "matrix_structure.h"
@@ -42,6 +44,65 @@
 
 namespace g2o {
   using namespace Eigen;
+
+/**
+ * \brief A block-column of a SparseBlockMatrix
+ *
+ * The blocks of the column are kept in a flat array sorted by their
+ * block-row. It offers the part of the std::map interface that is used to
+ * traverse the columns, i.e., it->first is the block-row and it->second the
+ * pointer to the block.
+ */
+template <class MatrixType>
+class SparseBlockColumn {
+
+  public:
+    typedef std::pair<int, MatrixType*> value_type;
+    typedef std::vector<value_type> Container;
+    typedef typename Container::iterator iterator;
+    typedef typename Container::const_iterator const_iterator;
+
+    iterator begin() { return _blocks.begin();}
+    iterator end() { return _blocks.end();}
+    const_iterator begin() const { return _blocks.begin();}
+    const_iterator end() const { return _blocks.end();}
+
+    size_t size() const { return _blocks.size();}
+    bool empty() const { return _blocks.empty();}
+    void clear() { _blocks.clear();}
+    void reserve(size_t n) { _blocks.reserve(n);}
+
+    //! first block whose block-row is not less than r
+    iterator lower_bound(int r) { return std::lower_bound(_blocks.begin(), _blocks.end(), r, RowLess());}
+    const_iterator lower_bound(int r) const { return std::lower_bound(_blocks.begin(), _blocks.end(), r, RowLess());}
+
+    //! block at block-row r, or end() if there is none
+    iterator find(int r) { iterator it = lower_bound(r); return (it != end() && it->first == r) ? it : end();}
+    const_iterator find(int r) const { const_iterator it = lower_bound(r); return (it != end() && it->first == r) ? it : end();}
+
+    //! inserts the block keeping the column sorted, does nothing if the block-row already has a block
+    std::pair<iterator, bool> insert(const value_type& v)
+    {
+      iterator it = lower_bound(v.first);
+      if (it != end() && it->first == v.first)
+        return std::make_pair(it, false);
+      return std::make_pair(_blocks.insert(it, v), true);
+    }
+
+    //! appends a block whose block-row is greater than all the others in the column
+    void push_back(const value_type& v)
+    {
+      assert((_blocks.empty() || _blocks.back().first < v.first) && "column must stay sorted");
+      _blocks.push_back(v);
+    }
+
+  protected:
+    struct RowLess {
+      bool operator()(const value_type& b, int r) const { return b.first < r;}
+    };
+    Container _blocks;
+};
+
 /**
  * \brief Sparse matrix which uses blocks
  *
@@ -70,7 +131,11 @@ class SparseBlockMatrix {
     //! rows of the matrix
     inline int rows() const {return _rowBlockIndices.size() ? _rowBlockIndices.back() : 0;}
 
-    typedef std::map<int, SparseMatrixBlock*> IntBlockMap;
+    //! a block-column, sorted by block-row
+    typedef SparseBlockColumn<SparseMatrixBlock> SparseColumn;
+
+    //! contiguous storage of the blocks allocated by setPattern()
+    typedef std::vector<SparseMatrixBlock, Eigen::aligned_allocator<SparseMatrixBlock> > BlockSlab;
 
     /**
      * constructs a sparse block matrix having a specific layout
@@ -93,6 +158,14 @@ class SparseBlockMatrix {
     //! this zeroes all the blocks. If dealloc=true the blocks are removed from memory
     void clear(bool dealloc=false) ;
 
+    /**
+     * replaces all the blocks by the given pattern. The blocks are allocated
+     * at once in a contiguous slab, in column order, and set to zero.
+     * @param blockRows: for each block-column the block-rows of its blocks,
+     * the lists are sorted and made unique in place.
+     */
+    void setPattern(std::vector<std::vector<int> >& blockRows);
+
     //! returns the block at location r,c. if alloc=true he block is created if it does not exist
     SparseMatrixBlock* block(int r, int c, bool alloc=false);
     //! returns the block at location r,c
@@ -175,8 +248,8 @@ class SparseBlockMatrix {
     void fillBlockStructure(MatrixStructure& ms) const;
 
     //! the block matrices per block-column
-    const std::vector<IntBlockMap>& blockCols() const { return _blockCols;}
-    std::vector<IntBlockMap>& blockCols() { return _blockCols;}
+    const std::vector<SparseColumn>& blockCols() const { return _blockCols;}
+    std::vector<SparseColumn>& blockCols() { return _blockCols;}
 
     //! indices of the row blocks
     const std::vector<int>& rowBlockIndices() const { return _rowBlockIndices;}
@@ -211,11 +284,16 @@ class SparseBlockMatrix {
     void takePatternFromHash(SparseBlockMatrixHashMap<MatrixType>& hashMatrix);
 
   protected:
+    //! is the block part of the slab, i.e., not allocated on its own?
+    bool isSlabBlock(const SparseMatrixBlock* b) const { return ! _slab.empty() && b >= &_slab[0] && b < &_slab[0] + _slab.size();}
+
     std::vector<int> _rowBlockIndices; ///< vector of the indices of the blocks along the rows.
     std::vector<int> _colBlockIndices; ///< vector of the indices of the blocks along the cols
-    //! array of maps of blocks. The index of the array represent a block column of the matrix
-    //! and the block column is stored as a map row_block -> matrix_block_ptr.
-    std::vector <IntBlockMap> _blockCols;
+    //! array of columns of blocks. The index of the array represent a block column of the matrix
+    //! and the block column is stored as a sorted array row_block -> matrix_block_ptr.
+    std::vector <SparseColumn> _blockCols;
+    //! blocks allocated by setPattern(), the ones added later are allocated on their own
+    BlockSlab _slab;
     bool _hasStorage;
 };
 
@@ -70,18 +70,51 @@ namespace g2o {
 #   pragma omp parallel for default (shared) if (_blockCols.size() > 100)
 #   endif
     for (int i=0; i < static_cast<int>(_blockCols.size()); ++i) {
-      for (typename SparseBlockMatrix<MatrixType>::IntBlockMap::const_iterator it=_blockCols[i].begin(); it!=_blockCols[i].end(); ++it){
+      for (typename SparseBlockMatrix<MatrixType>::SparseColumn::const_iterator it=_blockCols[i].begin(); it!=_blockCols[i].end(); ++it){
         typename SparseBlockMatrix<MatrixType>::SparseMatrixBlock* b=it->second;
-        if (_hasStorage && dealloc)
-          delete b;
-        else
+        if (_hasStorage && dealloc) {
+          if (! isSlabBlock(b))
+            delete b;
+        } else
           b->setZero();
       }
       if (_hasStorage && dealloc)
         _blockCols[i].clear();
     }
+    if (_hasStorage && dealloc)
+      BlockSlab().swap(_slab);
   }
 
+  template <class MatrixType>
+  void SparseBlockMatrix<MatrixType>::setPattern(std::vector<std::vector<int> >& blockRows) {
+    assert(blockRows.size() == _blockCols.size() && "pattern does not match the block columns");
+    assert(_hasStorage && "a view cannot allocate blocks");
+    clear(true);
+
+    size_t numBlocks = 0;
+    for (size_t i=0; i<blockRows.size(); ++i){
+      std::vector<int>& rows = blockRows[i];
+      std::sort(rows.begin(), rows.end());
+      rows.erase(std::unique(rows.begin(), rows.end()), rows.end());
+      numBlocks += rows.size();
+    }
+
+    // the slab is never resized afterwards, thus the block pointers stay valid
+    _slab.resize(numBlocks);
+    size_t k = 0;
+    for (size_t i=0; i<blockRows.size(); ++i){
+      const std::vector<int>& rows = blockRows[i];
+      SparseColumn& column = _blockCols[i];
+      column.reserve(rows.size());
+      for (size_t j=0; j<rows.size(); ++j, ++k){
+        typename SparseBlockMatrix<MatrixType>::SparseMatrixBlock* b = &_slab[k];
+        b->resize(rowsOfBlock(rows[j]), colsOfBlock(i));
+        b->setZero();
+        column.push_back(std::make_pair(rows[j], b));
+      }
+    }
+  }
+  
   template <class MatrixType>
   SparseBlockMatrix<MatrixType>::~SparseBlockMatrix(){
     if (_hasStorage)
@@ -90,7 +123,7 @@ namespace g2o {
 
   template <class MatrixType>
   typename SparseBlockMatrix<MatrixType>::SparseMatrixBlock* SparseBlockMatrix<MatrixType>::block(int r, int c, bool alloc) {
-    typename SparseBlockMatrix<MatrixType>::IntBlockMap::iterator it =_blockCols[c].find(r);
+    typename SparseBlockMatrix<MatrixType>::SparseColumn::iterator it =_blockCols[c].find(r);
     typename SparseBlockMatrix<MatrixType>::SparseMatrixBlock* _block=0;
     if (it==_blockCols[c].end()){
       if (!_hasStorage && ! alloc )
@@ -100,7 +133,7 @@ namespace g2o {
         int cb=colsOfBlock(c);
         _block=new typename SparseBlockMatrix<MatrixType>::SparseMatrixBlock(rb,cb);
         _block->setZero();
-        std::pair < typename SparseBlockMatrix<MatrixType>::IntBlockMap::iterator, bool> result
+        std::pair < typename SparseBlockMatrix<MatrixType>::SparseColumn::iterator, bool> result
           =_blockCols[c].insert(std::make_pair(r,_block)); (void) result;
         assert (result.second);
       }
@@ -112,7 +145,7 @@ namespace g2o {
 
   template <class MatrixType>
   const typename SparseBlockMatrix<MatrixType>::SparseMatrixBlock* SparseBlockMatrix<MatrixType>::block(int r, int c) const {
-    typename SparseBlockMatrix<MatrixType>::IntBlockMap::const_iterator it =_blockCols[c].find(r);
+    typename SparseBlockMatrix<MatrixType>::SparseColumn::const_iterator it =_blockCols[c].find(r);
     if (it==_blockCols[c].end())
   return 0;
     return it->second;
@@ -123,9 +156,10 @@ namespace g2o {
   SparseBlockMatrix<MatrixType>* SparseBlockMatrix<MatrixType>::clone() const {
     SparseBlockMatrix* ret= new SparseBlockMatrix(&_rowBlockIndices[0], &_colBlockIndices[0], _rowBlockIndices.size(), _colBlockIndices.size());
     for (size_t i=0; i<_blockCols.size(); ++i){
-      for (typename SparseBlockMatrix<MatrixType>::IntBlockMap::const_iterator it=_blockCols[i].begin(); it!=_blockCols[i].end(); ++it){
+      ret->_blockCols[i].reserve(_blockCols[i].size());
+      for (typename SparseBlockMatrix<MatrixType>::SparseColumn::const_iterator it=_blockCols[i].begin(); it!=_blockCols[i].end(); ++it){
         typename SparseBlockMatrix<MatrixType>::SparseMatrixBlock* b=new typename SparseBlockMatrix<MatrixType>::SparseMatrixBlock(*it->second);
-        ret->_blockCols[i].insert(std::make_pair(it->first, b));
+        ret->_blockCols[i].push_back(std::make_pair(it->first, b));
       }
     }
     ret->_hasStorage=true;
@@ -156,7 +190,7 @@ namespace g2o {
     }
 
     for (size_t i=0; i<_blockCols.size(); ++i){
-      for (typename SparseBlockMatrix<MatrixType>::IntBlockMap::const_iterator it=_blockCols[i].begin(); it!=_blockCols[i].end(); ++it){
+      for (typename SparseBlockMatrix<MatrixType>::SparseColumn::const_iterator it=_blockCols[i].begin(); it!=_blockCols[i].end(); ++it){
         typename SparseBlockMatrix<MatrixType>::SparseMatrixBlock* s=it->second;
         typename SparseBlockMatrix<MatrixTransposedType>::SparseMatrixBlock* d=dest->block(i,it->first,true);
         *d = s->transpose();
@@ -186,7 +220,7 @@ namespace g2o {
       }
     }
     for (size_t i=0; i<_blockCols.size(); ++i){
-      for (typename SparseBlockMatrix<MatrixType>::IntBlockMap::const_iterator it=_blockCols[i].begin(); it!=_blockCols[i].end(); ++it){
+      for (typename SparseBlockMatrix<MatrixType>::SparseColumn::const_iterator it=_blockCols[i].begin(); it!=_blockCols[i].end(); ++it){
         typename SparseBlockMatrix<MatrixType>::SparseMatrixBlock* s=it->second;
         typename SparseBlockMatrix<MatrixType>::SparseMatrixBlock* d=dest->block(it->first,i,true);
         (*d)+=*s;
@@ -211,11 +245,11 @@ namespace g2o {
     if (! dest->_hasStorage)
       return false;
     for (size_t i=0; i<M->_blockCols.size(); ++i){
-      for (typename SparseBlockMatrix<MatrixFactorType>::IntBlockMap::const_iterator it=M->_blockCols[i].begin(); it!=M->_blockCols[i].end(); ++it){
+      for (typename SparseBlockMatrix<MatrixFactorType>::SparseColumn::const_iterator it=M->_blockCols[i].begin(); it!=M->_blockCols[i].end(); ++it){
         // look for a non-zero block in a row of column it
         int colM=i;
         const typename SparseBlockMatrix<MatrixFactorType>::SparseMatrixBlock *b=it->second;
-        typename SparseBlockMatrix<MatrixType>::IntBlockMap::const_iterator rbt=_blockCols[it->first].begin();
+        typename SparseBlockMatrix<MatrixType>::SparseColumn::const_iterator rbt=_blockCols[it->first].begin();
         while(rbt!=_blockCols[it->first].end()){
           //int colA=it->first;
           int rowA=rbt->first;
@@ -245,7 +279,7 @@ namespace g2o {
     for (size_t i=0; i<_blockCols.size(); ++i){
       int srcOffset = i ? _colBlockIndices[i-1] : 0;
 
-      for (typename SparseBlockMatrix<MatrixType>::IntBlockMap::const_iterator it=_blockCols[i].begin(); it!=_blockCols[i].end(); ++it){
+      for (typename SparseBlockMatrix<MatrixType>::SparseColumn::const_iterator it=_blockCols[i].begin(); it!=_blockCols[i].end(); ++it){
         const typename SparseBlockMatrix<MatrixType>::SparseMatrixBlock* a=it->second;
         int destOffset = it->first ? _rowBlockIndices[it->first - 1] : 0;
         // destVec += *a * srcVec (according to the sub-vector parts)
@@ -268,7 +302,7 @@ namespace g2o {
 
     for (size_t i=0; i<_blockCols.size(); ++i){
       int srcOffset = colBaseOfBlock(i);
-      for (typename SparseBlockMatrix<MatrixType>::IntBlockMap::const_iterator it=_blockCols[i].begin(); it!=_blockCols[i].end(); ++it){
+      for (typename SparseBlockMatrix<MatrixType>::SparseColumn::const_iterator it=_blockCols[i].begin(); it!=_blockCols[i].end(); ++it){
         const typename SparseBlockMatrix<MatrixType>::SparseMatrixBlock* a=it->second;
         int destOffset = rowBaseOfBlock(it->first);
         if (destOffset > srcOffset) // only upper triangle
@@ -299,7 +333,7 @@ namespace g2o {
 #   endif
     for (int i=0; i < static_cast<int>(_blockCols.size()); ++i){
       int destOffset = colBaseOfBlock(i);
-      for (typename SparseBlockMatrix<MatrixType>::IntBlockMap::const_iterator it=_blockCols[i].begin(); 
+      for (typename SparseBlockMatrix<MatrixType>::SparseColumn::const_iterator it=_blockCols[i].begin(); 
           it!=_blockCols[i].end(); 
           ++it){
         const typename SparseBlockMatrix<MatrixType>::SparseMatrixBlock* a=it->second;
@@ -314,7 +348,7 @@ namespace g2o {
   template <class MatrixType>
   void SparseBlockMatrix<MatrixType>::scale(double a_) {
     for (size_t i=0; i<_blockCols.size(); ++i){
-      for (typename SparseBlockMatrix<MatrixType>::IntBlockMap::const_iterator it=_blockCols[i].begin(); it!=_blockCols[i].end(); ++it){
+      for (typename SparseBlockMatrix<MatrixType>::SparseColumn::const_iterator it=_blockCols[i].begin(); it!=_blockCols[i].end(); ++it){
         typename SparseBlockMatrix<MatrixType>::SparseMatrixBlock* a=it->second;
         *a *= a_;
       }
@@ -339,10 +373,10 @@ namespace g2o {
     typename SparseBlockMatrix<MatrixType>::SparseBlockMatrix* s=new SparseBlockMatrix(rowIdx, colIdx, m, n, true);
     for (int i=0; i<n; ++i){
       int mc=cmin+i;
-      for (typename SparseBlockMatrix<MatrixType>::IntBlockMap::const_iterator it=_blockCols[mc].begin(); it!=_blockCols[mc].end(); ++it){
+      for (typename SparseBlockMatrix<MatrixType>::SparseColumn::const_iterator it=_blockCols[mc].begin(); it!=_blockCols[mc].end(); ++it){
         if (it->first >= rmin && it->first < rmax){
           typename SparseBlockMatrix<MatrixType>::SparseMatrixBlock* b = alloc ? new typename SparseBlockMatrix<MatrixType>::SparseMatrixBlock (* (it->second) ) : it->second;
-          s->_blockCols[i].insert(std::make_pair(it->first-rmin, b));
+          s->_blockCols[i].push_back(std::make_pair(it->first-rmin, b));
         }
       }
     }
@@ -366,7 +400,7 @@ namespace g2o {
     } else {
       size_t count=0;
       for (size_t i=0; i<_blockCols.size(); ++i){
-        for (typename SparseBlockMatrix<MatrixType>::IntBlockMap::const_iterator it=_blockCols[i].begin(); it!=_blockCols[i].end(); ++it){
+        for (typename SparseBlockMatrix<MatrixType>::SparseColumn::const_iterator it=_blockCols[i].begin(); it!=_blockCols[i].end(); ++it){
           const typename SparseBlockMatrix<MatrixType>::SparseMatrixBlock* a=it->second;
           count += a->cols()*a->rows();
         }
@@ -387,7 +421,7 @@ namespace g2o {
     os << std::endl;
 
     for (size_t i=0; i<m.blockCols().size(); ++i){
-      for (typename SparseBlockMatrix<MatrixType>::IntBlockMap::const_iterator it=m.blockCols()[i].begin(); it!=m.blockCols()[i].end(); ++it){
+      for (typename SparseBlockMatrix<MatrixType>::SparseColumn::const_iterator it=m.blockCols()[i].begin(); it!=m.blockCols()[i].end(); ++it){
         const typename SparseBlockMatrix<MatrixType>::SparseMatrixBlock* b=it->second;
         os << "BLOCK: " << it->first << " " << i << std::endl;
         os << *b << std::endl;
@@ -434,7 +468,7 @@ namespace g2o {
     for (size_t i=0; i<n; ++i){
       //cerr << PVAR(i) <<  " ";
       int pi=pinv[i];
-      for (typename SparseBlockMatrix<MatrixType>::IntBlockMap::const_iterator it=_blockCols[i].begin(); 
+      for (typename SparseBlockMatrix<MatrixType>::SparseColumn::const_iterator it=_blockCols[i].begin(); 
           it!=_blockCols[i].end(); ++it){
         int pj=pinv[it->first];
 
@@ -470,7 +504,7 @@ namespace g2o {
       int cstart=i ? _colBlockIndices[i-1] : 0;
       int csize=colsOfBlock(i);
       for (int c=0; c<csize; ++c) {
-        for (typename SparseBlockMatrix<MatrixType>::IntBlockMap::const_iterator it=_blockCols[i].begin(); it!=_blockCols[i].end(); ++it){
+        for (typename SparseBlockMatrix<MatrixType>::SparseColumn::const_iterator it=_blockCols[i].begin(); it!=_blockCols[i].end(); ++it){
           const typename SparseBlockMatrix<MatrixType>::SparseMatrixBlock* b=it->second;
           int rstart=it->first ? _rowBlockIndices[it->first-1] : 0;
 
@@ -496,7 +530,7 @@ namespace g2o {
       int csize=colsOfBlock(i);
       for (int c=0; c<csize; ++c) {
         *Cp=nz;
-        for (typename SparseBlockMatrix<MatrixType>::IntBlockMap::const_iterator it=_blockCols[i].begin(); it!=_blockCols[i].end(); ++it){
+        for (typename SparseBlockMatrix<MatrixType>::SparseColumn::const_iterator it=_blockCols[i].begin(); it!=_blockCols[i].end(); ++it){
           const typename SparseBlockMatrix<MatrixType>::SparseMatrixBlock* b=it->second;
           int rstart=it->first ? _rowBlockIndices[it->first-1] : 0;
 
@@ -531,7 +565,7 @@ namespace g2o {
     for (int i = 0; i < static_cast<int>(_blockCols.size()); ++i){
       *Cp = nz;
       const int& c = i;
-      for (typename SparseBlockMatrix<MatrixType>::IntBlockMap::const_iterator it=_blockCols[i].begin(); it!=_blockCols[i].end(); ++it) {
+      for (typename SparseBlockMatrix<MatrixType>::SparseColumn::const_iterator it=_blockCols[i].begin(); it!=_blockCols[i].end(); ++it) {
         const int& r = it->first;
         if (r <= c) {
           *Ci++ = r;
@@ -555,7 +589,7 @@ namespace g2o {
     std::vector<TripletEntry> entries;
     for (size_t i = 0; i<_blockCols.size(); ++i){
       const int& c = i;
-      for (typename SparseBlockMatrix<MatrixType>::IntBlockMap::const_iterator it=_blockCols[i].begin(); it!=_blockCols[i].end(); ++it) {
+      for (typename SparseBlockMatrix<MatrixType>::SparseColumn::const_iterator it=_blockCols[i].begin(); it!=_blockCols[i].end(); ++it) {
         const int& r = it->first;
         const MatrixType& m = *(it->second);
         for (int cc = 0; cc < m.cols(); ++cc)
@@ -594,11 +628,11 @@ namespace g2o {
     blockCCS.blockCols().resize(blockCols().size());
     int numblocks = 0;
     for (size_t i = 0; i < blockCols().size(); ++i) {
-      const IntBlockMap& row = blockCols()[i];
+      const SparseColumn& row = blockCols()[i];
       typename SparseBlockMatrixCCS<MatrixType>::SparseColumn& dest = blockCCS.blockCols()[i];
       dest.clear();
       dest.reserve(row.size());
-      for (typename IntBlockMap::const_iterator it = row.begin(); it != row.end(); ++it) {
+      for (typename SparseColumn::const_iterator it = row.begin(); it != row.end(); ++it) {
         dest.push_back(typename SparseBlockMatrixCCS<MatrixType>::RowBlock(it->first, it->second));
         ++numblocks;
       }
@@ -613,8 +647,8 @@ namespace g2o {
     blockCCS.blockCols().resize(_rowBlockIndices.size());
     int numblocks = 0;
     for (size_t i = 0; i < blockCols().size(); ++i) {
-      const IntBlockMap& row = blockCols()[i];
-      for (typename IntBlockMap::const_iterator it = row.begin(); it != row.end(); ++it) {
+      const SparseColumn& row = blockCols()[i];
+      for (typename SparseColumn::const_iterator it = row.begin(); it != row.end(); ++it) {
         typename SparseBlockMatrixCCS<MatrixType>::SparseColumn& dest = blockCCS.blockCols()[it->first];
         dest.push_back(typename SparseBlockMatrixCCS<MatrixType>::RowBlock(i, it->second));
         ++numblocks;
@@ -626,8 +660,7 @@ namespace g2o {
   template <class MatrixType>
   void SparseBlockMatrix<MatrixType>::takePatternFromHash(SparseBlockMatrixHashMap<MatrixType>& hashMatrix)
   {
-    // sort the sparse columns and add them to the map structures by
-    // exploiting that we are inserting a sorted structure
+    // sort the sparse columns and append them to the flat columns
     typedef std::pair<int, MatrixType*> SparseColumnPair;
     typedef typename SparseBlockMatrixHashMap<MatrixType>::SparseColumn HashSparseColumn;
     for (size_t i = 0; i < hashMatrix.blockCols().size(); ++i) {
@@ -643,14 +676,11 @@ namespace g2o {
       // try to free some memory early
       HashSparseColumn aux;
       swap(aux, column);
-      // now insert sorted vector to the std::map structure
-      IntBlockMap& destColumnMap = blockCols()[i];
-      destColumnMap.insert(sparseRowSorted[0]);
-      for (size_t j = 1; j < sparseRowSorted.size(); ++j) {
-        typename SparseBlockMatrix<MatrixType>::IntBlockMap::iterator hint = destColumnMap.end();
-        --hint; // cppreference says the element goes after the hint (until C++11)
-        destColumnMap.insert(hint, sparseRowSorted[j]);
-      }
+      // the blocks were allocated on their own by the hash matrix, we take their ownership
+      SparseColumn& destColumn = blockCols()[i];
+      destColumn.reserve(destColumn.size() + sparseRowSorted.size());
+      for (size_t j = 0; j < sparseRowSorted.size(); ++j)
+        destColumn.insert(sparseRowSorted[j]);
     }
   }
 
@@ -83,9 +83,9 @@ namespace g2o {
           int c_size = A.colsOfBlock(i);
           assert(c_idx == A.colBaseOfBlock(i) && "mismatch in block indices");
 
-          const typename SparseBlockMatrix<MatrixType>::IntBlockMap& col = A.blockCols()[i];
+          const typename SparseBlockMatrix<MatrixType>::SparseColumn& col = A.blockCols()[i];
           if (col.size() > 0) {
-            typename SparseBlockMatrix<MatrixType>::IntBlockMap::const_iterator it;
+            typename SparseBlockMatrix<MatrixType>::SparseColumn::const_iterator it;
             for (it = col.begin(); it != col.end(); ++it) {
               int r_idx = A.rowBaseOfBlock(it->first);
               // only the upper triangular block is processed
@@ -158,8 +158,8 @@ class LinearSolverEigen: public LinearSolver<MatrixType>
           // prepare a block structure matrix for calling AMD
           std::vector<Triplet> triplets;
           for (size_t c = 0; c < A.blockCols().size(); ++c){
-            const typename SparseBlockMatrix<MatrixType>::IntBlockMap& column = A.blockCols()[c];
-            for (typename SparseBlockMatrix<MatrixType>::IntBlockMap::const_iterator it = column.begin(); it != column.end(); ++it) {
+            const typename SparseBlockMatrix<MatrixType>::SparseColumn& column = A.blockCols()[c];
+            for (typename SparseBlockMatrix<MatrixType>::SparseColumn::const_iterator it = column.begin(); it != column.end(); ++it) {
               const int& r = it->first;
               if (r > static_cast<int>(c)) // only upper triangle
                 break;
@@ -211,8 +211,8 @@ class LinearSolverEigen: public LinearSolver<MatrixType>
         triplets.reserve(A.nonZeros());
         for (size_t c = 0; c < A.blockCols().size(); ++c) {
           int colBaseOfBlock = A.colBaseOfBlock(c);
-          const typename SparseBlockMatrix<MatrixType>::IntBlockMap& column = A.blockCols()[c];
-          for (typename SparseBlockMatrix<MatrixType>::IntBlockMap::const_iterator it = column.begin(); it != column.end(); ++it) {
+          const typename SparseBlockMatrix<MatrixType>::SparseColumn& column = A.blockCols()[c];
+          for (typename SparseBlockMatrix<MatrixType>::SparseColumn::const_iterator it = column.begin(); it != column.end(); ++it) {
             int rowBaseOfBlock = A.rowBaseOfBlock(it->first);
             const MatrixType& m = *(it->second);
             for (int cc = 0; cc < m.cols(); ++cc) {
@@ -0,0 +1,551 @@
+// g2o - General Graph Optimization
+// Copyright (C) 2011 R. Kuemmerle, G. Grisetti, W. Burgard
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+// IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+// TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+// PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef G2O_LINEAR_SOLVER_SUPERNODAL_H
+#define G2O_LINEAR_SOLVER_SUPERNODAL_H
+
+#include <Eigen/Core>
+#include <Eigen/Cholesky>
+#include <Eigen/Sparse>
+#include <Eigen/OrderingMethods>
+
+#include "../core/linear_solver.h"
+#include "../core/batch_stats.h"
+#include "../core/openmp_mutex.h"
+#include "../stuff/timeutil.h"
+
+#include "../core/eigen_types.h"
+
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+#ifdef G2O_OPENMP
+#include <omp.h>
+#endif
+
+namespace g2o {
+
+/**
+ * \brief linear solver using a supernodal Cholesky decomposition
+ *
+ * The symbolic analysis is carried out on the blocks of A: fill-in reducing
+ * ordering of the blocks (AMD), elimination tree, and the supernodes, i.e.,
+ * runs of consecutive block columns of L which share the same pattern below
+ * the diagonal. Each supernode is stored as a dense column-major panel and
+ * factorized with the dense Cholesky, triangular solve, and rank update of
+ * Eigen. The analysis is computed once and re-used until init() is called.
+ *
+ * If g2o is compiled with OpenMP, independent subtrees of the supernodal
+ * elimination tree may be factorized in parallel, see setParallel().
+ */
+template <typename MatrixType>
+class LinearSolverSupernodal: public LinearSolver<MatrixType>
+{
+  public:
+    typedef Eigen::SparseMatrix<double, Eigen::ColMajor> SparseMatrix;
+    typedef Eigen::Triplet<double> Triplet;
+    typedef Eigen::PermutationMatrix<Eigen::Dynamic, Eigen::Dynamic> PermutationMatrix;
+    typedef Eigen::Map<MatrixXD, 0, Eigen::OuterStride<> > PanelMap;
+
+  public:
+    LinearSolverSupernodal() :
+      LinearSolver<MatrixType>(),
+      _init(true), _parallel(false), _writeDebug(false)
+    {
+    }
+
+    virtual ~LinearSolverSupernodal()
+    {
+    }
+
+    virtual bool init()
+    {
+      _init = true;
+      return true;
+    }
+
+    bool solve(const SparseBlockMatrix<MatrixType>& A, double* x, double* b)
+    {
+      if (_init) // compute the symbolic decomposition once
+        computeSymbolicDecomposition(A);
+      _init = false;
+
+      double t=get_monotonic_time();
+      fillPanels(A);
+      if (! factorize()) { // the matrix is not positive definite
+        if (_writeDebug) {
+          std::cerr << "Cholesky failure, writing debug.txt (Hessian loadable by Octave)" << std::endl;
+          A.writeOctave("debug.txt");
+        }
+        return false;
+      }
+
+      // Solving the system
+      solveFactorized(x, b);
+      G2OBatchStatistics* globalStats = G2OBatchStatistics::globalStats();
+      if (globalStats) {
+        globalStats->timeNumericDecomposition = get_monotonic_time() - t;
+        globalStats->choleskyNNZ = _factorNNZ;
+      }
+
+      return true;
+    }
+
+    //! factorize independent subtrees in parallel (only has an effect with OpenMP)
+    bool parallel() const { return _parallel;}
+    void setParallel(bool parallel) { _parallel = parallel;}
+
+    //! write a debug dump of the system matrix if it is not SPD in solve
+    virtual bool writeDebug() const { return _writeDebug;}
+    virtual void setWriteDebug(bool b) { _writeDebug = b;}
+
+  protected:
+    /**
+     * a supernode spans the block columns [firstBlock, lastBlock) of L. Its
+     * panel stores numRows x numCols values starting at valueOffset, the block
+     * rows of the panel are _rowBlocks[rowBegin, rowEnd), the diagonal blocks first.
+     */
+    struct Supernode
+    {
+      int firstBlock, lastBlock;
+      int numCols, numRows;
+      size_t valueOffset;
+      int rowBegin, rowEnd;
+      int parent;
+    };
+
+    //! destination of a block of A in the panels
+    struct AssemblyEntry
+    {
+      size_t offset;
+      int ld;
+      bool transposed;
+    };
+
+    //! scratch memory of one thread during the factorization
+    struct Workspace
+    {
+      MatrixXD update;
+      std::vector<int> relativeRow;
+    };
+
+    bool _init;
+    bool _parallel;
+    bool _writeDebug;
+    size_t _factorNNZ;
+
+    std::vector<int> _scalarPerm;       ///< scalar index in the permuted system -> index in A
+    std::vector<int> _blockBase;        ///< scalar offset of the permuted blocks
+    std::vector<int> _blockSupernode;   ///< supernode of each permuted block column
+    std::vector<int> _blockColOffset;   ///< scalar column offset of a permuted block inside its supernode
+    std::vector<Supernode> _supernodes;
+    std::vector<int> _rowBlocks;        ///< block rows of the panels
+    std::vector<int> _rowOffsets;       ///< scalar row offset of the entries of _rowBlocks in their panel
+    std::vector<AssemblyEntry> _assembly;
+    std::vector<double> _values;
+    VectorXD _y, _tmp;
+
+    // schedule for the parallel factorization
+    std::vector<int> _subtreeOf;                  ///< subtree of a supernode, -1 for the top of the tree
+    std::vector<std::vector<int> > _subtrees;
+    std::vector<int> _topSupernodes;
+    std::vector<OpenMPMutex> _locks;
+
+    /**
+     * compute the symbolic decompostion of the matrix only once.
+     * Since A has the same pattern in all the iterations, we only
+     * compute the ordering, the elimination tree, and the supernodes once
+     * and re-use them for all the following iterations.
+     */
+    void computeSymbolicDecomposition(const SparseBlockMatrix<MatrixType>& A)
+    {
+      double t=get_monotonic_time();
+      assert(A.rows() == A.cols() && "Matrix A is not square");
+      const int n = A.blockCols().size();
+
+      // AMD ordering on the block structure
+      PermutationMatrix blockP;
+      {
+        std::vector<Triplet> triplets;
+        for (int c = 0; c < n; ++c){
+          const typename SparseBlockMatrix<MatrixType>::SparseColumn& column = A.blockCols()[c];
+          for (typename SparseBlockMatrix<MatrixType>::SparseColumn::const_iterator it = column.begin(); it != column.end(); ++it) {
+            if (it->first > c) // only upper triangle
+              break;
+            triplets.push_back(Triplet(it->first, c, 0.));
+          }
+        }
+        SparseMatrix auxBlockMatrix(n, n);
+        auxBlockMatrix.setFromTriplets(triplets.begin(), triplets.end());
+        Eigen::AMDOrdering<int> ordering;
+        ordering(auxBlockMatrix.selfadjointView<Eigen::Upper>(), blockP);
+      }
+      std::vector<int> permInv(n);
+      _blockBase.resize(n + 1);
+      _blockBase[0] = 0;
+      for (int k = 0; k < n; ++k) {
+        const int& p = blockP.indices()(k);
+        permInv[p] = k;
+        _blockBase[k + 1] = _blockBase[k] + A.colsOfBlock(p);
+      }
+      _scalarPerm.resize(A.rows());
+      for (int k = 0; k < n; ++k) {
+        int base = A.colBaseOfBlock(blockP.indices()(k));
+        for (int j = _blockBase[k]; j < _blockBase[k + 1]; ++j)
+          _scalarPerm[j] = base++;
+      }
+
+      // lower triangular block pattern of the permuted matrix
+      std::vector<std::vector<int> > lowerPattern(n);
+      for (int c = 0; c < n; ++c) {
+        const typename SparseBlockMatrix<MatrixType>::SparseColumn& column = A.blockCols()[c];
+        for (typename SparseBlockMatrix<MatrixType>::SparseColumn::const_iterator it = column.begin(); it != column.end(); ++it) {
+          if (it->first >= c)
+            break;
+          int pr = permInv[it->first];
+          int pc = permInv[c];
+          lowerPattern[std::min(pr, pc)].push_back(std::max(pr, pc));
+        }
+      }
+
+      // pattern of the block columns of L and elimination tree
+      std::vector<std::vector<int> > patternL(n);
+      std::vector<int> parent(n, -1);
+      std::vector<int> numChildren(n, 0);
+      std::vector<std::vector<int> > children(n);
+      std::vector<int> merged;
+      for (int j = 0; j < n; ++j) {
+        std::vector<int>& pattern = patternL[j];
+        pattern.swap(lowerPattern[j]);
+        std::sort(pattern.begin(), pattern.end());
+        for (size_t i = 0; i < children[j].size(); ++i) {
+          const std::vector<int>& childPattern = patternL[children[j][i]];
+          merged.clear();
+          std::set_union(pattern.begin(), pattern.end(), childPattern.begin() + 1, childPattern.end(), std::back_inserter(merged));
+          pattern.swap(merged);
+        }
+        pattern.erase(std::unique(pattern.begin(), pattern.end()), pattern.end());
+        if (! pattern.empty()) {
+          parent[j] = pattern.front();
+          children[parent[j]].push_back(j);
+          numChildren[parent[j]]++;
+        }
+      }
+
+      // fundamental supernodes
+      _supernodes.clear();
+      _rowBlocks.clear();
+      _rowOffsets.clear();
+      _blockSupernode.resize(n);
+      _blockColOffset.resize(n);
+      for (int j = 0; j < n; ++j) {
+        bool extend = j > 0 && parent[j - 1] == j && numChildren[j] == 1 && patternL[j - 1].size() == patternL[j].size() + 1;
+        if (! extend) {
+          Supernode sn;
+          sn.firstBlock = j;
+          sn.parent = -1;
+          _supernodes.push_back(sn);
+        }
+        Supernode& sn = _supernodes.back();
+        sn.lastBlock = j + 1;
+        _blockSupernode[j] = _supernodes.size() - 1;
+        _blockColOffset[j] = _blockBase[j] - _blockBase[sn.firstBlock];
+      }
+
+      size_t valueOffset = 0;
+      _factorNNZ = 0;
+      for (size_t s = 0; s < _supernodes.size(); ++s) {
+        Supernode& sn = _supernodes[s];
+        sn.numCols = _blockBase[sn.lastBlock] - _blockBase[sn.firstBlock];
+        sn.rowBegin = _rowBlocks.size();
+        int rowOffset = 0;
+        for (int k = sn.firstBlock; k < sn.lastBlock; ++k) {
+          _rowBlocks.push_back(k);
+          _rowOffsets.push_back(rowOffset);
+          rowOffset += _blockBase[k + 1] - _blockBase[k];
+        }
+        const std::vector<int>& below = patternL[sn.lastBlock - 1];
+        for (size_t i = 0; i < below.size(); ++i) {
+          _rowBlocks.push_back(below[i]);
+          _rowOffsets.push_back(rowOffset);
+          rowOffset += _blockBase[below[i] + 1] - _blockBase[below[i]];
+        }
+        sn.rowEnd = _rowBlocks.size();
+        sn.numRows = rowOffset;
+        sn.valueOffset = valueOffset;
+        if (! below.empty())
+          sn.parent = _blockSupernode[below.front()];
+        valueOffset += static_cast<size_t>(sn.numRows) * sn.numCols;
+        _factorNNZ += static_cast<size_t>(sn.numRows) * sn.numCols - static_cast<size_t>(sn.numCols) * (sn.numCols - 1) / 2;
+      }
+      _values.resize(valueOffset);
+
+      // destination of the blocks of A
+      _assembly.clear();
+      for (int c = 0; c < n; ++c) {
+        const typename SparseBlockMatrix<MatrixType>::SparseColumn& column = A.blockCols()[c];
+        for (typename SparseBlockMatrix<MatrixType>::SparseColumn::const_iterator it = column.begin(); it != column.end(); ++it) {
+          if (it->first > c)
+            break;
+          int pr = permInv[it->first];
+          int pc = permInv[c];
+          int row = std::max(pr, pc);
+          int col = std::min(pr, pc);
+          const Supernode& sn = _supernodes[_blockSupernode[col]];
+          std::vector<int>::const_iterator rowIt = std::lower_bound(_rowBlocks.begin() + sn.rowBegin, _rowBlocks.begin() + sn.rowEnd, row);
+          assert(rowIt != _rowBlocks.begin() + sn.rowEnd && *rowIt == row && "block missing in the pattern of L");
+          AssemblyEntry entry;
+          entry.offset = sn.valueOffset + static_cast<size_t>(_blockColOffset[col]) * sn.numRows + _rowOffsets[rowIt - _rowBlocks.begin()];
+          entry.ld = sn.numRows;
+          entry.transposed = pr < pc;
+          _assembly.push_back(entry);
+        }
+      }
+
+      computeSchedule();
+
+      G2OBatchStatistics* globalStats = G2OBatchStatistics::globalStats();
+      if (globalStats)
+        globalStats->timeSymbolicDecomposition = get_monotonic_time() - t;
+    }
+
+    /**
+     * split the supernodal elimination tree into independent subtrees of
+     * similar work, which are factorized in parallel, and the remaining top
+     * part of the tree, which is factorized afterwards.
+     */
+    void computeSchedule()
+    {
+      _subtrees.clear();
+      _topSupernodes.clear();
+      _subtreeOf.assign(_supernodes.size(), -1);
+      int numThreads = 1;
+#     ifdef G2O_OPENMP
+      numThreads = omp_get_max_threads();
+#     endif
+      if (numThreads <= 1) {
+        for (size_t s = 0; s < _supernodes.size(); ++s)
+          _topSupernodes.push_back(s);
+        return;
+      }
+
+      // children have a smaller index than their parent
+      std::vector<double> work(_supernodes.size(), 0.);
+      double totalWork = 0.;
+      for (size_t s = 0; s < _supernodes.size(); ++s) {
+        const Supernode& sn = _supernodes[s];
+        work[s] += static_cast<double>(sn.numRows) * sn.numRows * sn.numCols;
+        if (sn.parent >= 0)
+          work[sn.parent] += work[s];
+        else
+          totalWork += work[s];
+      }
+      double maxWork = totalWork / (4 * numThreads);
+      for (int s = _supernodes.size() - 1; s >= 0; --s) {
+        const Supernode& sn = _supernodes[s];
+        if (sn.parent >= 0 && _subtreeOf[sn.parent] >= 0) {
+          _subtreeOf[s] = _subtreeOf[sn.parent];
+        } else if (work[s] <= maxWork) {
+          _subtreeOf[s] = _subtrees.size();
+          _subtrees.push_back(std::vector<int>());
+        }
+      }
+      for (size_t s = 0; s < _supernodes.size(); ++s) {
+        if (_subtreeOf[s] >= 0)
+          _subtrees[_subtreeOf[s]].push_back(s);
+        else
+          _topSupernodes.push_back(s);
+      }
+      std::vector<OpenMPMutex> locks(_supernodes.size());
+      _locks.swap(locks);
+    }
+
+    void fillPanels(const SparseBlockMatrix<MatrixType>& A)
+    {
+      std::fill(_values.begin(), _values.end(), 0.);
+      size_t idx = 0;
+      for (size_t c = 0; c < A.blockCols().size(); ++c) {
+        const typename SparseBlockMatrix<MatrixType>::SparseColumn& column = A.blockCols()[c];
+        for (typename SparseBlockMatrix<MatrixType>::SparseColumn::const_iterator it = column.begin(); it != column.end(); ++it) {
+          if (it->first > static_cast<int>(c))
+            break;
+          assert(idx < _assembly.size() && "pattern of A changed without calling init()");
+          const AssemblyEntry& entry = _assembly[idx++];
+          const MatrixType& m = *(it->second);
+          if (entry.transposed) {
+            PanelMap dest(&_values[entry.offset], m.cols(), m.rows(), Eigen::OuterStride<>(entry.ld));
+            dest = m.transpose();
+          } else {
+            PanelMap dest(&_values[entry.offset], m.rows(), m.cols(), Eigen::OuterStride<>(entry.ld));
+            dest = m;
+          }
+        }
+      }
+      assert(idx == _assembly.size() && "pattern of A changed without calling init()");
+    }
+
+    bool factorize()
+    {
+      bool ok = true;
+#     ifdef G2O_OPENMP
+      if (_parallel && _subtrees.size() > 1) {
+#       pragma omp parallel
+        {
+          Workspace ws;
+          ws.relativeRow.resize(_blockSupernode.size());
+#         pragma omp for schedule(dynamic) reduction(&&: ok)
+          for (int i = 0; i < static_cast<int>(_subtrees.size()); ++i) {
+            const std::vector<int>& subtree = _subtrees[i];
+            for (size_t k = 0; k < subtree.size() && ok; ++k)
+              ok = factorizeSupernode(subtree[k], ws, true);
+          }
+        }
+        if (! ok)
+          return false;
+        Workspace ws;
+        ws.relativeRow.resize(_blockSupernode.size());
+        for (size_t k = 0; k < _topSupernodes.size(); ++k)
+          if (! factorizeSupernode(_topSupernodes[k], ws, false))
+            return false;
+        return true;
+      }
+#     endif
+      Workspace ws;
+      ws.relativeRow.resize(_blockSupernode.size());
+      for (size_t s = 0; s < _supernodes.size() && ok; ++s)
+        ok = factorizeSupernode(s, ws, false);
+      return ok;
+    }
+
+    /**
+     * factorize the panel of supernode s and apply its update to the panels
+     * of its ancestors. If lockAncestors is true, the panels outside the
+     * subtree of s are locked while updating them.
+     */
+    bool factorizeSupernode(int s, Workspace& ws, bool lockAncestors)
+    {
+      const Supernode& sn = _supernodes[s];
+      PanelMap panel(&_values[sn.valueOffset], sn.numRows, sn.numCols, Eigen::OuterStride<>(sn.numRows));
+      Eigen::Block<PanelMap> diag = panel.topRows(sn.numCols);
+
+      Eigen::LLT<MatrixXD> llt(diag);
+      if (llt.info() != Eigen::Success)
+        return false;
+      diag = llt.matrixLLT();
+
+      const int m = sn.numRows - sn.numCols;
+      if (m == 0)
+        return true;
+
+      // L21 = A21 * L11^-T and the update L21 * L21^T for the ancestors
+      Eigen::Block<PanelMap> below = panel.bottomRows(m);
+      diag.template triangularView<Eigen::Lower>().transpose().template solveInPlace<Eigen::OnTheRight>(below);
+      ws.update.setZero(m, m);
+      ws.update.template selfadjointView<Eigen::Lower>().rankUpdate(below);
+
+      const int firstBelow = sn.rowBegin + (sn.lastBlock - sn.firstBlock);
+      int target = -1;
+      for (int jj = firstBelow; jj < sn.rowEnd; ++jj) {
+        const int colBlock = _rowBlocks[jj];
+        const int colUpdate = _rowOffsets[jj] - sn.numCols;
+        const int numCols = _blockBase[colBlock + 1] - _blockBase[colBlock];
+        if (_blockSupernode[colBlock] != target) {
+          if (target >= 0 && lockAncestors && _subtreeOf[target] != _subtreeOf[s])
+            _locks[target].unlock();
+          target = _blockSupernode[colBlock];
+          const Supernode& tn = _supernodes[target];
+          for (int i = tn.rowBegin; i < tn.rowEnd; ++i)
+            ws.relativeRow[_rowBlocks[i]] = _rowOffsets[i];
+          if (lockAncestors && _subtreeOf[target] != _subtreeOf[s])
+            _locks[target].lock();
+        }
+        const Supernode& tn = _supernodes[target];
+        PanelMap targetPanel(&_values[tn.valueOffset], tn.numRows, tn.numCols, Eigen::OuterStride<>(tn.numRows));
+        const int targetCol = _blockColOffset[colBlock];
+        for (int ii = jj; ii < sn.rowEnd; ++ii) {
+          const int rowBlock = _rowBlocks[ii];
+          const int numRows = _blockBase[rowBlock + 1] - _blockBase[rowBlock];
+          targetPanel.block(ws.relativeRow[rowBlock], targetCol, numRows, numCols) -=
+            ws.update.block(_rowOffsets[ii] - sn.numCols, colUpdate, numRows, numCols);
+        }
+      }
+      if (target >= 0 && lockAncestors && _subtreeOf[target] != _subtreeOf[s])
+        _locks[target].unlock();
+      return true;
+    }
+
+    //! solve L L^T x = b using the factorized panels
+    void solveFactorized(double* x, double* b)
+    {
+      const int rows = _scalarPerm.size();
+      _y.resize(rows);
+      for (int i = 0; i < rows; ++i)
+        _y(i) = b[_scalarPerm[i]];
+
+      // forward substitution L y = b
+      for (size_t s = 0; s < _supernodes.size(); ++s) {
+        const Supernode& sn = _supernodes[s];
+        PanelMap panel(&_values[sn.valueOffset], sn.numRows, sn.numCols, Eigen::OuterStride<>(sn.numRows));
+        const int m = sn.numRows - sn.numCols;
+        VectorXD::SegmentReturnType ys = _y.segment(_blockBase[sn.firstBlock], sn.numCols);
+        panel.topRows(sn.numCols).template triangularView<Eigen::Lower>().solveInPlace(ys);
+        if (m == 0)
+          continue;
+        _tmp.noalias() = panel.bottomRows(m) * ys;
+        for (int i = sn.rowBegin + (sn.lastBlock - sn.firstBlock); i < sn.rowEnd; ++i) {
+          const int k = _rowBlocks[i];
+          const int size = _blockBase[k + 1] - _blockBase[k];
+          _y.segment(_blockBase[k], size) -= _tmp.segment(_rowOffsets[i] - sn.numCols, size);
+        }
+      }
+
+      // backward substitution L^T x = y
+      for (int s = _supernodes.size() - 1; s >= 0; --s) {
+        const Supernode& sn = _supernodes[s];
+        PanelMap panel(&_values[sn.valueOffset], sn.numRows, sn.numCols, Eigen::OuterStride<>(sn.numRows));
+        const int m = sn.numRows - sn.numCols;
+        VectorXD::SegmentReturnType ys = _y.segment(_blockBase[sn.firstBlock], sn.numCols);
+        if (m > 0) {
+          _tmp.resize(m);
+          for (int i = sn.rowBegin + (sn.lastBlock - sn.firstBlock); i < sn.rowEnd; ++i) {
+            const int k = _rowBlocks[i];
+            const int size = _blockBase[k + 1] - _blockBase[k];
+            _tmp.segment(_rowOffsets[i] - sn.numCols, size) = _y.segment(_blockBase[k], size);
+          }
+          ys.noalias() -= panel.bottomRows(m).transpose() * _tmp;
+        }
+        panel.topRows(sn.numCols).template triangularView<Eigen::Lower>().transpose().solveInPlace(ys);
+      }
+
+      for (int i = 0; i < rows; ++i)
+        x[_scalarPerm[i]] = _y(i);
+    }
+};
+
+} // end namespace
+
+#endif
@@ -0,0 +1,197 @@
+/**
+* This file is part of ORB-SLAM2.
+*
+* Copyright (C) 2014-2016 Raúl Mur-Artal <raulmur at unizar dot es> (University of Zaragoza)
+* For more information see <https://github.com/raulmur/ORB_SLAM2>
+*
+* ORB-SLAM2 is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM2 is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with ORB-SLAM2. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef BUNDLEADJUSTER_H
+#define BUNDLEADJUSTER_H
+
+#include <vector>
+
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+#include <Eigen/StdVector>
+
+#include "Thirdparty/g2o/g2o/types/se3quat.h"
+#include "Thirdparty/g2o/g2o/core/sparse_block_matrix.h"
+#include "Thirdparty/g2o/g2o/solvers/linear_solver_supernodal.h"
+
+namespace ORB_SLAM2
+{
+
+// Bundle adjustment of SE3 poses and 3D points with monocular and stereo reprojection errors.
+// It runs the same Levenberg-Marquardt iterations as g2o with BlockSolver_6_3, EdgeSE3ProjectXYZ,
+// EdgeStereoSE3ProjectXYZ and Huber kernels, but observations are stored as plain arrays, the
+// points are eliminated with an explicit Schur complement and the work over points is split
+// among threads. The reduced camera system is solved with the supernodal Cholesky of g2o.
+//
+// Estimates, Jacobians and the per point blocks use Scalar. With float the linearization and the
+// Schur complement move half the memory and vectorize twice as wide; the reduced camera system,
+// the chi2 sums and the damping are always kept in double.
+// Fixed points are not optimized, so a single free pose with fixed points is a motion-only BA. With
+// a single free pose the 6x6 reduced system is solved with a dense LDLT.
+template<typename Scalar>
+class BundleAdjuster
+{
+public:
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+    typedef Eigen::Matrix<Scalar,3,1> Vector3;
+    typedef Eigen::Matrix<Scalar,3,3> Matrix3;
+    typedef Eigen::Matrix<Scalar,6,1> Vector6;
+    typedef Eigen::Matrix<Scalar,6,6> Matrix6;
+    typedef Eigen::Matrix<Scalar,6,3> Matrix63;
+    typedef Eigen::Matrix<Scalar,Eigen::Dynamic,1> VectorX;
+    typedef Eigen::Quaternion<Scalar> Quaternion;
+    typedef Eigen::Matrix<double,6,6> Matrix6d;
+
+    struct Pose
+    {
+        EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+        Quaternion q;
+        Vector3 t;
+    };
+
+    BundleAdjuster();
+    ~BundleAdjuster();
+
+    int AddPose(const g2o::SE3Quat &Tcw, const bool bFixed);
+    int AddPoint(const Eigen::Vector3d &Pw, const bool bFixed = false);
+
+    // thHuber <= 0 means no robust kernel
+    int AddMonoObservation(const int nPoint, const int nPose, const Eigen::Vector2d &obs, const double invSigma2,
+                           const double fx, const double fy, const double cx, const double cy, const double thHuber);
+    int AddStereoObservation(const int nPoint, const int nPose, const Eigen::Vector3d &obs, const double invSigma2,
+                             const double fx, const double fy, const double cx, const double cy, const double bf,
+                             const double thHuber);
+
+    // Inactive observations are left out of the next optimization (level 1 edges in g2o)
+    void SetActive(const int nObs, const bool bActive);
+    void SetHuberThreshold(const int nObs, const double thHuber);
+
+    void SetPose(const int nPose, const g2o::SE3Quat &Tcw);
+
+    void SetStopFlag(bool* pbStopFlag);
+
+    // Returns the number of iterations done
+    int Optimize(const int nIterations);
+
+    g2o::SE3Quat GetPose(const int nPose) const;
+    Eigen::Vector3d GetPoint(const int nPoint) const;
+
+    // Error of the observations at the current estimate. Inactive observations keep the error
+    // of the last optimization they took part in, unless it is recomputed with ComputeChi2.
+    int NumObservations() const;
+    bool IsStereo(const int nObs) const;
+    double Chi2(const int nObs) const;
+    double ComputeChi2(const int nObs);
+    bool IsDepthPositive(const int nObs) const;
+
+protected:
+
+    void BuildStructure();
+
+    void ComputeRotations(const std::vector<Pose,Eigen::aligned_allocator<Pose> > &vPoses);
+
+    // Updates the errors of the active observations and returns the robust chi2
+    double ComputeErrors(const std::vector<Pose,Eigen::aligned_allocator<Pose> > &vPoses,
+                         const std::vector<Vector3> &vPoints);
+
+    void Linearize();
+
+    // Computes the step for the given damping, returns false if the reduced camera system is not SPD
+    bool ComputeStep(const double lambda);
+
+    // Predicted decrease of the chi2 for the last step
+    double StepScale(const double lambda) const;
+
+    bool Stop() const;
+
+protected:
+
+    // Estimates
+    std::vector<Pose,Eigen::aligned_allocator<Pose> > mvPoses;
+    std::vector<bool> mvbFixedPose;
+    std::vector<Vector3> mvPoints;
+    std::vector<bool> mvbFixedPoint;
+
+    // Observations
+    std::vector<int> mvObsPoint;
+    std::vector<int> mvObsPose;
+    std::vector<Scalar> mvObsU;
+    std::vector<Scalar> mvObsV;
+    std::vector<Scalar> mvObsUr;
+    std::vector<bool> mvbStereo;
+    std::vector<Scalar> mvObsInfo;
+    std::vector<Scalar> mvFx, mvFy, mvCx, mvCy, mvBf;
+    std::vector<Scalar> mvHuber;
+    std::vector<bool> mvbActive;
+    std::vector<double> mvChi2;
+    std::vector<char> mvbDepthPositive;
+
+    bool* mpbStopFlag;
+    int mnThreads;
+
+    // Structure of the active problem. The observations of each point are sorted by pose,
+    // the ones of fixed poses last.
+    std::vector<int> mvPoseIdx;
+    int mnFreePoses;
+    std::vector<char> mvbOptimizedPoint;
+    std::vector<int> mvPointObsBegin;
+    std::vector<int> mvPointObs;
+    std::vector<int> mvPointNumFree;
+    std::vector<int> mvPairBegin;
+    std::vector<int> mvPairSlot;
+    std::vector<int> mvDiagSlot;
+    std::vector<Matrix6d*> mvpSlotBlock;
+
+    // Rotation and translation of the poses being evaluated
+    std::vector<Matrix3> mvRcw;
+    std::vector<Vector3> mvtcw;
+
+    // Linear system
+    std::vector<Matrix63,Eigen::aligned_allocator<Matrix63> > mvW;
+    std::vector<Matrix6,Eigen::aligned_allocator<Matrix6> > mvHpp;
+    Eigen::VectorXd mbp;
+    std::vector<Matrix3> mvHll;
+    std::vector<Matrix3> mvHllInv;
+    std::vector<Vector3> mvbl;
+
+    // Per thread accumulators
+    std::vector<std::vector<Matrix6,Eigen::aligned_allocator<Matrix6> > > mvvThreadHpp;
+    std::vector<std::vector<Matrix6,Eigen::aligned_allocator<Matrix6> > > mvvThreadSlots;
+    std::vector<VectorX> mvThreadb;
+
+    g2o::SparseBlockMatrix<Matrix6d>* mpS;
+    g2o::LinearSolverSupernodal<Matrix6d> mSolver;
+
+    // Reduced system of a single free pose, solved with a dense LDLT instead of mpS
+    bool mbDense;
+    Matrix6d mDenseS;
+    Eigen::VectorXd mrhs;
+
+    // Step and candidate estimate
+    Eigen::VectorXd mxPose;
+    std::vector<Vector3> mvxPoint;
+    std::vector<Pose,Eigen::aligned_allocator<Pose> > mvNewPoses;
+    std::vector<Vector3> mvNewPoints;
+};
+
+} //namespace ORB_SLAM
+
+#endif // BUNDLEADJUSTER_H
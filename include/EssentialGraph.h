@@ -0,0 +1,87 @@
+/**
+* This file is part of ORB-SLAM2.
+*
+* Copyright (C) 2014-2016 Raúl Mur-Artal <raulmur at unizar dot es> (University of Zaragoza)
+* For more information see <https://github.com/raulmur/ORB_SLAM2>
+*
+* ORB-SLAM2 is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM2 is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with ORB-SLAM2. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef ESSENTIALGRAPH_H
+#define ESSENTIALGRAPH_H
+
+#include <map>
+#include <vector>
+#include <mutex>
+
+namespace ORB_SLAM2
+{
+
+class KeyFrame;
+
+// Edges of the essential graph (spanning tree, loop edges and covisibility edges with high weight),
+// updated by the keyframes when their connections change so that the pose graph optimization
+// does not have to query every keyframe of the map.
+class EssentialGraph
+{
+public:
+
+    enum eEdgeType
+    {
+        SPANNING_TREE=1,
+        LOOP=2,
+        COVISIBILITY=4
+    };
+
+    struct Edge
+    {
+        // pKF has a greater id than pKFn
+        KeyFrame* pKF;
+        KeyFrame* pKFn;
+        int nType;
+    };
+
+    EssentialGraph(const int minFeat=100);
+
+    // Weight of pConnected as seen by pKF, 0 if they are no longer connected. As in the
+    // optimization, covisibility edges are taken from the keyframe with the greatest id.
+    void UpdateCovisibility(KeyFrame* pKF, KeyFrame* pConnected, const int weight);
+
+    // pOldParent and pNewParent can be NULL
+    void ChangeParent(KeyFrame* pKF, KeyFrame* pOldParent, KeyFrame* pNewParent);
+
+    void AddLoopEdge(KeyFrame* pKF1, KeyFrame* pKF2);
+
+    std::vector<Edge> GetEdges();
+
+    int GetMinFeat() const;
+
+    void clear();
+
+protected:
+
+    void SetType(KeyFrame* pKF1, KeyFrame* pKF2, const int nType, const bool bSet);
+
+    const int mnMinFeat;
+
+    // Edges by the ids of their keyframes, greatest first
+    std::map<std::pair<long unsigned int,long unsigned int>,Edge> mEdges;
+
+    std::mutex mMutexGraph;
+};
+
+} //namespace ORB_SLAM
+
+#endif // ESSENTIALGRAPH_H
@@ -63,6 +63,7 @@ public:
     void UpdateConnections();
     void UpdateBestCovisibles();
     std::set<KeyFrame *> GetConnectedKeyFrames();
+    std::vector<long unsigned int> GetConnectedKeyFrameIds();
     std::vector<KeyFrame* > GetVectorCovisibleKeyFrames();
     std::vector<KeyFrame*> GetBestCovisibilityKeyFrames(const int &N);
     std::vector<KeyFrame*> GetCovisiblesByWeight(const int &w);
@@ -76,6 +77,11 @@ public:
     KeyFrame* GetParent();
     bool hasChild(KeyFrame* pKF);
 
+    // The first keyframe of a map is the root of its spanning tree, it is fixed
+    // in bundle adjustment and never erased
+    void SetOrigin(const bool bOrigin);
+    bool IsOrigin();
+
     // Loop Edges
     void AddLoopEdge(KeyFrame* pKF);
     std::set<KeyFrame*> GetLoopEdges();
@@ -169,6 +175,8 @@ public:
     //BoW
     DBoW2::BowVector mBowVec;
     DBoW2::FeatureVector mFeatVec;
+    cv::Mat mBowDescriptors;
+    std::vector<DBoW2::WordId> mvBowWords;
 
     // Pose relative to parent (this is computed when bad flag is activated)
     cv::Mat mTcp;
@@ -215,6 +223,7 @@ protected:
 
     // Spanning Tree and Loop Edges
     bool mbFirstConnection;
+    bool mbOrigin;
     KeyFrame* mpParent;
     std::set<KeyFrame*> mspChildrens;
     std::set<KeyFrame*> mspLoopEdges;
@@ -24,6 +24,8 @@
 #include <vector>
 #include <list>
 #include <set>
+#include <map>
+#include <stdint.h>
 
 #include "KeyFrame.h"
 #include "Frame.h"
@@ -59,12 +61,29 @@ public:
 
 protected:
 
+  // Global signature of a BoW vector: sign of a random +-1 projection of the word weights (SimHash).
+  // Similar vectors give signatures with a small Hamming distance.
+  static const int SIGNATURE_WORDS = 4;
+  void ComputeSignature(const DBoW2::BowVector &vBow, uint64_t* pSignature) const;
+
+  // Number of words shared by two BoW vectors
+  static int CommonWords(const DBoW2::BowVector &vBow1, const DBoW2::BowVector &vBow2);
+
   // Associated vocabulary
   const ORBVocabulary* mpVoc;
 
   // Inverted file
   std::vector<list<KeyFrame*> > mvInvertedFile;
 
+  // Signatures of the keyframes in the database, stored contiguously
+  std::vector<uint64_t> mvSignatures;
+  std::vector<KeyFrame*> mvpSignatureKFs;
+  std::map<KeyFrame*,size_t> mmSignatureIndex;
+
+  // With more keyframes than this, loop detection only scores the keyframes
+  // whose signature is closest to the query instead of traversing the inverted file
+  size_t mnLoopPrefilter;
+
   // Mutex
   std::mutex mMutex;
 };
@@ -28,6 +28,7 @@
 #include "KeyFrameDatabase.h"
 
 #include <mutex>
+#include <condition_variable>
 
 
 namespace ORB_SLAM2
@@ -93,6 +94,10 @@ protected:
     bool mbResetRequested;
     std::mutex mMutexReset;
 
+    // Wakes up the thread when a keyframe arrives or a reset is requested, and
+    // acknowledges the reset to the requesting thread
+    std::condition_variable mcvReset;
+
     bool CheckFinish();
     void SetFinish();
     bool mbFinishRequested;
@@ -0,0 +1,163 @@
+/**
+* This file is part of ORB-SLAM2.
+*
+* Copyright (C) 2014-2016 Raúl Mur-Artal <raulmur at unizar dot es> (University of Zaragoza)
+* For more information see <https://github.com/raulmur/ORB_SLAM2>
+*
+* ORB-SLAM2 is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM2 is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with ORB-SLAM2. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <string>
+#include <sstream>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <fstream>
+#include <chrono>
+
+// Messages below this level are removed at compile time: 0 debug, 1 info, 2 warning, 3 error
+#ifndef ORB_SLAM2_LOG_LEVEL
+#define ORB_SLAM2_LOG_LEVEL 1
+#endif
+
+// Usage: ORB_LOG(INFO) << "New map created with " << N << " points";
+// Each statement is one message, no trailing endl is needed. It expands to a single expression,
+// so it is safe inside an unbraced if/else, and the message is not built if the level is off.
+#define ORB_LOG(level) \
+    !(ORB_SLAM2::Logger::LOG_##level >= ORB_SLAM2_LOG_LEVEL && \
+      ORB_SLAM2::Logger::Instance().IsEnabled(ORB_SLAM2::Logger::LOG_##level)) ? (void)0 : \
+    ORB_SLAM2::LogMessageVoidify() & ORB_SLAM2::LogMessage(ORB_SLAM2::Logger::LOG_##level).stream()
+
+namespace ORB_SLAM2
+{
+
+// Asynchronous logger. Each thread writes its messages to its own lock-free ring buffer and a
+// background thread drains all the buffers, writing them to the log file and echoing them to the
+// console. Logging never blocks: if a buffer is full the message is dropped and counted.
+class Logger
+{
+public:
+    enum eLevel{
+        LOG_DEBUG=0,
+        LOG_INFO=1,
+        LOG_WARNING=2,
+        LOG_ERROR=3
+    };
+
+    static Logger& Instance();
+
+    // Write the messages also to the given file (appended)
+    bool Open(const std::string &filename);
+
+    // Messages below the level are discarded at run time
+    void SetLevel(const eLevel level);
+    inline bool IsEnabled(const eLevel level) const {
+        return level>=mnLevel.load(std::memory_order_relaxed);
+    }
+
+    void SetConsole(const bool bConsole);
+
+    void Push(const eLevel level, std::string &msg);
+
+    // Write all pending messages before returning
+    void Flush();
+
+    // Flush and stop the background thread. Called at exit.
+    void Shutdown();
+
+protected:
+
+    struct Record
+    {
+        double mTime;
+        eLevel mLevel;
+        std::string mMsg;
+    };
+
+    // Single producer (the owner thread), single consumer (the flusher) ring buffer
+    struct ThreadBuffer
+    {
+        static const size_t SIZE = 1024;
+
+        ThreadBuffer(): mnHead(0), mnTail(0), mnDropped(0), mvRecords(SIZE){}
+
+        std::atomic<size_t> mnHead;
+        std::atomic<size_t> mnTail;
+        std::atomic<size_t> mnDropped;
+        std::vector<Record> mvRecords;
+    };
+
+    Logger();
+
+    ThreadBuffer* GetThreadBuffer();
+
+    void Run();
+
+    // Drain the buffers and write the messages sorted by time
+    void Drain();
+
+protected:
+
+    std::atomic<int> mnLevel;
+    std::chrono::steady_clock::time_point mStart;
+
+    std::mutex mMutexBuffers;
+    std::vector<std::shared_ptr<ThreadBuffer> > mvpBuffers;
+
+    // Held by the consumer side (flusher thread or Flush)
+    std::mutex mMutexOutput;
+    std::ofstream mFile;
+    bool mbConsole;
+    std::vector<Record> mvBatch;
+
+    std::mutex mMutexFinish;
+    std::condition_variable mcvFlush;
+    bool mbFinish;
+    std::thread* mptFlusher;
+};
+
+// Collects one message and hands it to the logger when destroyed
+class LogMessage
+{
+public:
+    LogMessage(const Logger::eLevel level): mLevel(level){}
+    ~LogMessage();
+
+    inline std::ostream& stream(){
+        return mStream;
+    }
+
+protected:
+    Logger::eLevel mLevel;
+    std::ostringstream mStream;
+};
+
+// Turns the stream of ORB_LOG into void, to match the other branch of its conditional.
+// operator& binds looser than << and tighter than ?:
+class LogMessageVoidify
+{
+public:
+    LogMessageVoidify(){}
+    void operator&(std::ostream&){}
+};
+
+} //namespace ORB_SLAM
+
+#endif // LOGGER_H
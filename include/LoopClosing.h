@@ -31,6 +31,7 @@
 
 #include <thread>
 #include <mutex>
+#include <condition_variable>
 #include "Thirdparty/g2o/g2o/types/types_seven_dof_expmap.h"
 
 namespace ORB_SLAM2
@@ -45,7 +46,8 @@ class LoopClosing
 {
 public:
 
-    typedef pair<set<KeyFrame*>,int> ConsistentGroup;    
+    // Sorted ids of the keyframes of a covisibility group and its consistency counter
+    typedef pair<vector<long unsigned int>,int> ConsistentGroup;
     typedef map<KeyFrame*,g2o::Sim3,std::less<KeyFrame*>,
         Eigen::aligned_allocator<std::pair<const KeyFrame*, g2o::Sim3> > > KeyFrameAndPose;
 
@@ -67,6 +69,9 @@ public:
     // This function will run in a separate thread
     void RunGlobalBundleAdjustment(unsigned long nLoopKF);
 
+    // Stops a running Global BA and waits for its thread
+    void StopGlobalBundleAdjustment();
+
     bool isRunningGBA(){
         unique_lock<std::mutex> lock(mMutexGBA);
         return mbRunningGBA;
@@ -88,16 +93,27 @@ protected:
 
     bool DetectLoop();
 
+    // True if two sorted lists of keyframe ids have some id in common
+    static bool ShareKeyFrame(const std::vector<long unsigned int> &vGroup1, const std::vector<long unsigned int> &vGroup2);
+
     bool ComputeSim3();
 
     void SearchAndFuse(const KeyFrameAndPose &CorrectedPosesMap);
 
     void CorrectLoop();
 
+    // If the loop closes with a map spawned after tracking was lost, its spanning tree is hung
+    // from the matched keyframe and its origin is no longer fixed
+    void MergeMaps();
+
     void ResetIfRequested();
     bool mbResetRequested;
     std::mutex mMutexReset;
 
+    // Wakes up the thread when a keyframe arrives or a reset is requested, and
+    // acknowledges the reset to the requesting thread
+    std::condition_variable mcvReset;
+
     bool CheckFinish();
     void SetFinish();
     bool mbFinishRequested;
@@ -143,7 +159,7 @@ protected:
     bool mbFixScale;
 
 
-    bool mnFullBAIdx;
+    int mnFullBAIdx;
 };
 
 } //namespace ORB_SLAM
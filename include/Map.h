@@ -23,9 +23,12 @@
 
 #include "MapPoint.h"
 #include "KeyFrame.h"
+#include "EssentialGraph.h"
 #include <set>
+#include <vector>
 
 #include <mutex>
+#include <future>
 
 
 
@@ -39,6 +42,7 @@ class Map
 {
 public:
     Map();
+    ~Map();
 
     void AddKeyFrame(KeyFrame* pKF);
     void AddMapPoint(MapPoint* pMP);
@@ -57,10 +61,15 @@ public:
 
     long unsigned int GetMaxKFid();
 
+    // Releases every entity owned by the map in bulk. The map is empty when it returns, the
+    // KeyFrames and MapPoints are destroyed by a background task.
     void clear();
 
     vector<KeyFrame*> mvpKeyFrameOrigins;
 
+    // Kept up to date by the keyframes, used by the pose graph optimization after a loop
+    EssentialGraph mEssentialGraph;
+
     std::mutex mMutexMapUpdate;
 
     // This avoid that two points are created simultaneously in separate threads (id conflict)
@@ -70,6 +79,11 @@ protected:
     std::set<MapPoint*> mspMapPoints;
     std::set<KeyFrame*> mspKeyFrames;
 
+    // Every entity added to the map, including the erased ones, owned until the map is cleared
+    std::vector<MapPoint*> mvpOwnedMapPoints;
+    std::vector<KeyFrame*> mvpOwnedKeyFrames;
+    std::future<void> mRelease;
+
     std::vector<MapPoint*> mvpReferenceMapPoints;
 
     long unsigned int mnMaxKFid;
@@ -27,6 +27,7 @@
 
 #include<opencv2/core/core.hpp>
 #include<mutex>
+#include<atomic>
 
 namespace ORB_SLAM2
 {
@@ -42,6 +43,10 @@ public:
     MapPoint(const cv::Mat &Pos, KeyFrame* pRefKF, Map* pMap);
     MapPoint(const cv::Mat &Pos,  Map* pMap, Frame* pFrame, const int &idxF);
 
+    // Reinitialize a point created from a Frame with a new measurement. Used by the tracking
+    // to recycle its temporal "visual odometry" points, which are never added to the map.
+    void ResetFromFrame(const cv::Mat &Pos, Frame* pFrame, const int &idxF);
+
     void SetWorldPos(const cv::Mat &Pos);
     cv::Mat GetWorldPos();
 
@@ -63,11 +68,12 @@ public:
     void Replace(MapPoint* pMP);    
     MapPoint* GetReplaced();
 
+    // Tracking statistics are relaxed atomics, they do not take mMutexFeatures
     void IncreaseVisible(int n=1);
     void IncreaseFound(int n=1);
     float GetFoundRatio();
     inline int GetFound(){
-        return mnFound;
+        return mnFound.load(std::memory_order_relaxed);
     }
 
     void ComputeDistinctiveDescriptors();
@@ -86,7 +92,9 @@ public:
     static long unsigned int nNextId;
     long int mnFirstKFid;
     long int mnFirstFrame;
-    int nObs;
+
+    // Written with mMutexFeatures locked, read without it
+    std::atomic<int> nObs;
 
     // Variables used by the tracking
     float mTrackProjX;
@@ -130,11 +138,12 @@ protected:
      KeyFrame* mpRefKF;
 
      // Tracking counters
-     int mnVisible;
-     int mnFound;
+     std::atomic<int> mnVisible;
+     std::atomic<int> mnFound;
 
      // Bad flag (we do not currently erase MapPoint from memory)
-     bool mbBad;
+     // Set with mMutexFeatures and mMutexPos locked, read without them
+     std::atomic<bool> mbBad;
      MapPoint* mpReplaced;
 
      // Scale invariance distances
@@ -55,11 +55,24 @@ public:
 
     // Compute the ORB features and descriptors on an image.
     // ORB are dispersed on the image using an octree.
-    // Mask is ignored in the current implementation.
+    // Mask (CV_8UC1, same size as the image) is combined with the static mask, features are
+    // only detected where both are non zero. Leave it empty to use only the static mask.
     void operator()( cv::InputArray image, cv::InputArray mask,
       std::vector<cv::KeyPoint>& keypoints,
       cv::OutputArray descriptors);
 
+    // Two step extraction. DetectKeyPoints keeps the pyramid of the image and returns the keypoints
+    // without orientation. ComputeDescriptors then computes orientation and descriptor only for the
+    // flagged keypoints of the last detected image, the other descriptor rows are left to zero.
+    void DetectKeyPoints(cv::InputArray image, cv::InputArray mask, std::vector<cv::KeyPoint>& keypoints);
+    void ComputeDescriptors(std::vector<cv::KeyPoint>& keypoints, const std::vector<bool> &vbCompute,
+                            cv::Mat &descriptors);
+
+    // Static region of interest applied to every image (CV_8UC1, non zero where features are
+    // wanted). An empty mask detects on the whole image. If the image size is given the mask must
+    // match it, otherwise it is checked against the first image. An invalid mask is rejected.
+    bool SetMask(const cv::Mat &mask, const cv::Size &imageSize = cv::Size());
+
     int inline GetLevels(){
         return nlevels;}
 
@@ -87,7 +100,8 @@ public:
 protected:
 
     void ComputePyramid(cv::Mat image);
-    void ComputeKeyPointsOctTree(std::vector<std::vector<cv::KeyPoint> >& allKeypoints);    
+    void ComputeMaskPyramid(const cv::Mat &mask);
+    void ComputeKeyPointsOctTree(std::vector<std::vector<cv::KeyPoint> >& allKeypoints, const bool bOrientation = true);
     std::vector<cv::KeyPoint> DistributeOctTree(const std::vector<cv::KeyPoint>& vToDistributeKeys, const int &minX,
                                            const int &maxX, const int &minY, const int &maxY, const int &nFeatures, const int &level);
 
@@ -108,6 +122,13 @@ protected:
     std::vector<float> mvInvScaleFactor;    
     std::vector<float> mvLevelSigma2;
     std::vector<float> mvInvLevelSigma2;
+
+    // Static mask and the mask of the current image at each level (empty if there is no mask)
+    cv::Mat mMask;
+    std::vector<cv::Mat> mvMaskPyramid;
+
+    // An invalid mask of the current image is only reported once
+    bool mbFrameMaskWarned;
 };
 
 } //namespace ORB_SLAM
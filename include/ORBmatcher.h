@@ -23,6 +23,7 @@
 #define ORBMATCHER_H
 
 #include<vector>
+#include<stdint.h>
 #include<opencv2/core/core.hpp>
 #include<opencv2/features2d/features2d.hpp>
 
@@ -43,6 +44,17 @@ public:
     // Computes the Hamming distance between two ORB descriptors
     static int DescriptorDistance(const cv::Mat &a, const cv::Mat &b);
 
+    // Same distance for descriptors stored as four 64-bit words
+    static inline int DescriptorDistance(const uint64_t* a, const uint64_t* b)
+    {
+        return __builtin_popcountll(a[0]^b[0]) + __builtin_popcountll(a[1]^b[1]) +
+               __builtin_popcountll(a[2]^b[2]) + __builtin_popcountll(a[3]^b[3]);
+    }
+
+    // Copies the descriptors in the order of the features of the feature vector, so that the
+    // descriptors of each vocabulary node are contiguous. Used by SearchByBoW.
+    static cv::Mat PackBowDescriptors(const DBoW2::FeatureVector &featVec, const cv::Mat &descriptors);
+
     // Search matches between Frame keypoints and projected MapPoints. Returns number of matches
     // Used to track the local map (Tracking)
     int SearchByProjection(Frame &F, const std::vector<MapPoint*> &vpMapPoints, const float th=3);
@@ -66,7 +78,9 @@ public:
     int SearchByBoW(KeyFrame *pKF1, KeyFrame* pKF2, std::vector<MapPoint*> &vpMatches12);
 
     // Matching for the Map Initialization (only used in the monocular case)
-    int SearchForInitialization(Frame &F1, Frame &F2, std::vector<cv::Point2f> &vbPrevMatched, std::vector<int> &vnMatches12, int windowSize=10);
+    // Keypoints of F1 matched on input (vnMatches12 from the previous frame) are searched in windowSizeTracked
+    // around their last match, the others in windowSize. A negative windowSizeTracked uses windowSize for all.
+    int SearchForInitialization(Frame &F1, Frame &F2, std::vector<cv::Point2f> &vbPrevMatched, std::vector<int> &vnMatches12, int windowSize=10, int windowSizeTracked=-1);
 
     // Matching to triangulate new MapPoints. Check Epipolar Constraint.
     int SearchForTriangulation(KeyFrame *pKF1, KeyFrame* pKF2, cv::Mat F12,
@@ -24,6 +24,9 @@
 
 #include <string>
 #include <thread>
+#include <memory>
+#include <future>
+#include <list>
 #include <opencv2/core/core.hpp>
 
 #include "Tracking.h"
@@ -51,6 +54,16 @@ class Tracking;
 class LocalMapping;
 class LoopClosing;
 
+// Result of a processed frame. Snapshots are immutable and shared: System publishes a new one after
+// each Track* call and consumers keep the one they got alive for as long as they need it.
+struct TrackedFrame
+{
+    int mState;
+    std::vector<MapPoint*> mvpMapPoints;
+    std::vector<cv::KeyPoint> mvKeysUn;
+    std::shared_ptr<const std::vector<Tree> > mpvTrees;
+};
+
 class System
 {
 public:
@@ -76,21 +89,34 @@ public:
 
     // Proccess the given stereo frame. Images must be synchronized and rectified.
     // Input images: RGB (CV_8UC3) or grayscale (CV_8U). RGB is converted to grayscale.
+    // Optional mask (CV_8U): features are only detected on both images where it is non zero.
     // Returns the camera pose (empty if tracking fails).
-    cv::Mat TrackStereo(const cv::Mat &imLeft, const cv::Mat &imRight, const double &timestamp);
+    cv::Mat TrackStereo(const cv::Mat &imLeft, const cv::Mat &imRight, const double &timestamp, const cv::Mat &mask = cv::Mat());
 
     // Process the given rgbd frame. Depthmap must be registered to the RGB frame.
     // Input image: RGB (CV_8UC3) or grayscale (CV_8U). RGB is converted to grayscale.
     // Input depthmap: Float (CV_32F).
+    // Optional mask (CV_8U): features are only detected where it is non zero.
     // Returns the camera pose (empty if tracking fails).
-    cv::Mat TrackRGBD(const cv::Mat &im, const cv::Mat &depthmap, const double &timestamp);
+    cv::Mat TrackRGBD(const cv::Mat &im, const cv::Mat &depthmap, const double &timestamp, const cv::Mat &mask = cv::Mat());
 
     cv::Mat TrackRGBDTrees(const cv::Mat &im, const cv::Mat &depthmap, const double &timestamp, std::vector<Tree> trees);
 
     // Proccess the given monocular frame
     // Input images: RGB (CV_8UC3) or grayscale (CV_8U). RGB is converted to grayscale.
+    // Optional mask (CV_8U): features are only detected where it is non zero.
     // Returns the camera pose (empty if tracking fails).
-    cv::Mat TrackMonocular(const cv::Mat &im, const double &timestamp);
+    cv::Mat TrackMonocular(const cv::Mat &im, const double &timestamp, const cv::Mat &mask = cv::Mat());
+
+    // The vocabulary is loaded in the background while the rest of the system starts, frames can be
+    // fed right away. Monocular frames are used for the initialization, which waits for the vocabulary
+    // only to create the initial map. Stereo and RGB-D frames are buffered (the last MAX_PENDING_FRAMES)
+    // and tracked once the system is ready; meanwhile the returned pose is empty.
+    bool IsReady();
+    std::shared_future<bool> GetReadyFuture();
+
+    // Blocks until the vocabulary is loaded, exits if it could not be loaded
+    void WaitUntilReady();
 
     // This stops local mapping thread (map building) and performs only camera tracking.
     void ActivateLocalizationMode();
@@ -133,9 +159,11 @@ public:
 
     // Information from most recent processed frame
     // You can call this right after TrackMonocular (or stereo or RGBD)
+    // The vectors are copied from the snapshot on each call, GetTrackedFrame shares it without copies.
     int GetTrackingState();
     std::vector<MapPoint*> GetTrackedMapPoints();
     std::vector<cv::KeyPoint> GetTrackedKeyPointsUn();
+    std::shared_ptr<const TrackedFrame> GetTrackedFrame();
 
     shared_ptr<PointCloudMapping> GetPointCloudMapping();
 
@@ -152,6 +180,15 @@ public:
     bool isDetected;
     bool startDetect;
 
+private:
+
+    // Publish the result of the frame just tracked, in constant time
+    void PublishTrackedFrame(std::vector<Tree>* pvTrees = NULL);
+
+    bool LoadVocabulary(const string &strVocFile);
+
+    void BufferFrame(const cv::Mat &im1, const cv::Mat &im2, const double &timestamp, const cv::Mat &mask);
+
 private:
 
     // Input sensor
@@ -204,13 +241,22 @@ private:
     bool mbActivateLocalizationMode;
     bool mbDeactivateLocalizationMode;
 
-    // Tracking state
-    int mTrackingState;
-    std::vector<MapPoint*> mTrackedMapPoints;
-    std::vector<cv::KeyPoint> mTrackedKeyPointsUn;
-    std::mutex mMutexState;
+    // Startup
+    static const size_t MAX_PENDING_FRAMES = 10;
+    std::shared_future<bool> mReady;
 
-    std::vector<Tree> treeDB;
+    struct PendingFrame
+    {
+        cv::Mat mIm1;
+        cv::Mat mIm2;
+        double mTimestamp;
+        cv::Mat mMask;
+    };
+    std::list<PendingFrame> mlPendingFrames;
+
+    // Tracking state. The snapshot is swapped with atomic_store/atomic_load.
+    std::shared_ptr<const TrackedFrame> mpTrackedFrame;
+    std::mutex mMutexState;
 
     cv::Mat pose;
 
@@ -62,9 +62,15 @@ public:
              KeyFrameDatabase* pKFDB, const string &strSettingPath, const int sensor);
 
     // Preprocess the input and call Track(). Extract features and performs stereo matching.
-    cv::Mat GrabImageStereo(const cv::Mat &imRectLeft,const cv::Mat &imRectRight, const double &timestamp);
-    cv::Mat GrabImageRGBD(const cv::Mat &imRGB,const cv::Mat &imD, const double &timestamp);
-    cv::Mat GrabImageMonocular(const cv::Mat &im, const double &timestamp);
+    // Features are only extracted where the mask and the static mask of the settings are non zero.
+    cv::Mat GrabImageStereo(const cv::Mat &imRectLeft,const cv::Mat &imRectRight, const double &timestamp, const cv::Mat &mask = cv::Mat());
+    cv::Mat GrabImageRGBD(const cv::Mat &imRGB,const cv::Mat &imD, const double &timestamp, const cv::Mat &mask = cv::Mat());
+    cv::Mat GrabImageMonocular(const cv::Mat &im, const double &timestamp, const cv::Mat &mask = cv::Mat());
+
+    // Moves out the MapPoint matches and undistorted keypoints of the frame just tracked, without
+    // copying them. The current frame is then left empty (N=0) until the next GrabImage*, the
+    // last frame keeps its own copy for tracking.
+    void ReleaseCurrentFrame(std::vector<MapPoint*> &vpMapPoints, std::vector<cv::KeyPoint> &vKeysUn);
 
     void SetLocalMapper(LocalMapping* pLocalMapper);
     void SetLoopClosing(LoopClosing* pLoopClosing);
@@ -109,6 +115,13 @@ public:
     std::vector<cv::Point3f> mvIniP3D;
     Frame mInitialFrame;
 
+    // Median motion of the initialization matches in the last frame (pixels), it sets the
+    // search window of the reference keypoints that are being tracked
+    float mfIniFlow;
+
+    // Consecutive frames in which the displacement gate skipped the H/F model selection
+    int mnIniGatedFrames;
+
     // Lists used to recover the full camera trajectory at the end of the execution.
     // Basically we store the reference keyframe for each frame and its relative transformation
     list<cv::Mat> mlRelativeFramePoses;
@@ -139,6 +152,19 @@ protected:
     bool TrackWithMotionModel();
 
     bool Relocalization();
+    void ScheduleRelocalization(const int nBestMatches);
+
+    // Starts a new map when tracking is lost, the previous one is kept and merged by the loop closing
+    void SpawnMap();
+
+    // When the camera stands still the last frame is reused, skipping extraction, tracking and mapping
+    bool CheckStationary(const cv::Mat &imGray);
+    void TrackStationary(const double &timestamp);
+
+    // High resolution input: features are detected on images reduced by mfDownscale and the
+    // keypoints matched to MapPoints are refined on the full resolution image
+    cv::Mat Downscale(const cv::Mat &im, const int interpolation) const;
+    void RefineKeyPoints();
 
     void UpdateLocalMap();
     void UpdateLocalPoints();
@@ -175,6 +201,9 @@ protected:
     KeyFrame* mpReferenceKF;
     std::vector<KeyFrame*> mvpLocalKeyFrames;
     std::vector<MapPoint*> mvpLocalMapPoints;
+
+    // MapPoints in view of the current frame, their visibility counters are updated in one pass
+    std::vector<MapPoint*> mvpVisibleMapPoints;
     
     // System
     System* mpSystem;
@@ -215,13 +244,36 @@ protected:
     unsigned int mnLastKeyFrameId;
     unsigned int mnLastRelocFrameId;
 
+    // Relocalization backoff. While lost, attempts are spaced mnRelocInterval frames apart
+    // (at most mnRelocMaxInterval), growing while the candidates are poor.
+    int mnRelocInterval;
+    int mnRelocMaxInterval;
+    unsigned long mnNextRelocFrameId;
+
+    // Start a new map instead of resetting when tracking is lost
+    bool mbSpawnMapOnLoss;
+
+    // Stationary camera detection. mStaticThumb is a thumbnail of the last tracked image, the camera
+    // is idle after mnStaticMinFrames frames differing less than mfStaticDiffTh (mean gray level)
+    cv::Mat mStaticThumb;
+    float mfStaticDiffTh;
+    int mnStaticMinFrames;
+    int mnStaticFrames;
+
+    // Detection resolution, the calibration refers to the downscaled images (1 if not downscaled)
+    float mfDownscale;
+    cv::Mat mImGrayFull;
+
     //Motion Model
     cv::Mat mVelocity;
 
     //Color order (true RGB, false BGR, ignored if grayscale)
     bool mbRGB;
 
-    list<MapPoint*> mlpTemporalPoints;
+    // Temporal "visual odometry" MapPoints. They are allocated once and recycled,
+    // only the first mnTemporalPoints are in use by the last frame.
+    vector<MapPoint*> mvpTemporalPoints;
+    size_t mnTemporalPoints;
 
 	
 };
@@ -29,6 +29,7 @@
 #include "Tree.h"
 
 #include <mutex>
+#include <condition_variable>
 
 namespace ORB_SLAM2
 {
@@ -56,6 +57,9 @@ public:
 
     bool isStopped();
 
+    // Blocks until the viewer has stopped (or finished) after RequestStop
+    void WaitUntilStopped();
+
     void Release();
 
     float cameraRotationAngle(float theta, cv::Mat currentPose);
@@ -111,6 +115,7 @@ private:
     bool mbStopped;
     bool mbStopRequested;
     std::mutex mMutexStop;
+    std::condition_variable mcvStop;
 
     vector<float> thetaList;
 
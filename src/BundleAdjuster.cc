@@ -0,0 +1,820 @@
+/**
+* This file is part of ORB-SLAM2.
+*
+* Copyright (C) 2014-2016 Raúl Mur-Artal <raulmur at unizar dot es> (University of Zaragoza)
+* For more information see <https://github.com/raulmur/ORB_SLAM2>
+*
+* ORB-SLAM2 is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM2 is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with ORB-SLAM2. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "BundleAdjuster.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <thread>
+
+#include <Eigen/Cholesky>
+
+using namespace std;
+
+namespace ORB_SLAM2
+{
+
+namespace
+{
+
+// Calls f(begin,end,thread) on nThreads contiguous chunks of [0,n)
+template<class Function>
+void ParallelFor(const int n, const int nThreads, const Function &f)
+{
+    if(nThreads<=1)
+    {
+        f(0,n,0);
+        return;
+    }
+
+    const int chunk = (n+nThreads-1)/nThreads;
+    vector<thread> vThreads;
+    vThreads.reserve(nThreads-1);
+    for(int t=1; t<nThreads; t++)
+        vThreads.push_back(thread(f,min(n,t*chunk),min(n,(t+1)*chunk),t));
+    f(0,min(n,chunk),0);
+    for(size_t t=0; t<vThreads.size(); t++)
+        vThreads[t].join();
+}
+
+// Huber kernel as g2o::RobustKernelHuber: rho(chi2) and rho'(chi2)
+template<typename Scalar>
+inline void Robustify(const Scalar chi2, const Scalar delta, Scalar &rho0, Scalar &rho1)
+{
+    if(delta<=0 || chi2<=delta*delta)
+    {
+        rho0 = chi2;
+        rho1 = 1;
+    }
+    else
+    {
+        const Scalar e = sqrt(chi2);
+        rho0 = 2*e*delta-delta*delta;
+        rho1 = delta/e;
+    }
+}
+
+// Jacobians of the monocular error w.r.t. the point and the pose (g2o::EdgeSE3ProjectXYZ)
+template<typename Scalar>
+inline void MonoJacobians(const Eigen::Matrix<Scalar,3,3> &R, const Eigen::Matrix<Scalar,3,1> &Xc,
+                          const Scalar fx, const Scalar fy,
+                          Eigen::Matrix<Scalar,2,3> &Jp, Eigen::Matrix<Scalar,2,6> &Jc)
+{
+    const Scalar x = Xc[0];
+    const Scalar y = Xc[1];
+    const Scalar invz = Scalar(1)/Xc[2];
+    const Scalar invz2 = invz*invz;
+
+    Eigen::Matrix<Scalar,2,3> tmp;
+    tmp << fx, 0, -x*invz*fx,
+           0, fy, -y*invz*fy;
+    Jp = -invz*tmp*R;
+
+    Jc << x*y*invz2*fx, -(1+x*x*invz2)*fx, y*invz*fx, -invz*fx, 0, x*invz2*fx,
+          (1+y*y*invz2)*fy, -x*y*invz2*fy, -x*invz*fy, 0, -invz*fy, y*invz2*fy;
+}
+
+// Jacobians of the stereo error w.r.t. the point and the pose (g2o::EdgeStereoSE3ProjectXYZ)
+template<typename Scalar>
+inline void StereoJacobians(const Eigen::Matrix<Scalar,3,3> &R, const Eigen::Matrix<Scalar,3,1> &Xc,
+                            const Scalar fx, const Scalar fy, const Scalar bf,
+                            Eigen::Matrix<Scalar,3,3> &Jp, Eigen::Matrix<Scalar,3,6> &Jc)
+{
+    Eigen::Matrix<Scalar,2,3> Jp2;
+    Eigen::Matrix<Scalar,2,6> Jc2;
+    MonoJacobians<Scalar>(R,Xc,fx,fy,Jp2,Jc2);
+
+    const Scalar x = Xc[0];
+    const Scalar y = Xc[1];
+    const Scalar invz2 = Scalar(1)/(Xc[2]*Xc[2]);
+
+    Jp.template topRows<2>() = Jp2;
+    Jp.row(2) = Jp2.row(0)-bf*invz2*R.row(2);
+
+    Jc.template topRows<2>() = Jc2;
+    Jc.row(2) = Jc2.row(0);
+    Jc(2,0) -= bf*y*invz2;
+    Jc(2,1) += bf*x*invz2;
+    Jc(2,4) = 0;
+    Jc(2,5) -= bf*invz2;
+}
+
+// Adds the weighted normal equations of one observation. Hll, bl and W are skipped for fixed points.
+template<typename Scalar, int D>
+inline void Accumulate(const Eigen::Matrix<Scalar,D,3> &Jp, const Eigen::Matrix<Scalar,D,6> &Jc,
+                       const Eigen::Matrix<Scalar,D,1> &e, const Scalar w, const bool bFreePoint, const bool bFreePose,
+                       Eigen::Matrix<Scalar,3,3> &Hll, Eigen::Matrix<Scalar,3,1> &bl, Eigen::Matrix<Scalar,6,6> &Hpp,
+                       Scalar* bp, Eigen::Matrix<Scalar,6,3> &W)
+{
+    if(bFreePoint)
+    {
+        Hll.noalias() += w*Jp.transpose()*Jp;
+        bl.noalias() -= w*Jp.transpose()*e;
+    }
+    if(bFreePose)
+    {
+        Hpp.noalias() += w*Jc.transpose()*Jc;
+        Eigen::Map<Eigen::Matrix<Scalar,6,1> >(bp).noalias() -= w*Jc.transpose()*e;
+        if(bFreePoint)
+            W.noalias() = w*Jc.transpose()*Jp;
+    }
+}
+
+// exp(update)*T as g2o::SE3Quat::exp and g2o::SE3Quat::operator*
+template<typename Pose, typename Scalar>
+inline Pose UpdatePose(const Eigen::Matrix<Scalar,6,1> &update, const Pose &T)
+{
+    typedef Eigen::Matrix<Scalar,3,3> Matrix3;
+    typedef Eigen::Matrix<Scalar,3,1> Vector3;
+
+    const Vector3 omega = update.template head<3>();
+    const Vector3 upsilon = update.template tail<3>();
+
+    const Scalar theta = omega.norm();
+    Matrix3 Omega;
+    Omega << 0, -omega[2], omega[1],
+             omega[2], 0, -omega[0],
+             -omega[1], omega[0], 0;
+
+    Matrix3 R;
+    Matrix3 V;
+    if(theta<Scalar(0.00001))
+    {
+        R = Matrix3::Identity()+Omega+Omega*Omega;
+        V = R;
+    }
+    else
+    {
+        const Matrix3 Omega2 = Omega*Omega;
+        const Scalar theta2 = theta*theta;
+        R = Matrix3::Identity()+sin(theta)/theta*Omega+(1-cos(theta))/theta2*Omega2;
+        V = Matrix3::Identity()+(1-cos(theta))/theta2*Omega+(theta-sin(theta))/(theta2*theta)*Omega2;
+    }
+
+    Pose result;
+    const Eigen::Quaternion<Scalar> q(R);
+    result.q = (q*T.q).normalized();
+    result.t = q*T.t+V*upsilon;
+    return result;
+}
+
+} // namespace
+
+template<typename Scalar>
+BundleAdjuster<Scalar>::BundleAdjuster(): mpbStopFlag(NULL), mnThreads(1), mnFreePoses(0), mpS(NULL), mbDense(false)
+{
+}
+
+template<typename Scalar>
+BundleAdjuster<Scalar>::~BundleAdjuster()
+{
+    delete mpS;
+}
+
+template<typename Scalar>
+int BundleAdjuster<Scalar>::AddPose(const g2o::SE3Quat &Tcw, const bool bFixed)
+{
+    mvPoses.push_back(Pose());
+    mvbFixedPose.push_back(bFixed);
+    SetPose(mvPoses.size()-1,Tcw);
+    return mvPoses.size()-1;
+}
+
+template<typename Scalar>
+void BundleAdjuster<Scalar>::SetPose(const int nPose, const g2o::SE3Quat &Tcw)
+{
+    mvPoses[nPose].q = Tcw.rotation().template cast<Scalar>();
+    mvPoses[nPose].t = Tcw.translation().template cast<Scalar>();
+}
+
+template<typename Scalar>
+int BundleAdjuster<Scalar>::AddPoint(const Eigen::Vector3d &Pw, const bool bFixed)
+{
+    mvPoints.push_back(Pw.cast<Scalar>());
+    mvbFixedPoint.push_back(bFixed);
+    return mvPoints.size()-1;
+}
+
+template<typename Scalar>
+int BundleAdjuster<Scalar>::AddMonoObservation(const int nPoint, const int nPose, const Eigen::Vector2d &obs,
+                                               const double invSigma2, const double fx, const double fy,
+                                               const double cx, const double cy, const double thHuber)
+{
+    const int idx = AddStereoObservation(nPoint,nPose,Eigen::Vector3d(obs[0],obs[1],0),invSigma2,fx,fy,cx,cy,0,thHuber);
+    mvbStereo[idx] = false;
+    return idx;
+}
+
+template<typename Scalar>
+int BundleAdjuster<Scalar>::AddStereoObservation(const int nPoint, const int nPose, const Eigen::Vector3d &obs,
+                                                 const double invSigma2, const double fx, const double fy,
+                                                 const double cx, const double cy, const double bf,
+                                                 const double thHuber)
+{
+    mvObsPoint.push_back(nPoint);
+    mvObsPose.push_back(nPose);
+    mvObsU.push_back(obs[0]);
+    mvObsV.push_back(obs[1]);
+    mvObsUr.push_back(obs[2]);
+    mvbStereo.push_back(true);
+    mvObsInfo.push_back(invSigma2);
+    mvFx.push_back(fx);
+    mvFy.push_back(fy);
+    mvCx.push_back(cx);
+    mvCy.push_back(cy);
+    mvBf.push_back(bf);
+    mvHuber.push_back(thHuber);
+    mvbActive.push_back(true);
+    mvChi2.push_back(0);
+    mvbDepthPositive.push_back(true);
+    return mvObsPoint.size()-1;
+}
+
+template<typename Scalar>
+void BundleAdjuster<Scalar>::SetActive(const int nObs, const bool bActive)
+{
+    mvbActive[nObs] = bActive;
+}
+
+template<typename Scalar>
+void BundleAdjuster<Scalar>::SetHuberThreshold(const int nObs, const double thHuber)
+{
+    mvHuber[nObs] = thHuber;
+}
+
+template<typename Scalar>
+void BundleAdjuster<Scalar>::SetStopFlag(bool* pbStopFlag)
+{
+    mpbStopFlag = pbStopFlag;
+}
+
+template<typename Scalar>
+g2o::SE3Quat BundleAdjuster<Scalar>::GetPose(const int nPose) const
+{
+    return g2o::SE3Quat(mvPoses[nPose].q.template cast<double>(),mvPoses[nPose].t.template cast<double>());
+}
+
+template<typename Scalar>
+Eigen::Vector3d BundleAdjuster<Scalar>::GetPoint(const int nPoint) const
+{
+    return mvPoints[nPoint].template cast<double>();
+}
+
+template<typename Scalar>
+int BundleAdjuster<Scalar>::NumObservations() const
+{
+    return mvObsPoint.size();
+}
+
+template<typename Scalar>
+bool BundleAdjuster<Scalar>::IsStereo(const int nObs) const
+{
+    return mvbStereo[nObs];
+}
+
+template<typename Scalar>
+double BundleAdjuster<Scalar>::Chi2(const int nObs) const
+{
+    return mvChi2[nObs];
+}
+
+template<typename Scalar>
+double BundleAdjuster<Scalar>::ComputeChi2(const int nObs)
+{
+    const Pose &T = mvPoses[mvObsPose[nObs]];
+    const Vector3 Xc = T.q*mvPoints[mvObsPoint[nObs]]+T.t;
+    const Scalar invz = Scalar(1)/Xc[2];
+    const Scalar u = mvFx[nObs]*Xc[0]*invz+mvCx[nObs];
+    const Scalar v = mvFy[nObs]*Xc[1]*invz+mvCy[nObs];
+    const Scalar eu = mvObsU[nObs]-u;
+    const Scalar ev = mvObsV[nObs]-v;
+    Scalar e2 = eu*eu+ev*ev;
+    if(mvbStereo[nObs])
+    {
+        const Scalar eur = mvObsUr[nObs]-(u-mvBf[nObs]*invz);
+        e2 += eur*eur;
+    }
+    mvChi2[nObs] = mvObsInfo[nObs]*e2;
+    mvbDepthPositive[nObs] = Xc[2]>0;
+    return mvChi2[nObs];
+}
+
+template<typename Scalar>
+bool BundleAdjuster<Scalar>::IsDepthPositive(const int nObs) const
+{
+    return mvbDepthPositive[nObs];
+}
+
+template<typename Scalar>
+bool BundleAdjuster<Scalar>::Stop() const
+{
+    return mpbStopFlag && *mpbStopFlag;
+}
+
+template<typename Scalar>
+void BundleAdjuster<Scalar>::BuildStructure()
+{
+    typedef g2o::SparseBlockMatrix<Matrix6d> SparseMatrix;
+
+    const int nPoses = mvPoses.size();
+    const int nPoints = mvPoints.size();
+    const int nObs = mvObsPoint.size();
+
+    // Poses which are optimized: not fixed and with some active observation
+    vector<bool> vbObserved(nPoses,false);
+    mvPointObsBegin.assign(nPoints+1,0);
+    for(int i=0; i<nObs; i++)
+    {
+        if(!mvbActive[i])
+            continue;
+        vbObserved[mvObsPose[i]] = true;
+        mvPointObsBegin[mvObsPoint[i]+1]++;
+    }
+
+    mvPoseIdx.assign(nPoses,-1);
+    mnFreePoses = 0;
+    for(int i=0; i<nPoses; i++)
+        if(vbObserved[i] && !mvbFixedPose[i])
+            mvPoseIdx[i] = mnFreePoses++;
+
+    // Observations grouped by point
+    int nOptimizedPoints = 0;
+    mvbOptimizedPoint.resize(nPoints);
+    for(int i=0; i<nPoints; i++)
+    {
+        mvbOptimizedPoint[i] = !mvbFixedPoint[i] && mvPointObsBegin[i+1]>0;
+        if(mvbOptimizedPoint[i])
+            nOptimizedPoints++;
+        mvPointObsBegin[i+1] += mvPointObsBegin[i];
+    }
+    mvPointObs.resize(mvPointObsBegin[nPoints]);
+    vector<int> vNext(mvPointObsBegin.begin(),mvPointObsBegin.end()-1);
+    for(int i=0; i<nObs; i++)
+        if(mvbActive[i])
+            mvPointObs[vNext[mvObsPoint[i]]++] = i;
+
+    mvPointNumFree.assign(nPoints,0);
+    mvPairBegin.assign(nPoints+1,0);
+    vector<pair<int,int> > vKeys;
+    for(int i=0; i<nPoints; i++)
+    {
+        vKeys.clear();
+        for(int j=mvPointObsBegin[i]; j<mvPointObsBegin[i+1]; j++)
+        {
+            const int idx = mvPoseIdx[mvObsPose[mvPointObs[j]]];
+            vKeys.push_back(make_pair(idx<0 ? numeric_limits<int>::max() : idx, mvPointObs[j]));
+            if(idx>=0)
+                mvPointNumFree[i]++;
+        }
+        sort(vKeys.begin(),vKeys.end());
+        for(size_t j=0; j<vKeys.size(); j++)
+            mvPointObs[mvPointObsBegin[i]+j] = vKeys[j].second;
+
+        // A fixed point does not couple the poses that observe it
+        const int nFree = mvbOptimizedPoint[i] ? mvPointNumFree[i] : 0;
+        mvPairBegin[i+1] = mvPairBegin[i]+nFree*(nFree+1)/2;
+    }
+
+    delete mpS;
+    mpS = NULL;
+    mvpSlotBlock.clear();
+    mvDiagSlot.resize(mnFreePoses);
+    vector<int> vColumnSlot(mnFreePoses);
+
+    // A single free pose (motion-only BA) has a 6x6 reduced system, it is solved densely
+    // without the sparse pattern and the symbolic analysis
+    mbDense = mnFreePoses==1;
+    if(mbDense)
+    {
+        mvpSlotBlock.push_back(&mDenseS);
+        mvDiagSlot[0] = 0;
+        vColumnSlot[0] = 0;
+    }
+    else if(mnFreePoses>0)
+    {
+        // Pattern of the reduced camera system, upper triangle
+        vector<vector<int> > vBlockRows(mnFreePoses);
+        for(int c=0; c<mnFreePoses; c++)
+            vBlockRows[c].push_back(c);
+        for(int i=0; i<nPoints; i++)
+        {
+            if(!mvbOptimizedPoint[i])
+                continue;
+            const int* pObs = mvPointObs.data()+mvPointObsBegin[i];
+            for(int j=0; j<mvPointNumFree[i]; j++)
+            {
+                const int cj = mvPoseIdx[mvObsPose[pObs[j]]];
+                for(int k=0; k<j; k++)
+                    vBlockRows[cj].push_back(mvPoseIdx[mvObsPose[pObs[k]]]);
+            }
+        }
+
+        vector<int> vBlockIndices(mnFreePoses);
+        for(int i=0; i<mnFreePoses; i++)
+            vBlockIndices[i] = 6*(i+1);
+        mpS = new SparseMatrix(&vBlockIndices[0],&vBlockIndices[0],mnFreePoses,mnFreePoses);
+
+        mpS->setPattern(vBlockRows);
+        for(int c=0; c<mnFreePoses; c++)
+        {
+            const typename SparseMatrix::SparseColumn &column = mpS->blockCols()[c];
+            vColumnSlot[c] = mvpSlotBlock.size();
+            for(typename SparseMatrix::SparseColumn::const_iterator it=column.begin(); it!=column.end(); it++)
+                mvpSlotBlock.push_back(it->second);
+            mvDiagSlot[c] = mvpSlotBlock.size()-1;
+        }
+    }
+
+    mvPairSlot.resize(mvPairBegin[nPoints]);
+    for(int i=0; i<nPoints; i++)
+    {
+        if(!mvbOptimizedPoint[i])
+            continue;
+        const int* pObs = mvPointObs.data()+mvPointObsBegin[i];
+        int nPair = mvPairBegin[i];
+        for(int j=0; j<mvPointNumFree[i]; j++)
+        {
+            const int cj = mvPoseIdx[mvObsPose[pObs[j]]];
+            for(int k=j; k<mvPointNumFree[i]; k++)
+            {
+                if(mbDense)
+                {
+                    mvPairSlot[nPair++] = 0;
+                    continue;
+                }
+                const int ck = mvPoseIdx[mvObsPose[pObs[k]]];
+                const typename SparseMatrix::SparseColumn &column = mpS->blockCols()[ck];
+                mvPairSlot[nPair++] = vColumnSlot[ck]+(column.lower_bound(cj)-column.begin());
+            }
+        }
+    }
+    if(mpS)
+        mSolver.init();
+
+    // Split the points among threads only if there is enough work for them. The number of
+    // cores is queried once, it reads sysfs and would be paid in every optimization.
+    static const int nHardware = max(1,(int)thread::hardware_concurrency());
+    mnThreads = max(1,min(nHardware,nOptimizedPoints/256));
+
+    mvW.resize(nObs);
+    mvHpp.resize(mnFreePoses);
+    mvHll.resize(nPoints);
+    mvHllInv.resize(nPoints);
+    mvbl.resize(nPoints);
+    mvxPoint.resize(nPoints);
+    mvvThreadHpp.resize(mnThreads);
+    mvvThreadSlots.resize(mnThreads);
+    mvThreadb.resize(mnThreads);
+    for(int t=0; t<mnThreads; t++)
+    {
+        mvvThreadHpp[t].resize(mnFreePoses);
+        mvvThreadSlots[t].resize(mvpSlotBlock.size());
+        mvThreadb[t].resize(6*mnFreePoses);
+    }
+}
+
+template<typename Scalar>
+void BundleAdjuster<Scalar>::ComputeRotations(const vector<Pose,Eigen::aligned_allocator<Pose> > &vPoses)
+{
+    mvRcw.resize(vPoses.size());
+    mvtcw.resize(vPoses.size());
+    for(size_t i=0; i<vPoses.size(); i++)
+    {
+        mvRcw[i] = vPoses[i].q.toRotationMatrix();
+        mvtcw[i] = vPoses[i].t;
+    }
+}
+
+template<typename Scalar>
+double BundleAdjuster<Scalar>::ComputeErrors(const vector<Pose,Eigen::aligned_allocator<Pose> > &vPoses,
+                                             const vector<Vector3> &vPoints)
+{
+    ComputeRotations(vPoses);
+
+    vector<double> vThreadChi2(mnThreads,0);
+    ParallelFor(mvPoints.size(),mnThreads,[&](int begin, int end, int t)
+    {
+        double chi2 = 0;
+        for(int i=begin; i<end; i++)
+        {
+            for(int j=mvPointObsBegin[i]; j<mvPointObsBegin[i+1]; j++)
+            {
+                const int o = mvPointObs[j];
+                const int nPose = mvObsPose[o];
+                const Vector3 Xc = mvRcw[nPose]*vPoints[i]+mvtcw[nPose];
+                const Scalar invz = Scalar(1)/Xc[2];
+                const Scalar u = mvFx[o]*Xc[0]*invz+mvCx[o];
+                const Scalar v = mvFy[o]*Xc[1]*invz+mvCy[o];
+                const Scalar eu = mvObsU[o]-u;
+                const Scalar ev = mvObsV[o]-v;
+                Scalar e2 = eu*eu+ev*ev;
+                if(mvbStereo[o])
+                {
+                    const Scalar eur = mvObsUr[o]-(u-mvBf[o]*invz);
+                    e2 += eur*eur;
+                }
+                const Scalar chi2o = mvObsInfo[o]*e2;
+                mvChi2[o] = chi2o;
+                mvbDepthPositive[o] = Xc[2]>0;
+
+                Scalar rho0, rho1;
+                Robustify<Scalar>(chi2o,mvHuber[o],rho0,rho1);
+                chi2 += rho0;
+            }
+        }
+        vThreadChi2[t] = chi2;
+    });
+
+    double chi2 = 0;
+    for(int t=0; t<mnThreads; t++)
+        chi2 += vThreadChi2[t];
+    return chi2;
+}
+
+template<typename Scalar>
+void BundleAdjuster<Scalar>::Linearize()
+{
+    ComputeRotations(mvPoses);
+
+    ParallelFor(mvPoints.size(),mnThreads,[&](int begin, int end, int t)
+    {
+        vector<Matrix6,Eigen::aligned_allocator<Matrix6> > &vHpp = mvvThreadHpp[t];
+        VectorX &bp = mvThreadb[t];
+        for(size_t i=0; i<vHpp.size(); i++)
+            vHpp[i].setZero();
+        bp.setZero();
+
+        Matrix6 HppDummy;
+        for(int i=begin; i<end; i++)
+        {
+            const bool bFreePoint = mvbOptimizedPoint[i];
+            Matrix3 &Hll = mvHll[i];
+            Vector3 &bl = mvbl[i];
+            Hll.setZero();
+            bl.setZero();
+            for(int j=mvPointObsBegin[i]; j<mvPointObsBegin[i+1]; j++)
+            {
+                const int o = mvPointObs[j];
+                const int nPose = mvObsPose[o];
+                const int c = mvPoseIdx[nPose];
+                const Matrix3 &R = mvRcw[nPose];
+                const Vector3 Xc = R*mvPoints[i]+mvtcw[nPose];
+                const Scalar invz = Scalar(1)/Xc[2];
+                const Scalar u = mvFx[o]*Xc[0]*invz+mvCx[o];
+                const Scalar v = mvFy[o]*Xc[1]*invz+mvCy[o];
+
+                Matrix6 &Hpp = c>=0 ? vHpp[c] : HppDummy;
+                Scalar* pbp = c>=0 ? bp.data()+6*c : NULL;
+
+                if(!mvbStereo[o])
+                {
+                    const Eigen::Matrix<Scalar,2,1> e(mvObsU[o]-u,mvObsV[o]-v);
+                    Scalar rho0, rho1;
+                    Robustify<Scalar>(mvObsInfo[o]*e.squaredNorm(),mvHuber[o],rho0,rho1);
+
+                    Eigen::Matrix<Scalar,2,3> Jp;
+                    Eigen::Matrix<Scalar,2,6> Jc;
+                    MonoJacobians<Scalar>(R,Xc,mvFx[o],mvFy[o],Jp,Jc);
+                    Accumulate<Scalar,2>(Jp,Jc,e,rho1*mvObsInfo[o],bFreePoint,c>=0,Hll,bl,Hpp,pbp,mvW[o]);
+                }
+                else
+                {
+                    const Vector3 e(mvObsU[o]-u,mvObsV[o]-v,mvObsUr[o]-(u-mvBf[o]*invz));
+                    Scalar rho0, rho1;
+                    Robustify<Scalar>(mvObsInfo[o]*e.squaredNorm(),mvHuber[o],rho0,rho1);
+
+                    Eigen::Matrix<Scalar,3,3> Jp;
+                    Eigen::Matrix<Scalar,3,6> Jc;
+                    StereoJacobians<Scalar>(R,Xc,mvFx[o],mvFy[o],mvBf[o],Jp,Jc);
+                    Accumulate<Scalar,3>(Jp,Jc,e,rho1*mvObsInfo[o],bFreePoint,c>=0,Hll,bl,Hpp,pbp,mvW[o]);
+                }
+            }
+        }
+    });
+
+    mbp = mvThreadb[0].template cast<double>();
+    for(int c=0; c<mnFreePoses; c++)
+        mvHpp[c] = mvvThreadHpp[0][c];
+    for(int t=1; t<mnThreads; t++)
+    {
+        mbp += mvThreadb[t].template cast<double>();
+        for(int c=0; c<mnFreePoses; c++)
+            mvHpp[c] += mvvThreadHpp[t][c];
+    }
+}
+
+template<typename Scalar>
+bool BundleAdjuster<Scalar>::ComputeStep(const double lambda)
+{
+    // Schur complement of the points: S = Hpp - W Hll^-1 W^T, rhs = bp - W Hll^-1 bl
+    ParallelFor(mvPoints.size(),mnThreads,[&](int begin, int end, int t)
+    {
+        vector<Matrix6,Eigen::aligned_allocator<Matrix6> > &vSlots = mvvThreadSlots[t];
+        VectorX &rhs = mvThreadb[t];
+        for(size_t i=0; i<vSlots.size(); i++)
+            vSlots[i].setZero();
+        rhs.setZero();
+
+        vector<Matrix63,Eigen::aligned_allocator<Matrix63> > vV;
+        for(int i=begin; i<end; i++)
+        {
+            if(!mvbOptimizedPoint[i])
+                continue;
+
+            Matrix3 H = mvHll[i];
+            H.diagonal().array() += Scalar(lambda);
+            mvHllInv[i] = H.inverse();
+
+            const int* pObs = mvPointObs.data()+mvPointObsBegin[i];
+            const int nFree = mvPointNumFree[i];
+            vV.resize(nFree);
+            for(int j=0; j<nFree; j++)
+            {
+                vV[j].noalias() = mvW[pObs[j]]*mvHllInv[i];
+                const int c = mvPoseIdx[mvObsPose[pObs[j]]];
+                rhs.template segment<6>(6*c).noalias() -= vV[j]*mvbl[i];
+            }
+
+            const int* pSlot = mvPairSlot.data()+mvPairBegin[i];
+            for(int j=0; j<nFree; j++)
+                for(int k=j; k<nFree; k++)
+                    vSlots[*pSlot++].noalias() -= vV[j]*mvW[pObs[k]].transpose();
+        }
+    });
+
+    if(mnFreePoses>0)
+    {
+        // The reduced camera system is assembled and factorized in double
+        mrhs = mbp;
+        for(size_t s=0; s<mvpSlotBlock.size(); s++)
+            *mvpSlotBlock[s] = mvvThreadSlots[0][s].template cast<double>();
+        mrhs += mvThreadb[0].template cast<double>();
+        for(int t=1; t<mnThreads; t++)
+        {
+            for(size_t s=0; s<mvpSlotBlock.size(); s++)
+                *mvpSlotBlock[s] += mvvThreadSlots[t][s].template cast<double>();
+            mrhs += mvThreadb[t].template cast<double>();
+        }
+        for(int c=0; c<mnFreePoses; c++)
+        {
+            Matrix6d &D = *mvpSlotBlock[mvDiagSlot[c]];
+            D += mvHpp[c].template cast<double>();
+            D.diagonal().array() += lambda;
+        }
+
+        mxPose.resize(6*mnFreePoses);
+        if(mbDense)
+        {
+            const Eigen::LDLT<Matrix6d> ldlt(mDenseS);
+            if(ldlt.info()!=Eigen::Success || ldlt.vectorD().minCoeff()<=0)
+                return false;
+            mxPose = ldlt.solve(mrhs);
+        }
+        else if(!mSolver.solve(*mpS,mxPose.data(),mrhs.data()))
+            return false;
+    }
+
+    // Back substitution of the points
+    ParallelFor(mvPoints.size(),mnThreads,[&](int begin, int end, int t)
+    {
+        for(int i=begin; i<end; i++)
+        {
+            if(!mvbOptimizedPoint[i])
+            {
+                mvxPoint[i].setZero();
+                continue;
+            }
+            Vector3 b = mvbl[i];
+            const int* pObs = mvPointObs.data()+mvPointObsBegin[i];
+            for(int j=0; j<mvPointNumFree[i]; j++)
+            {
+                const int c = mvPoseIdx[mvObsPose[pObs[j]]];
+                b.noalias() -= mvW[pObs[j]].transpose()*mxPose.template segment<6>(6*c).template cast<Scalar>();
+            }
+            mvxPoint[i].noalias() = mvHllInv[i]*b;
+        }
+    });
+
+    return true;
+}
+
+template<typename Scalar>
+double BundleAdjuster<Scalar>::StepScale(const double lambda) const
+{
+    double scale = 0;
+    for(int i=0; i<6*mnFreePoses; i++)
+        scale += mxPose[i]*(lambda*mxPose[i]+mbp[i]);
+    for(size_t i=0; i<mvPoints.size(); i++)
+    {
+        if(!mvbOptimizedPoint[i])
+            continue;
+        const Eigen::Vector3d x = mvxPoint[i].template cast<double>();
+        scale += x.dot(lambda*x+mvbl[i].template cast<double>());
+    }
+    return scale;
+}
+
+template<typename Scalar>
+int BundleAdjuster<Scalar>::Optimize(const int nIterations)
+{
+    BuildStructure();
+
+    double currentChi2 = ComputeErrors(mvPoses,mvPoints);
+    double lambda = 0;
+    double ni = 2;
+
+    int it=0;
+    for(; it<nIterations && !Stop(); it++)
+    {
+        Linearize();
+
+        if(it==0)
+        {
+            double maxDiagonal = 0;
+            for(int c=0; c<mnFreePoses; c++)
+                maxDiagonal = max(maxDiagonal,(double)mvHpp[c].diagonal().cwiseAbs().maxCoeff());
+            for(size_t i=0; i<mvPoints.size(); i++)
+                if(mvbOptimizedPoint[i])
+                    maxDiagonal = max(maxDiagonal,(double)mvHll[i].diagonal().cwiseAbs().maxCoeff());
+            lambda = 1e-5*maxDiagonal;
+            ni = 2;
+        }
+
+        // Levenberg-Marquardt trials as in g2o::OptimizationAlgorithmLevenberg
+        double rho = 0;
+        int nTrials = 0;
+        do
+        {
+            const bool bOk = ComputeStep(lambda);
+
+            mvNewPoses = mvPoses;
+            for(size_t i=0; i<mvPoses.size(); i++)
+            {
+                const int c = mvPoseIdx[i];
+                if(c>=0)
+                    mvNewPoses[i] = UpdatePose<Pose,Scalar>(mxPose.segment<6>(6*c).cast<Scalar>(),mvPoses[i]);
+            }
+            mvNewPoints.resize(mvPoints.size());
+            for(size_t i=0; i<mvPoints.size(); i++)
+                mvNewPoints[i] = mvPoints[i]+mvxPoint[i];
+
+            double tempChi2 = ComputeErrors(mvNewPoses,mvNewPoints);
+            if(!bOk)
+                tempChi2 = numeric_limits<double>::max();
+
+            rho = (currentChi2-tempChi2)/(StepScale(lambda)+1e-3);
+
+            if(rho>0 && std::isfinite(tempChi2))
+            {
+                const double alpha = min(1.0-pow(2*rho-1,3),2./3.);
+                lambda *= max(1./3.,alpha);
+                ni = 2;
+                currentChi2 = tempChi2;
+                mvPoses.swap(mvNewPoses);
+                mvPoints.swap(mvNewPoints);
+            }
+            else
+            {
+                lambda *= ni;
+                ni *= 2;
+            }
+            nTrials++;
+        }
+        while(rho<0 && nTrials<10 && !Stop());
+
+        if(nTrials==10 || rho==0)
+        {
+            it++;
+            break;
+        }
+    }
+
+    // Errors at the final estimate
+    ComputeErrors(mvPoses,mvPoints);
+
+    return it;
+}
+
+template class BundleAdjuster<float>;
+template class BundleAdjuster<double>;
+
+} //namespace ORB_SLAM
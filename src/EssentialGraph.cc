@@ -0,0 +1,111 @@
+/**
+* This file is part of ORB-SLAM2.
+*
+* Copyright (C) 2014-2016 Raúl Mur-Artal <raulmur at unizar dot es> (University of Zaragoza)
+* For more information see <https://github.com/raulmur/ORB_SLAM2>
+*
+* ORB-SLAM2 is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM2 is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with ORB-SLAM2. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "EssentialGraph.h"
+#include "KeyFrame.h"
+
+using namespace std;
+
+namespace ORB_SLAM2
+{
+
+EssentialGraph::EssentialGraph(const int minFeat):mnMinFeat(minFeat)
+{
+}
+
+void EssentialGraph::UpdateCovisibility(KeyFrame *pKF, KeyFrame *pConnected, const int weight)
+{
+    if(pKF->mnId<pConnected->mnId)
+        return;
+
+    unique_lock<mutex> lock(mMutexGraph);
+    SetType(pKF,pConnected,COVISIBILITY,weight>=mnMinFeat);
+}
+
+void EssentialGraph::ChangeParent(KeyFrame *pKF, KeyFrame *pOldParent, KeyFrame *pNewParent)
+{
+    if(pOldParent==pNewParent)
+        return;
+
+    unique_lock<mutex> lock(mMutexGraph);
+    if(pOldParent)
+        SetType(pKF,pOldParent,SPANNING_TREE,false);
+    if(pNewParent)
+        SetType(pKF,pNewParent,SPANNING_TREE,true);
+}
+
+void EssentialGraph::AddLoopEdge(KeyFrame *pKF1, KeyFrame *pKF2)
+{
+    unique_lock<mutex> lock(mMutexGraph);
+    SetType(pKF1,pKF2,LOOP,true);
+}
+
+vector<EssentialGraph::Edge> EssentialGraph::GetEdges()
+{
+    unique_lock<mutex> lock(mMutexGraph);
+    vector<Edge> vEdges;
+    vEdges.reserve(mEdges.size());
+    for(map<pair<long unsigned int,long unsigned int>,Edge>::const_iterator mit=mEdges.begin(), mend=mEdges.end(); mit!=mend; mit++)
+        vEdges.push_back(mit->second);
+    return vEdges;
+}
+
+int EssentialGraph::GetMinFeat() const
+{
+    return mnMinFeat;
+}
+
+void EssentialGraph::clear()
+{
+    unique_lock<mutex> lock(mMutexGraph);
+    mEdges.clear();
+}
+
+void EssentialGraph::SetType(KeyFrame *pKF1, KeyFrame *pKF2, const int nType, const bool bSet)
+{
+    if(pKF1->mnId<pKF2->mnId)
+        swap(pKF1,pKF2);
+
+    const pair<long unsigned int,long unsigned int> key(pKF1->mnId,pKF2->mnId);
+    map<pair<long unsigned int,long unsigned int>,Edge>::iterator mit = mEdges.find(key);
+
+    if(bSet)
+    {
+        if(mit==mEdges.end())
+        {
+            Edge edge;
+            edge.pKF = pKF1;
+            edge.pKFn = pKF2;
+            edge.nType = nType;
+            mEdges[key] = edge;
+        }
+        else
+            mit->second.nType |= nType;
+    }
+    else if(mit!=mEdges.end())
+    {
+        mit->second.nType &= ~nType;
+        if(!mit->second.nType)
+            mEdges.erase(mit);
+    }
+}
+
+} //namespace ORB_SLAM
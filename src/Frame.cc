@@ -22,6 +22,7 @@
 #include "Converter.h"
 #include "ORBmatcher.h"
 #include <thread>
+#include <algorithm>
 
 namespace ORB_SLAM2
 {
@@ -41,7 +42,8 @@ Frame::Frame(const Frame &frame)
      mTimeStamp(frame.mTimeStamp), mK(frame.mK.clone()), mDistCoef(frame.mDistCoef.clone()),
      mbf(frame.mbf), mb(frame.mb), mThDepth(frame.mThDepth), N(frame.N), mvKeys(frame.mvKeys),
      mvKeysRight(frame.mvKeysRight), mvKeysUn(frame.mvKeysUn),  mvuRight(frame.mvuRight),
-     mvDepth(frame.mvDepth), mBowVec(frame.mBowVec), mFeatVec(frame.mFeatVec),
+     mvDepth(frame.mvDepth), mBowVec(frame.mBowVec), mFeatVec(frame.mFeatVec), mBowDescriptors(frame.mBowDescriptors),
+     mvBowWords(frame.mvBowWords),
      mDescriptors(frame.mDescriptors.clone()), mDescriptorsRight(frame.mDescriptorsRight.clone()),
      mvpMapPoints(frame.mvpMapPoints), mvbOutlier(frame.mvbOutlier), mnId(frame.mnId),
      mpReferenceKF(frame.mpReferenceKF), mnScaleLevels(frame.mnScaleLevels),
@@ -58,7 +60,7 @@ Frame::Frame(const Frame &frame)
 }
 
 
-Frame::Frame(const cv::Mat &imLeft, const cv::Mat &imRight, const double &timeStamp, ORBextractor* extractorLeft, ORBextractor* extractorRight, ORBVocabulary* voc, cv::Mat &K, cv::Mat &distCoef, const float &bf, const float &thDepth)
+Frame::Frame(const cv::Mat &imLeft, const cv::Mat &imRight, const double &timeStamp, ORBextractor* extractorLeft, ORBextractor* extractorRight, ORBVocabulary* voc, cv::Mat &K, cv::Mat &distCoef, const float &bf, const float &thDepth, const cv::Mat &mask)
     :mpORBvocabulary(voc),mpORBextractorLeft(extractorLeft),mpORBextractorRight(extractorRight), mTimeStamp(timeStamp), mK(K.clone()),mDistCoef(distCoef.clone()), mbf(bf), mThDepth(thDepth),
      mpReferenceKF(static_cast<KeyFrame*>(NULL))
 {
@@ -75,8 +77,8 @@ Frame::Frame(const cv::Mat &imLeft, const cv::Mat &imRight, const double &timeSt
     mvInvLevelSigma2 = mpORBextractorLeft->GetInverseScaleSigmaSquares();
 
     // ORB extraction
-    thread threadLeft(&Frame::ExtractORB,this,0,imLeft);
-    thread threadRight(&Frame::ExtractORB,this,1,imRight);
+    thread threadLeft(&Frame::ExtractORB,this,0,imLeft,mask);
+    thread threadRight(&Frame::ExtractORB,this,1,imRight,mask);
     threadLeft.join();
     threadRight.join();
 
@@ -116,7 +118,7 @@ Frame::Frame(const cv::Mat &imLeft, const cv::Mat &imRight, const double &timeSt
     AssignFeaturesToGrid();
 }
 
-Frame::Frame(const cv::Mat &imGray, const cv::Mat &imDepth, const double &timeStamp, ORBextractor* extractor,ORBVocabulary* voc, cv::Mat &K, cv::Mat &distCoef, const float &bf, const float &thDepth)
+Frame::Frame(const cv::Mat &imGray, const cv::Mat &imDepth, const double &timeStamp, ORBextractor* extractor,ORBVocabulary* voc, cv::Mat &K, cv::Mat &distCoef, const float &bf, const float &thDepth, const cv::Mat &mask)
     :mpORBvocabulary(voc),mpORBextractorLeft(extractor),mpORBextractorRight(static_cast<ORBextractor*>(NULL)),
      mTimeStamp(timeStamp), mK(K.clone()),mDistCoef(distCoef.clone()), mbf(bf), mThDepth(thDepth)
 {
@@ -133,7 +135,7 @@ Frame::Frame(const cv::Mat &imGray, const cv::Mat &imDepth, const double &timeSt
     mvInvLevelSigma2 = mpORBextractorLeft->GetInverseScaleSigmaSquares();
 
     // ORB extraction
-    ExtractORB(0,imGray);
+    ExtractORB(0,imGray,mask);
 
     N = mvKeys.size();
 
@@ -171,7 +173,7 @@ Frame::Frame(const cv::Mat &imGray, const cv::Mat &imDepth, const double &timeSt
 }
 
 
-Frame::Frame(const cv::Mat &imGray, const double &timeStamp, ORBextractor* extractor,ORBVocabulary* voc, cv::Mat &K, cv::Mat &distCoef, const float &bf, const float &thDepth)
+Frame::Frame(const cv::Mat &imGray, const double &timeStamp, ORBextractor* extractor,ORBVocabulary* voc, cv::Mat &K, cv::Mat &distCoef, const float &bf, const float &thDepth, const cv::Mat &mask)
     :mpORBvocabulary(voc),mpORBextractorLeft(extractor),mpORBextractorRight(static_cast<ORBextractor*>(NULL)),
      mTimeStamp(timeStamp), mK(K.clone()),mDistCoef(distCoef.clone()), mbf(bf), mThDepth(thDepth)
 {
@@ -188,7 +190,7 @@ Frame::Frame(const cv::Mat &imGray, const double &timeStamp, ORBextractor* extra
     mvInvLevelSigma2 = mpORBextractorLeft->GetInverseScaleSigmaSquares();
 
     // ORB extraction
-    ExtractORB(0,imGray);
+    ExtractORB(0,imGray,mask);
 
     N = mvKeys.size();
 
@@ -244,12 +246,12 @@ void Frame::AssignFeaturesToGrid()
     }
 }
 
-void Frame::ExtractORB(int flag, const cv::Mat &im)
+void Frame::ExtractORB(int flag, const cv::Mat &im, const cv::Mat &mask)
 {
     if(flag==0)
-        (*mpORBextractorLeft)(im,cv::Mat(),mvKeys,mDescriptors);
+        (*mpORBextractorLeft)(im,mask,mvKeys,mDescriptors);
     else
-        (*mpORBextractorRight)(im,cv::Mat(),mvKeysRight,mDescriptorsRight);
+        mpORBextractorRight->DetectKeyPoints(im,mask,mvKeysRight);
 }
 
 void Frame::SetPose(cv::Mat Tcw)
@@ -397,7 +399,19 @@ void Frame::ComputeBoW()
     if(mBowVec.empty())
     {
         vector<cv::Mat> vCurrentDesc = Converter::toDescriptorVector(mDescriptors);
-        mpORBvocabulary->transform(vCurrentDesc,mBowVec,mFeatVec,4);
+        mpORBvocabulary->transform(vCurrentDesc,mBowVec,mvBowWords);
+    }
+}
+
+void Frame::ComputeFeatVec()
+{
+    ComputeBoW();
+
+    if(mFeatVec.empty() && !mvBowWords.empty())
+    {
+        // Nodes in the 4th level (from leaves up), found going up from the words
+        mpORBvocabulary->getFeatureVector(mvBowWords,mFeatVec,4);
+        mBowDescriptors = ORBmatcher::PackBowDescriptors(mFeatVec,mDescriptors);
     }
 }
 
@@ -497,6 +511,38 @@ void Frame::ComputeStereoMatches()
     const float minD = 0;
     const float maxD = mbf/minZ;
 
+    // Right descriptors are only computed for keypoints that are candidates of some left keypoint
+    vector<bool> vbCandidateR(Nr,false);
+
+    for(int iL=0; iL<N; iL++)
+    {
+        const cv::KeyPoint &kpL = mvKeys[iL];
+        const int &levelL = kpL.octave;
+        const float &uL = kpL.pt.x;
+
+        const vector<size_t> &vCandidates = vRowIndices[kpL.pt.y];
+
+        const float minU = uL-maxD;
+        const float maxU = uL-minD;
+
+        if(maxU<0)
+            continue;
+
+        for(size_t iC=0; iC<vCandidates.size(); iC++)
+        {
+            const size_t iR = vCandidates[iC];
+            const cv::KeyPoint &kpR = mvKeysRight[iR];
+
+            if(kpR.octave<levelL-1 || kpR.octave>levelL+1)
+                continue;
+
+            if(kpR.pt.x>=minU && kpR.pt.x<=maxU)
+                vbCandidateR[iR] = true;
+        }
+    }
+
+    mpORBextractorRight->ComputeDescriptors(mvKeysRight,vbCandidateR,mDescriptorsRight);
+
     // For each left keypoint search a match in the right image
     vector<pair<int, int> > vDistIdx;
     vDistIdx.reserve(N);
@@ -663,6 +709,38 @@ void Frame::ComputeStereoFromRGBD(const cv::Mat &imDepth)
     }
 }
 
+void Frame::ShiftKeyPoint(const int i, const float dx, const float dy)
+{
+    int nOldPosX, nOldPosY;
+    const bool bOldInGrid = PosInGrid(mvKeysUn[i],nOldPosX,nOldPosY);
+
+    // Distortion is locally a translation, the undistorted keypoint and the stereo
+    // coordinate (same disparity) are shifted by the same offset
+    mvKeys[i].pt.x += dx;
+    mvKeys[i].pt.y += dy;
+    mvKeysUn[i].pt.x += dx;
+    mvKeysUn[i].pt.y += dy;
+    if(mvuRight[i]>=0)
+        mvuRight[i] += dx;
+
+    int nNewPosX, nNewPosY;
+    const bool bNewInGrid = PosInGrid(mvKeysUn[i],nNewPosX,nNewPosY);
+
+    if(bOldInGrid && bNewInGrid && nOldPosX==nNewPosX && nOldPosY==nNewPosY)
+        return;
+
+    if(bOldInGrid)
+    {
+        vector<size_t> &vCell = mGrid[nOldPosX][nOldPosY];
+        vector<size_t>::iterator vit = find(vCell.begin(),vCell.end(),(size_t)i);
+        if(vit!=vCell.end())
+            vCell.erase(vit);
+    }
+
+    if(bNewInGrid)
+        mGrid[nNewPosX][nNewPosY].push_back(i);
+}
+
 cv::Mat Frame::UnprojectStereo(const int &i)
 {
     const float z = mvDepth[i];
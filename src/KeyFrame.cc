@@ -22,6 +22,7 @@
 #include "Converter.h"
 #include "ORBmatcher.h"
 #include<mutex>
+#include<queue>
 
 namespace ORB_SLAM2
 {
@@ -36,11 +37,11 @@ KeyFrame::KeyFrame(Frame &F, Map *pMap, KeyFrameDatabase *pKFDB):
     fx(F.fx), fy(F.fy), cx(F.cx), cy(F.cy), invfx(F.invfx), invfy(F.invfy),
     mbf(F.mbf), mb(F.mb), mThDepth(F.mThDepth), N(F.N), mvKeys(F.mvKeys), mvKeysUn(F.mvKeysUn),
     mvuRight(F.mvuRight), mvDepth(F.mvDepth), mDescriptors(F.mDescriptors.clone()),
-    mBowVec(F.mBowVec), mFeatVec(F.mFeatVec), mnScaleLevels(F.mnScaleLevels), mfScaleFactor(F.mfScaleFactor),
+    mBowVec(F.mBowVec), mFeatVec(F.mFeatVec), mBowDescriptors(F.mBowDescriptors), mvBowWords(F.mvBowWords), mnScaleLevels(F.mnScaleLevels), mfScaleFactor(F.mfScaleFactor),
     mfLogScaleFactor(F.mfLogScaleFactor), mvScaleFactors(F.mvScaleFactors), mvLevelSigma2(F.mvLevelSigma2),
     mvInvLevelSigma2(F.mvInvLevelSigma2), mnMinX(F.mnMinX), mnMinY(F.mnMinY), mnMaxX(F.mnMaxX),
     mnMaxY(F.mnMaxY), mK(F.mK), mvpMapPoints(F.mvpMapPoints), mpKeyFrameDB(pKFDB),
-    mpORBvocabulary(F.mpORBvocabulary), mbFirstConnection(true), mpParent(NULL), mbNotErase(false),
+    mpORBvocabulary(F.mpORBvocabulary), mbFirstConnection(true), mbOrigin(false), mpParent(NULL), mbNotErase(false),
     mbToBeErased(false), mbBad(false), mHalfBaseline(F.mb/2), mpMap(pMap)
 {
     mnId=nNextId++;
@@ -58,12 +59,19 @@ KeyFrame::KeyFrame(Frame &F, Map *pMap, KeyFrameDatabase *pKFDB):
 
 void KeyFrame::ComputeBoW()
 {
-    if(mBowVec.empty() || mFeatVec.empty())
+    // The words computed by the frame are reused, the vocabulary is only descended if it had none
+    if(mBowVec.empty())
     {
         vector<cv::Mat> vCurrentDesc = Converter::toDescriptorVector(mDescriptors);
+        mpORBvocabulary->transform(vCurrentDesc,mBowVec,mvBowWords);
+    }
+
+    if(mFeatVec.empty())
+    {
         // Feature vector associate features with nodes in the 4th level (from leaves up)
         // We assume the vocabulary tree has 6 levels, change the 4 otherwise
-        mpORBvocabulary->transform(vCurrentDesc,mBowVec,mFeatVec,4);
+        mpORBvocabulary->getFeatureVector(mvBowWords,mFeatVec,4);
+        mBowDescriptors = ORBmatcher::PackBowDescriptors(mFeatVec,mDescriptors);
     }
 }
 
@@ -132,6 +140,8 @@ void KeyFrame::AddConnection(KeyFrame *pKF, const int &weight)
             return;
     }
 
+    mpMap->mEssentialGraph.UpdateCovisibility(this,pKF,weight);
+
     UpdateBestCovisibles();
 }
 
@@ -165,6 +175,19 @@ set<KeyFrame*> KeyFrame::GetConnectedKeyFrames()
     return s;
 }
 
+vector<long unsigned int> KeyFrame::GetConnectedKeyFrameIds()
+{
+    vector<long unsigned int> vIds;
+    {
+        unique_lock<mutex> lock(mMutexConnections);
+        vIds.reserve(mConnectedKeyFrameWeights.size());
+        for(map<KeyFrame*,int>::iterator mit=mConnectedKeyFrameWeights.begin();mit!=mConnectedKeyFrameWeights.end();mit++)
+            vIds.push_back(mit->first->mnId);
+    }
+    sort(vIds.begin(),vIds.end());
+    return vIds;
+}
+
 vector<KeyFrame*> KeyFrame::GetVectorCovisibleKeyFrames()
 {
     unique_lock<mutex> lock(mMutexConnections);
@@ -363,15 +386,23 @@ void KeyFrame::UpdateConnections()
     {
         unique_lock<mutex> lockCon(mMutexConnections);
 
+        EssentialGraph &graph = mpMap->mEssentialGraph;
+        for(map<KeyFrame*,int>::iterator mit=mConnectedKeyFrameWeights.begin(), mend=mConnectedKeyFrameWeights.end(); mit!=mend; mit++)
+            if(!KFcounter.count(mit->first))
+                graph.UpdateCovisibility(this,mit->first,0);
+        for(map<KeyFrame*,int>::iterator mit=KFcounter.begin(), mend=KFcounter.end(); mit!=mend; mit++)
+            graph.UpdateCovisibility(this,mit->first,mit->second);
+
         // mspConnectedKeyFrames = spConnectedKeyFrames;
         mConnectedKeyFrameWeights = KFcounter;
         mvpOrderedConnectedKeyFrames = vector<KeyFrame*>(lKFs.begin(),lKFs.end());
         mvOrderedWeights = vector<int>(lWs.begin(), lWs.end());
 
-        if(mbFirstConnection && mnId!=0)
+        if(mbFirstConnection && !mbOrigin)
         {
             mpParent = mvpOrderedConnectedKeyFrames.front();
             mpParent->AddChild(this);
+            graph.ChangeParent(this,NULL,mpParent);
             mbFirstConnection = false;
         }
 
@@ -393,7 +424,9 @@ void KeyFrame::EraseChild(KeyFrame *pKF)
 void KeyFrame::ChangeParent(KeyFrame *pKF)
 {
     unique_lock<mutex> lockCon(mMutexConnections);
+    mpMap->mEssentialGraph.ChangeParent(this,mpParent,pKF);
     mpParent = pKF;
+    mbFirstConnection = false;
     pKF->AddChild(this);
 }
 
@@ -415,11 +448,24 @@ bool KeyFrame::hasChild(KeyFrame *pKF)
     return mspChildrens.count(pKF);
 }
 
+void KeyFrame::SetOrigin(const bool bOrigin)
+{
+    unique_lock<mutex> lockCon(mMutexConnections);
+    mbOrigin = bOrigin;
+}
+
+bool KeyFrame::IsOrigin()
+{
+    unique_lock<mutex> lockCon(mMutexConnections);
+    return mbOrigin;
+}
+
 void KeyFrame::AddLoopEdge(KeyFrame *pKF)
 {
     unique_lock<mutex> lockCon(mMutexConnections);
     mbNotErase = true;
     mspLoopEdges.insert(pKF);
+    mpMap->mEssentialGraph.AddLoopEdge(this,pKF);
 }
 
 set<KeyFrame*> KeyFrame::GetLoopEdges()
@@ -454,7 +500,7 @@ void KeyFrame::SetBadFlag()
 {   
     {
         unique_lock<mutex> lock(mMutexConnections);
-        if(mnId==0)
+        if(mbOrigin)
             return;
         else if(mbNotErase)
         {
@@ -469,73 +515,104 @@ void KeyFrame::SetBadFlag()
     for(size_t i=0; i<mvpMapPoints.size(); i++)
         if(mvpMapPoints[i])
             mvpMapPoints[i]->EraseObservation(this);
+    set<KeyFrame*> spChildrens;
+    KeyFrame* pParent;
     {
         unique_lock<mutex> lock(mMutexConnections);
         unique_lock<mutex> lock1(mMutexFeatures);
 
+        for(map<KeyFrame*,int>::iterator mit = mConnectedKeyFrameWeights.begin(), mend=mConnectedKeyFrameWeights.end(); mit!=mend; mit++)
+            mpMap->mEssentialGraph.UpdateCovisibility(this,mit->first,0);
+
         mConnectedKeyFrameWeights.clear();
         mvpOrderedConnectedKeyFrames.clear();
 
-        // Update Spanning Tree
-        set<KeyFrame*> sParentCandidates;
-        sParentCandidates.insert(mpParent);
+        spChildrens.swap(mspChildrens);
+        pParent = mpParent;
+    }
 
-        // Assign at each iteration one children with a parent (the pair with highest covisibility weight)
-        // Include that children as new parent candidate for the rest
-        while(!mspChildrens.empty())
-        {
-            bool bContinue = false;
+    // Update Spanning Tree
+    // The children are attached as in Prim's algorithm for a maximum spanning tree: at each step the
+    // strongest covisibility link from a pending children to the parent or to an already attached
+    // children is taken, and the links to the new parent candidate are queued.
+    vector<KeyFrame*> vpChildrens;
+    vpChildrens.reserve(spChildrens.size());
+    map<KeyFrame*,size_t> mChildIdx;
+    for(set<KeyFrame*>::iterator sit=spChildrens.begin(), send=spChildrens.end(); sit!=send; sit++)
+    {
+        if((*sit)->isBad())
+            continue;
+        mChildIdx[*sit] = vpChildrens.size();
+        vpChildrens.push_back(*sit);
+    }
 
-            int max = -1;
-            KeyFrame* pC;
-            KeyFrame* pP;
+    // Links (weight, children, parent candidate) and links from each children to the other ones
+    priority_queue<pair<int,pair<size_t,KeyFrame*> > > qLinks;
+    vector<vector<pair<int,size_t> > > vChildLinks(vpChildrens.size());
 
-            for(set<KeyFrame*>::iterator sit=mspChildrens.begin(), send=mspChildrens.end(); sit!=send; sit++)
+    for(size_t i=0; i<vpChildrens.size(); i++)
+    {
+        KeyFrame* pKF = vpChildrens[i];
+        const vector<KeyFrame*> vpConnected = pKF->GetVectorCovisibleKeyFrames();
+        for(size_t j=0, jend=vpConnected.size(); j<jend; j++)
+        {
+            KeyFrame* pKFj = vpConnected[j];
+            if(pKFj==pParent)
+                qLinks.push(make_pair(pKF->GetWeight(pKFj),make_pair(i,pKFj)));
+            else
             {
-                KeyFrame* pKF = *sit;
-                if(pKF->isBad())
-                    continue;
-
-                // Check if a parent candidate is connected to the keyframe
-                vector<KeyFrame*> vpConnected = pKF->GetVectorCovisibleKeyFrames();
-                for(size_t i=0, iend=vpConnected.size(); i<iend; i++)
-                {
-                    for(set<KeyFrame*>::iterator spcit=sParentCandidates.begin(), spcend=sParentCandidates.end(); spcit!=spcend; spcit++)
-                    {
-                        if(vpConnected[i]->mnId == (*spcit)->mnId)
-                        {
-                            int w = pKF->GetWeight(vpConnected[i]);
-                            if(w>max)
-                            {
-                                pC = pKF;
-                                pP = vpConnected[i];
-                                max = w;
-                                bContinue = true;
-                            }
-                        }
-                    }
-                }
+                map<KeyFrame*,size_t>::iterator mit = mChildIdx.find(pKFj);
+                if(mit!=mChildIdx.end())
+                    vChildLinks[mit->second].push_back(make_pair(pKF->GetWeight(pKFj),i));
             }
+        }
+    }
 
-            if(bContinue)
-            {
-                pC->ChangeParent(pP);
-                sParentCandidates.insert(pC);
-                mspChildrens.erase(pC);
-            }
-            else
-                break;
+    vector<bool> vbAttached(vpChildrens.size(),false);
+    while(!qLinks.empty())
+    {
+        const size_t i = qLinks.top().second.first;
+        KeyFrame* pP = qLinks.top().second.second;
+        qLinks.pop();
+
+        if(vbAttached[i])
+            continue;
+
+        vpChildrens[i]->ChangeParent(pP);
+        vbAttached[i] = true;
+
+        for(size_t j=0, jend=vChildLinks[i].size(); j<jend; j++)
+        {
+            const size_t k = vChildLinks[i][j].second;
+            if(!vbAttached[k])
+                qLinks.push(make_pair(vChildLinks[i][j].first,make_pair(k,vpChildrens[i])));
         }
+    }
 
-        // If a children has no covisibility links with any parent candidate, assign to the original parent of this KF
-        if(!mspChildrens.empty())
-            for(set<KeyFrame*>::iterator sit=mspChildrens.begin(); sit!=mspChildrens.end(); sit++)
-            {
-                (*sit)->ChangeParent(mpParent);
-            }
+    // If a children has no covisibility links with any parent candidate, assign to the original parent of this KF
+    for(set<KeyFrame*>::iterator sit=spChildrens.begin(), send=spChildrens.end(); sit!=send; sit++)
+    {
+        map<KeyFrame*,size_t>::iterator mit = mChildIdx.find(*sit);
+        if(mit==mChildIdx.end() || !vbAttached[mit->second])
+            (*sit)->ChangeParent(pParent);
+    }
 
-        mpParent->EraseChild(this);
-        mTcp = Tcw*mpParent->GetPoseInverse();
+    {
+        unique_lock<mutex> lock(mMutexConnections);
+        unique_lock<mutex> lock1(mMutexFeatures);
+
+        // Children added while the tree was being repaired
+        for(set<KeyFrame*>::iterator sit=mspChildrens.begin(); sit!=mspChildrens.end(); sit++)
+            (*sit)->ChangeParent(mpParent);
+        mspChildrens.clear();
+
+        // A discarded origin is the root of its tree and has no parent
+        if(mpParent)
+        {
+            mpParent->EraseChild(this);
+            mpMap->mEssentialGraph.ChangeParent(this,mpParent,NULL);
+            mTcp = Tcw*mpParent->GetPoseInverse();
+        }
         mbBad = true;
     }
 
@@ -558,6 +635,7 @@ void KeyFrame::EraseConnection(KeyFrame* pKF)
         if(mConnectedKeyFrameWeights.count(pKF))
         {
             mConnectedKeyFrameWeights.erase(pKF);
+            mpMap->mEssentialGraph.UpdateCovisibility(this,pKF,0);
             bUpdate=true;
         }
     }
@@ -24,14 +24,36 @@
 #include "Thirdparty/DBoW2/DBoW2/BowVector.h"
 
 #include<mutex>
+#include<algorithm>
 
 using namespace std;
 
 namespace ORB_SLAM2
 {
 
+namespace
+{
+
+inline uint64_t SplitMix64(uint64_t x)
+{
+    x += 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+inline int HammingDistance(const uint64_t* a, const uint64_t* b, const int n)
+{
+    int dist = 0;
+    for(int i=0; i<n; i++)
+        dist += __builtin_popcountll(a[i]^b[i]);
+    return dist;
+}
+
+} // namespace
+
 KeyFrameDatabase::KeyFrameDatabase (const ORBVocabulary &voc):
-    mpVoc(&voc)
+    mpVoc(&voc), mnLoopPrefilter(500)
 {
     mvInvertedFile.resize(voc.size());
 }
@@ -41,8 +63,17 @@ void KeyFrameDatabase::add(KeyFrame *pKF)
 {
     unique_lock<mutex> lock(mMutex);
 
-    for(DBoW2::BowVector::const_iterator vit= pKF->mBowVec.begin(), vend=pKF->mBowVec.end(); vit!=vend; vit++)
-        mvInvertedFile[vit->first].push_back(pKF);
+    const DBoW2::BowVector &vBow = pKF->mBowVec;
+    for(size_t i=0, iend=vBow.size(); i<iend; i++)
+        mvInvertedFile[vBow.wordId(i)].push_back(pKF);
+
+    if(mmSignatureIndex.count(pKF))
+        return;
+
+    mmSignatureIndex[pKF] = mvpSignatureKFs.size();
+    mvpSignatureKFs.push_back(pKF);
+    mvSignatures.resize(mvSignatures.size()+SIGNATURE_WORDS);
+    ComputeSignature(vBow,&mvSignatures[mvSignatures.size()-SIGNATURE_WORDS]);
 }
 
 void KeyFrameDatabase::erase(KeyFrame* pKF)
@@ -50,10 +81,11 @@ void KeyFrameDatabase::erase(KeyFrame* pKF)
     unique_lock<mutex> lock(mMutex);
 
     // Erase elements in the Inverse File for the entry
-    for(DBoW2::BowVector::const_iterator vit=pKF->mBowVec.begin(), vend=pKF->mBowVec.end(); vit!=vend; vit++)
+    const DBoW2::BowVector &vBow = pKF->mBowVec;
+    for(size_t i=0, iend=vBow.size(); i<iend; i++)
     {
         // List of keyframes that share the word
-        list<KeyFrame*> &lKFs =   mvInvertedFile[vit->first];
+        list<KeyFrame*> &lKFs =   mvInvertedFile[vBow.wordId(i)];
 
         for(list<KeyFrame*>::iterator lit=lKFs.begin(), lend= lKFs.end(); lit!=lend; lit++)
         {
@@ -64,12 +96,85 @@ void KeyFrameDatabase::erase(KeyFrame* pKF)
             }
         }
     }
+
+    // Move the last signature to the place of the erased one
+    map<KeyFrame*,size_t>::iterator mit = mmSignatureIndex.find(pKF);
+    if(mit!=mmSignatureIndex.end())
+    {
+        const size_t idx = mit->second;
+        const size_t last = mvpSignatureKFs.size()-1;
+        if(idx!=last)
+        {
+            mvpSignatureKFs[idx] = mvpSignatureKFs[last];
+            copy(mvSignatures.begin()+last*SIGNATURE_WORDS,mvSignatures.end(),mvSignatures.begin()+idx*SIGNATURE_WORDS);
+            mmSignatureIndex[mvpSignatureKFs[idx]] = idx;
+        }
+        mvpSignatureKFs.pop_back();
+        mvSignatures.resize(last*SIGNATURE_WORDS);
+        mmSignatureIndex.erase(mit);
+    }
 }
 
 void KeyFrameDatabase::clear()
 {
     mvInvertedFile.clear();
     mvInvertedFile.resize(mpVoc->size());
+    mvSignatures.clear();
+    mvpSignatureKFs.clear();
+    mmSignatureIndex.clear();
+}
+
+void KeyFrameDatabase::ComputeSignature(const DBoW2::BowVector &vBow, uint64_t* pSignature) const
+{
+    const int nBits = 64*SIGNATURE_WORDS;
+    vector<float> vAcc(nBits,0.f);
+
+    // Each word votes with its weight along a pseudo-random +-1 direction given by hashing its id
+    for(size_t i=0, iend=vBow.size(); i<iend; i++)
+    {
+        const float v = vBow.value(i);
+        const uint64_t seed = (uint64_t)vBow.wordId(i)*SIGNATURE_WORDS;
+        for(int w=0; w<SIGNATURE_WORDS; w++)
+        {
+            const uint64_t h = SplitMix64(seed+w);
+            float* pAcc = &vAcc[64*w];
+            for(int b=0; b<64; b++)
+                pAcc[b] += ((h>>b)&1) ? v : -v;
+        }
+    }
+
+    for(int w=0; w<SIGNATURE_WORDS; w++)
+    {
+        uint64_t sig = 0;
+        for(int b=0; b<64; b++)
+            if(vAcc[64*w+b]>0)
+                sig |= (uint64_t)1<<b;
+        pSignature[w] = sig;
+    }
+}
+
+int KeyFrameDatabase::CommonWords(const DBoW2::BowVector &vBow1, const DBoW2::BowVector &vBow2)
+{
+    const DBoW2::WordId* it1 = vBow1.ids();
+    const DBoW2::WordId* end1 = it1+vBow1.size();
+    const DBoW2::WordId* it2 = vBow2.ids();
+    const DBoW2::WordId* end2 = it2+vBow2.size();
+
+    int nCommon = 0;
+    while(it1<end1 && it2<end2)
+    {
+        if(*it1==*it2)
+        {
+            nCommon++;
+            it1++;
+            it2++;
+        }
+        else if(*it1<*it2)
+            it1++;
+        else
+            it2++;
+    }
+    return nCommon;
 }
 
 
@@ -83,23 +188,59 @@ vector<KeyFrame*> KeyFrameDatabase::DetectLoopCandidates(KeyFrame* pKF, float mi
     {
         unique_lock<mutex> lock(mMutex);
 
-        for(DBoW2::BowVector::const_iterator vit=pKF->mBowVec.begin(), vend=pKF->mBowVec.end(); vit != vend; vit++)
+        const DBoW2::BowVector &vBow = pKF->mBowVec;
+
+        // In large maps only the keyframes with the closest signatures are considered
+        if(mvpSignatureKFs.size()>mnLoopPrefilter)
         {
-            list<KeyFrame*> &lKFs =   mvInvertedFile[vit->first];
+            uint64_t signature[SIGNATURE_WORDS];
+            ComputeSignature(vBow,signature);
 
-            for(list<KeyFrame*>::iterator lit=lKFs.begin(), lend= lKFs.end(); lit!=lend; lit++)
+            vector<pair<int,KeyFrame*> > vDistAndKF;
+            vDistAndKF.reserve(mvpSignatureKFs.size());
+            const uint64_t* pSignatures = mvSignatures.data();
+            for(size_t i=0, iend=mvpSignatureKFs.size(); i<iend; i++)
             {
-                KeyFrame* pKFi=*lit;
-                if(pKFi->mnLoopQuery!=pKF->mnId)
+                KeyFrame* pKFi = mvpSignatureKFs[i];
+                if(pKFi==pKF || spConnectedKeyFrames.count(pKFi))
+                    continue;
+                vDistAndKF.push_back(make_pair(HammingDistance(signature,pSignatures+i*SIGNATURE_WORDS,SIGNATURE_WORDS),pKFi));
+            }
+
+            if(vDistAndKF.size()>mnLoopPrefilter)
+                nth_element(vDistAndKF.begin(),vDistAndKF.begin()+mnLoopPrefilter,vDistAndKF.end());
+
+            for(size_t i=0, iend=min(vDistAndKF.size(),mnLoopPrefilter); i<iend; i++)
+            {
+                KeyFrame* pKFi = vDistAndKF[i].second;
+                const int nCommon = CommonWords(vBow,pKFi->mBowVec);
+                if(nCommon==0)
+                    continue;
+                pKFi->mnLoopQuery=pKF->mnId;
+                pKFi->mnLoopWords=nCommon;
+                lKFsSharingWords.push_back(pKFi);
+            }
+        }
+        else
+        {
+            for(size_t i=0, iend=vBow.size(); i<iend; i++)
+            {
+                list<KeyFrame*> &lKFs =   mvInvertedFile[vBow.wordId(i)];
+
+                for(list<KeyFrame*>::iterator lit=lKFs.begin(), lend= lKFs.end(); lit!=lend; lit++)
                 {
-                    pKFi->mnLoopWords=0;
-                    if(!spConnectedKeyFrames.count(pKFi))
+                    KeyFrame* pKFi=*lit;
+                    if(pKFi->mnLoopQuery!=pKF->mnId)
                     {
-                        pKFi->mnLoopQuery=pKF->mnId;
-                        lKFsSharingWords.push_back(pKFi);
+                        pKFi->mnLoopWords=0;
+                        if(!spConnectedKeyFrames.count(pKFi))
+                        {
+                            pKFi->mnLoopQuery=pKF->mnId;
+                            lKFsSharingWords.push_back(pKFi);
+                        }
                     }
+                    pKFi->mnLoopWords++;
                 }
-                pKFi->mnLoopWords++;
             }
         }
     }
@@ -204,9 +345,10 @@ vector<KeyFrame*> KeyFrameDatabase::DetectRelocalizationCandidates(Frame *F)
     {
         unique_lock<mutex> lock(mMutex);
 
-        for(DBoW2::BowVector::const_iterator vit=F->mBowVec.begin(), vend=F->mBowVec.end(); vit != vend; vit++)
+        const DBoW2::BowVector &vBow = F->mBowVec;
+        for(size_t i=0, iend=vBow.size(); i<iend; i++)
         {
-            list<KeyFrame*> &lKFs =   mvInvertedFile[vit->first];
+            list<KeyFrame*> &lKFs =   mvInvertedFile[vBow.wordId(i)];
 
             for(list<KeyFrame*>::iterator lit=lKFs.begin(), lend= lKFs.end(); lit!=lend; lit++)
             {
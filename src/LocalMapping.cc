@@ -22,6 +22,7 @@
 #include "LoopClosing.h"
 #include "ORBmatcher.h"
 #include "Optimizer.h"
+#include "Logger.h"
 
 #include<mutex>
 
@@ -105,7 +106,11 @@ void LocalMapping::Run()
         if(CheckFinish())
             break;
 
-        usleep(3000);
+        {
+            unique_lock<mutex> lock(mMutexReset);
+            if(!mbResetRequested)
+                mcvReset.wait_for(lock,chrono::milliseconds(3));
+        }
     }
 
     SetFinish();
@@ -113,9 +118,12 @@ void LocalMapping::Run()
 
 void LocalMapping::InsertKeyFrame(KeyFrame *pKF)
 {
-    unique_lock<mutex> lock(mMutexNewKFs);
-    mlNewKeyFrames.push_back(pKF);
-    mbAbortBA=true;
+    {
+        unique_lock<mutex> lock(mMutexNewKFs);
+        mlNewKeyFrames.push_back(pKF);
+        mbAbortBA=true;
+    }
+    mcvReset.notify_all();
 }
 
 
@@ -566,7 +574,7 @@ bool LocalMapping::Stop()
     if(mbStopRequested && !mbNotStop)
     {
         mbStopped = true;
-        cout << "Local Mapping STOP" << endl;
+        ORB_LOG(INFO) << "Local Mapping STOP";
         return true;
     }
 
@@ -597,7 +605,7 @@ void LocalMapping::Release()
         delete *lit;
     mlNewKeyFrames.clear();
 
-    cout << "Local Mapping RELEASE" << endl;
+    ORB_LOG(INFO) << "Local Mapping RELEASE";
 }
 
 bool LocalMapping::AcceptKeyFrames()
@@ -640,7 +648,7 @@ void LocalMapping::KeyFrameCulling()
     for(vector<KeyFrame*>::iterator vit=vpLocalKeyFrames.begin(), vend=vpLocalKeyFrames.end(); vit!=vend; vit++)
     {
         KeyFrame* pKF = *vit;
-        if(pKF->mnId==0)
+        if(pKF->IsOrigin())
             continue;
         const vector<MapPoint*> vpMapPoints = pKF->GetMapPointMatches();
 
@@ -704,20 +712,15 @@ cv::Mat LocalMapping::SkewSymmetricMatrix(const cv::Mat &v)
 
 void LocalMapping::RequestReset()
 {
-    {
-        unique_lock<mutex> lock(mMutexReset);
-        mbResetRequested = true;
-    }
+    unique_lock<mutex> lock(mMutexReset);
+    mbResetRequested = true;
 
-    while(1)
-    {
-        {
-            unique_lock<mutex> lock2(mMutexReset);
-            if(!mbResetRequested)
-                break;
-        }
-        usleep(3000);
-    }
+    // A running local BA is aborted so that the reset is served right away
+    mbAbortBA = true;
+    mcvReset.notify_all();
+
+    while(mbResetRequested)
+        mcvReset.wait(lock);
 }
 
 void LocalMapping::ResetIfRequested()
@@ -728,6 +731,7 @@ void LocalMapping::ResetIfRequested()
         mlNewKeyFrames.clear();
         mlpRecentAddedMapPoints.clear();
         mbResetRequested=false;
+        mcvReset.notify_all();
     }
 }
 
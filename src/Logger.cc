@@ -0,0 +1,233 @@
+/**
+* This file is part of ORB-SLAM2.
+*
+* Copyright (C) 2014-2016 Raúl Mur-Artal <raulmur at unizar dot es> (University of Zaragoza)
+* For more information see <https://github.com/raulmur/ORB_SLAM2>
+*
+* ORB-SLAM2 is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM2 is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with ORB-SLAM2. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "Logger.h"
+
+#include<iostream>
+#include<iomanip>
+#include<algorithm>
+#include<cstdlib>
+
+using namespace std;
+
+namespace ORB_SLAM2
+{
+
+static void ShutdownLogger()
+{
+    Logger::Instance().Shutdown();
+}
+
+static bool CompareRecordTime(const pair<double,size_t> &a, const pair<double,size_t> &b)
+{
+    return a.first < b.first;
+}
+
+Logger& Logger::Instance()
+{
+    // Never destroyed, threads may still log while static objects are destroyed
+    static Logger* pLogger = new Logger();
+    return *pLogger;
+}
+
+Logger::Logger(): mnLevel(LOG_DEBUG), mStart(chrono::steady_clock::now()), mbConsole(true), mbFinish(false)
+{
+    mptFlusher = new thread(&Logger::Run,this);
+    atexit(ShutdownLogger);
+}
+
+bool Logger::Open(const string &filename)
+{
+    unique_lock<mutex> lock(mMutexOutput);
+    if(mFile.is_open())
+        mFile.close();
+    mFile.open(filename.c_str(),ios::app);
+    return mFile.is_open();
+}
+
+void Logger::SetLevel(const eLevel level)
+{
+    mnLevel = level;
+}
+
+void Logger::SetConsole(const bool bConsole)
+{
+    unique_lock<mutex> lock(mMutexOutput);
+    mbConsole = bConsole;
+}
+
+Logger::ThreadBuffer* Logger::GetThreadBuffer()
+{
+    static thread_local ThreadBuffer* pBuffer = NULL;
+    if(!pBuffer)
+    {
+        // Owned by the logger, so that messages of finished threads are still written
+        shared_ptr<ThreadBuffer> pNewBuffer = make_shared<ThreadBuffer>();
+        unique_lock<mutex> lock(mMutexBuffers);
+        mvpBuffers.push_back(pNewBuffer);
+        pBuffer = pNewBuffer.get();
+    }
+    return pBuffer;
+}
+
+void Logger::Push(const eLevel level, string &msg)
+{
+    ThreadBuffer* pBuffer = GetThreadBuffer();
+
+    const size_t head = pBuffer->mnHead.load(memory_order_relaxed);
+    const size_t tail = pBuffer->mnTail.load(memory_order_acquire);
+    if(head-tail>=ThreadBuffer::SIZE)
+    {
+        pBuffer->mnDropped.fetch_add(1,memory_order_relaxed);
+        return;
+    }
+
+    Record &record = pBuffer->mvRecords[head%ThreadBuffer::SIZE];
+    record.mTime = chrono::duration<double>(chrono::steady_clock::now()-mStart).count();
+    record.mLevel = level;
+    record.mMsg.swap(msg);
+    pBuffer->mnHead.store(head+1,memory_order_release);
+
+    if(level>=LOG_WARNING || head+1-tail>=ThreadBuffer::SIZE/2)
+        mcvFlush.notify_one();
+}
+
+void Logger::Flush()
+{
+    unique_lock<mutex> lock(mMutexOutput);
+    Drain();
+}
+
+void Logger::Shutdown()
+{
+    {
+        unique_lock<mutex> lock(mMutexFinish);
+        mbFinish = true;
+    }
+    mcvFlush.notify_one();
+
+    if(mptFlusher)
+    {
+        mptFlusher->join();
+        delete mptFlusher;
+        mptFlusher = NULL;
+    }
+
+    Flush();
+}
+
+void Logger::Run()
+{
+    unique_lock<mutex> lock(mMutexFinish);
+    while(!mbFinish)
+    {
+        mcvFlush.wait_for(lock,chrono::milliseconds(20));
+
+        lock.unlock();
+        {
+            unique_lock<mutex> lockOutput(mMutexOutput);
+            Drain();
+        }
+        lock.lock();
+    }
+}
+
+void Logger::Drain()
+{
+    vector<shared_ptr<ThreadBuffer> > vpBuffers;
+    {
+        unique_lock<mutex> lock(mMutexBuffers);
+        vpBuffers = mvpBuffers;
+    }
+
+    mvBatch.clear();
+    size_t nDropped = 0;
+    for(size_t i=0; i<vpBuffers.size(); i++)
+    {
+        ThreadBuffer* pBuffer = vpBuffers[i].get();
+        size_t tail = pBuffer->mnTail.load(memory_order_relaxed);
+        const size_t head = pBuffer->mnHead.load(memory_order_acquire);
+        for(; tail<head; tail++)
+        {
+            Record &record = pBuffer->mvRecords[tail%ThreadBuffer::SIZE];
+            mvBatch.push_back(Record());
+            mvBatch.back().mTime = record.mTime;
+            mvBatch.back().mLevel = record.mLevel;
+            mvBatch.back().mMsg.swap(record.mMsg);
+        }
+        pBuffer->mnTail.store(tail,memory_order_release);
+        nDropped += pBuffer->mnDropped.exchange(0,memory_order_relaxed);
+    }
+
+    if(mvBatch.empty() && nDropped==0)
+        return;
+
+    // Messages of different threads are written in time order
+    vector<pair<double,size_t> > vOrder(mvBatch.size());
+    for(size_t i=0; i<mvBatch.size(); i++)
+        vOrder[i] = make_pair(mvBatch[i].mTime,i);
+    stable_sort(vOrder.begin(),vOrder.end(),CompareRecordTime);
+
+    static const char* levelNames[] = {"DEBUG", "INFO", "WARN", "ERROR"};
+
+    for(size_t i=0; i<vOrder.size(); i++)
+    {
+        const Record &record = mvBatch[vOrder[i].second];
+
+        if(mFile.is_open())
+            mFile << "[" << fixed << setprecision(3) << setw(10) << record.mTime << "] "
+                  << setw(5) << left << levelNames[record.mLevel] << right << " " << record.mMsg << "\n";
+
+        if(mbConsole)
+        {
+            if(record.mLevel>=LOG_WARNING)
+                cerr << record.mMsg << "\n";
+            else
+                cout << record.mMsg << "\n";
+        }
+    }
+
+    if(nDropped>0)
+    {
+        if(mFile.is_open())
+            mFile << "[" << fixed << setprecision(3) << setw(10)
+                  << chrono::duration<double>(chrono::steady_clock::now()-mStart).count() << "] "
+                  << setw(5) << left << levelNames[LOG_WARNING] << right << " "
+                  << nDropped << " log messages dropped" << "\n";
+        if(mbConsole)
+            cerr << nDropped << " log messages dropped" << "\n";
+    }
+
+    if(mFile.is_open())
+        mFile.flush();
+    if(mbConsole)
+    {
+        cout.flush();
+        cerr.flush();
+    }
+}
+
+LogMessage::~LogMessage()
+{
+    string msg = mStream.str();
+    Logger::Instance().Push(mLevel,msg);
+}
+
+} //namespace ORB_SLAM
@@ -28,7 +28,10 @@
 
 #include "ORBmatcher.h"
 
+#include "Logger.h"
+
 #include<mutex>
+#include<algorithm>
 #include<thread>
 
 
@@ -81,7 +84,11 @@ void LoopClosing::Run()
         if(CheckFinish())
             break;
 
-        usleep(5000);
+        {
+            unique_lock<mutex> lock(mMutexReset);
+            if(!mbResetRequested)
+                mcvReset.wait_for(lock,chrono::milliseconds(5));
+        }
     }
 
     SetFinish();
@@ -89,9 +96,12 @@ void LoopClosing::Run()
 
 void LoopClosing::InsertKeyFrame(KeyFrame *pKF)
 {
-    unique_lock<mutex> lock(mMutexLoopQueue);
-    if(pKF->mnId!=0)
-        mlpLoopKeyFrameQueue.push_back(pKF);
+    {
+        unique_lock<mutex> lock(mMutexLoopQueue);
+        if(!pKF->IsOrigin())
+            mlpLoopKeyFrameQueue.push_back(pKF);
+    }
+    mcvReset.notify_all();
 }
 
 bool LoopClosing::CheckNewKeyFrames()
@@ -100,6 +110,29 @@ bool LoopClosing::CheckNewKeyFrames()
     return(!mlpLoopKeyFrameQueue.empty());
 }
 
+bool LoopClosing::ShareKeyFrame(const vector<long unsigned int> &vGroup1, const vector<long unsigned int> &vGroup2)
+{
+    if(vGroup1.empty() || vGroup2.empty())
+        return false;
+    if(vGroup1.back()<vGroup2.front() || vGroup2.back()<vGroup1.front())
+        return false;
+
+    // Merge both sorted lists, jumping ahead with a binary search when one list is much shorter
+    vector<long unsigned int>::const_iterator it1 = vGroup1.begin(), end1 = vGroup1.end();
+    vector<long unsigned int>::const_iterator it2 = vGroup2.begin(), end2 = vGroup2.end();
+    const bool bGallop = vGroup1.size()*8<vGroup2.size() || vGroup2.size()*8<vGroup1.size();
+    while(it1!=end1 && it2!=end2)
+    {
+        if(*it1==*it2)
+            return true;
+        if(*it1<*it2)
+            it1 = bGallop ? lower_bound(it1,end1,*it2) : it1+1;
+        else
+            it2 = bGallop ? lower_bound(it2,end2,*it1) : it2+1;
+    }
+    return false;
+}
+
 bool LoopClosing::DetectLoop()
 {
     {
@@ -156,39 +189,31 @@ bool LoopClosing::DetectLoop()
     mvpEnoughConsistentCandidates.clear();
 
     vector<ConsistentGroup> vCurrentConsistentGroups;
+    vCurrentConsistentGroups.reserve(vpCandidateKFs.size());
     vector<bool> vbConsistentGroup(mvConsistentGroups.size(),false);
     for(size_t i=0, iend=vpCandidateKFs.size(); i<iend; i++)
     {
         KeyFrame* pCandidateKF = vpCandidateKFs[i];
 
-        set<KeyFrame*> spCandidateGroup = pCandidateKF->GetConnectedKeyFrames();
-        spCandidateGroup.insert(pCandidateKF);
+        vector<long unsigned int> vCandidateGroup = pCandidateKF->GetConnectedKeyFrameIds();
+        vCandidateGroup.insert(lower_bound(vCandidateGroup.begin(),vCandidateGroup.end(),pCandidateKF->mnId),pCandidateKF->mnId);
 
         bool bEnoughConsistent = false;
         bool bConsistentForSomeGroup = false;
         for(size_t iG=0, iendG=mvConsistentGroups.size(); iG<iendG; iG++)
         {
-            set<KeyFrame*> sPreviousGroup = mvConsistentGroups[iG].first;
+            const vector<long unsigned int> &vPreviousGroup = mvConsistentGroups[iG].first;
 
-            bool bConsistent = false;
-            for(set<KeyFrame*>::iterator sit=spCandidateGroup.begin(), send=spCandidateGroup.end(); sit!=send;sit++)
-            {
-                if(sPreviousGroup.count(*sit))
-                {
-                    bConsistent=true;
-                    bConsistentForSomeGroup=true;
-                    break;
-                }
-            }
+            const bool bConsistent = ShareKeyFrame(vCandidateGroup,vPreviousGroup);
 
             if(bConsistent)
             {
+                bConsistentForSomeGroup=true;
                 int nPreviousConsistency = mvConsistentGroups[iG].second;
                 int nCurrentConsistency = nPreviousConsistency + 1;
                 if(!vbConsistentGroup[iG])
                 {
-                    ConsistentGroup cg = make_pair(spCandidateGroup,nCurrentConsistency);
-                    vCurrentConsistentGroups.push_back(cg);
+                    vCurrentConsistentGroups.push_back(make_pair(vCandidateGroup,nCurrentConsistency));
                     vbConsistentGroup[iG]=true; //this avoid to include the same group more than once
                 }
                 if(nCurrentConsistency>=mnCovisibilityConsistencyTh && !bEnoughConsistent)
@@ -201,14 +226,11 @@ bool LoopClosing::DetectLoop()
 
         // If the group is not consistent with any previous group insert with consistency counter set to zero
         if(!bConsistentForSomeGroup)
-        {
-            ConsistentGroup cg = make_pair(spCandidateGroup,0);
-            vCurrentConsistentGroups.push_back(cg);
-        }
+            vCurrentConsistentGroups.push_back(make_pair(vCandidateGroup,0));
     }
 
     // Update Covisibility Consistent Groups
-    mvConsistentGroups = vCurrentConsistentGroups;
+    mvConsistentGroups.swap(vCurrentConsistentGroups);
 
 
     // Add Current Keyframe to database
@@ -401,7 +423,7 @@ bool LoopClosing::ComputeSim3()
 
 void LoopClosing::CorrectLoop()
 {
-    cout << "Loop detected!" << endl;
+    ORB_LOG(INFO) << "Loop detected!";
 
     // Send a stop signal to Local Mapping
     // Avoid new keyframes are inserted while correcting the loop
@@ -409,18 +431,7 @@ void LoopClosing::CorrectLoop()
 
     // If a Global Bundle Adjustment is running, abort it
     if(isRunningGBA())
-    {
-        unique_lock<mutex> lock(mMutexGBA);
-        mbStopGBA = true;
-
-        mnFullBAIdx++;
-
-        if(mpThreadGBA)
-        {
-            mpThreadGBA->detach();
-            delete mpThreadGBA;
-        }
-    }
+        StopGlobalBundleAdjustment();
 
     // Wait until Local Mapping has effectively stopped
     while(!mpLocalMapper->isStopped())
@@ -541,6 +552,9 @@ void LoopClosing::CorrectLoop()
     // Fuse duplications.
     SearchAndFuse(CorrectedSim3);
 
+    // If the loop closes with a previous map, join both spanning trees before the essential graph
+    // is built, so that the optimization pulls this map into the frame of the older one
+    MergeMaps();
 
     // After the MapPoint fusion, new links in the covisibility graph will appear attaching both sides of the loop
     map<KeyFrame*, set<KeyFrame*> > LoopConnections;
@@ -613,22 +627,49 @@ void LoopClosing::SearchAndFuse(const KeyFrameAndPose &CorrectedPosesMap)
 }
 
 
-void LoopClosing::RequestReset()
+void LoopClosing::MergeMaps()
 {
-    {
-        unique_lock<mutex> lock(mMutexReset);
-        mbResetRequested = true;
-    }
+    // Path from the current keyframe to the root of its spanning tree
+    vector<KeyFrame*> vpPath;
+    for(KeyFrame* pKF=mpCurrentKF; pKF; pKF=pKF->GetParent())
+        vpPath.push_back(pKF);
 
-    while(1)
+    KeyFrame* pMatchedRoot = mpMatchedKF;
+    while(pMatchedRoot->GetParent())
+        pMatchedRoot = pMatchedRoot->GetParent();
+
+    KeyFrame* pOrigin = vpPath.back();
+    if(pOrigin==pMatchedRoot || vpPath.size()<2)
+        return;
+
+    ORB_LOG(INFO) << "Loop closes with a previous map, merging maps";
+
+    unique_lock<mutex> lock(mpMap->mMutexMapUpdate);
+
+    // Reverse the path so that the current keyframe becomes the root, then hang it from the matched keyframe
+    KeyFrame* pNewParent = mpMatchedKF;
+    for(size_t i=0; i<vpPath.size(); i++)
     {
-        {
-        unique_lock<mutex> lock2(mMutexReset);
-        if(!mbResetRequested)
-            break;
-        }
-        usleep(5000);
+        if(i+1<vpPath.size())
+            vpPath[i+1]->EraseChild(vpPath[i]);
+        vpPath[i]->ChangeParent(pNewParent);
+        pNewParent = vpPath[i];
     }
+
+    pOrigin->SetOrigin(false);
+
+    vector<KeyFrame*> &vpOrigins = mpMap->mvpKeyFrameOrigins;
+    vpOrigins.erase(remove(vpOrigins.begin(),vpOrigins.end(),pOrigin),vpOrigins.end());
+}
+
+void LoopClosing::RequestReset()
+{
+    unique_lock<mutex> lock(mMutexReset);
+    mbResetRequested = true;
+    mcvReset.notify_all();
+
+    while(mbResetRequested)
+        mcvReset.wait(lock);
 }
 
 void LoopClosing::ResetIfRequested()
@@ -638,13 +679,46 @@ void LoopClosing::ResetIfRequested()
     {
         mlpLoopKeyFrameQueue.clear();
         mLastLoopKFid=0;
+
+        // Abort a running Global BA, its result would be discarded
+        if(isRunningGBA())
+        {
+            StopGlobalBundleAdjustment();
+
+            unique_lock<mutex> lock2(mMutexGBA);
+            mbRunningGBA = false;
+            mbFinishedGBA = true;
+        }
+
         mbResetRequested=false;
+        mcvReset.notify_all();
+    }
+}
+
+void LoopClosing::StopGlobalBundleAdjustment()
+{
+    thread* pThreadGBA;
+    {
+        unique_lock<mutex> lock(mMutexGBA);
+        mbStopGBA = true;
+        mnFullBAIdx++;
+        pThreadGBA = mpThreadGBA;
+        mpThreadGBA = NULL;
+    }
+
+    // A stopped BA still writes its estimates to every keyframe and point, so the thread is
+    // joined before the map can be changed or cleared. It takes mMutexGBA to see that its
+    // result is outdated, which is why the lock is released first.
+    if(pThreadGBA)
+    {
+        pThreadGBA->join();
+        delete pThreadGBA;
     }
 }
 
 void LoopClosing::RunGlobalBundleAdjustment(unsigned long nLoopKF)
 {
-    cout << "Starting Global Bundle Adjustment" << endl;
+    ORB_LOG(INFO) << "Starting Global Bundle Adjustment";
 
     int idx =  mnFullBAIdx;
     Optimizer::GlobalBundleAdjustemnt(mpMap,10,&mbStopGBA,nLoopKF,false);
@@ -660,8 +734,8 @@ void LoopClosing::RunGlobalBundleAdjustment(unsigned long nLoopKF)
 
         if(!mbStopGBA)
         {
-            cout << "Global Bundle Adjustment finished" << endl;
-            cout << "Updating map ..." << endl;
+            ORB_LOG(INFO) << "Global Bundle Adjustment finished";
+            ORB_LOG(INFO) << "Updating map ...";
             mpLocalMapper->RequestStop();
             // Wait until Local Mapping has effectively stopped
 
@@ -740,7 +814,7 @@ void LoopClosing::RunGlobalBundleAdjustment(unsigned long nLoopKF)
 
             mpLocalMapper->Release();
 
-            cout << "Map updated!" << endl;
+            ORB_LOG(INFO) << "Map updated!";
         }
 
         mbFinishedGBA = true;
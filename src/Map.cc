@@ -29,10 +29,19 @@ Map::Map():mnMaxKFid(0),mnBigChangeIdx(0)
 {
 }
 
+Map::~Map()
+{
+    clear();
+    mRelease.wait();
+}
+
+// The first keyframes are added by both the tracking and the local mapping, but erased
+// entities are never added again, so each one is owned once.
 void Map::AddKeyFrame(KeyFrame *pKF)
 {
     unique_lock<mutex> lock(mMutexMap);
-    mspKeyFrames.insert(pKF);
+    if(mspKeyFrames.insert(pKF).second)
+        mvpOwnedKeyFrames.push_back(pKF);
     if(pKF->mnId>mnMaxKFid)
         mnMaxKFid=pKF->mnId;
 }
@@ -40,7 +49,8 @@ void Map::AddKeyFrame(KeyFrame *pKF)
 void Map::AddMapPoint(MapPoint *pMP)
 {
     unique_lock<mutex> lock(mMutexMap);
-    mspMapPoints.insert(pMP);
+    if(mspMapPoints.insert(pMP).second)
+        mvpOwnedMapPoints.push_back(pMP);
 }
 
 void Map::EraseMapPoint(MapPoint *pMP)
@@ -48,8 +58,7 @@ void Map::EraseMapPoint(MapPoint *pMP)
     unique_lock<mutex> lock(mMutexMap);
     mspMapPoints.erase(pMP);
 
-    // TODO: This only erase the pointer.
-    // Delete the MapPoint
+    // The MapPoint is deleted when the map is cleared
 }
 
 void Map::EraseKeyFrame(KeyFrame *pKF)
@@ -57,8 +66,7 @@ void Map::EraseKeyFrame(KeyFrame *pKF)
     unique_lock<mutex> lock(mMutexMap);
     mspKeyFrames.erase(pKF);
 
-    // TODO: This only erase the pointer.
-    // Delete the MapPoint
+    // The KeyFrame is deleted when the map is cleared
 }
 
 void Map::SetReferenceMapPoints(const vector<MapPoint *> &vpMPs)
@@ -115,19 +123,41 @@ long unsigned int Map::GetMaxKFid()
     return mnMaxKFid;
 }
 
+static void ReleaseEntities(vector<MapPoint*>* pvpMPs, vector<KeyFrame*>* pvpKFs)
+{
+    for(size_t i=0; i<pvpMPs->size(); i++)
+        delete (*pvpMPs)[i];
+
+    for(size_t i=0; i<pvpKFs->size(); i++)
+        delete (*pvpKFs)[i];
+
+    delete pvpMPs;
+    delete pvpKFs;
+}
+
 void Map::clear()
 {
-    for(set<MapPoint*>::iterator sit=mspMapPoints.begin(), send=mspMapPoints.end(); sit!=send; sit++)
-        delete *sit;
+    vector<MapPoint*>* pvpMPs = new vector<MapPoint*>();
+    vector<KeyFrame*>* pvpKFs = new vector<KeyFrame*>();
+
+    {
+        unique_lock<mutex> lock(mMutexMap);
+        pvpMPs->swap(mvpOwnedMapPoints);
+        pvpKFs->swap(mvpOwnedKeyFrames);
+        mspMapPoints.clear();
+        mspKeyFrames.clear();
+    }
 
-    for(set<KeyFrame*>::iterator sit=mspKeyFrames.begin(), send=mspKeyFrames.end(); sit!=send; sit++)
-        delete *sit;
+    // Destroying the entities of a large map takes seconds, it does not hold up the reset.
+    // A previous release is waited for, so at most one runs at a time.
+    if(mRelease.valid())
+        mRelease.wait();
+    mRelease = async(launch::async,&ReleaseEntities,pvpMPs,pvpKFs);
 
-    mspMapPoints.clear();
-    mspKeyFrames.clear();
     mnMaxKFid = 0;
     mvpReferenceMapPoints.clear();
     mvpKeyFrameOrigins.clear();
+    mEssentialGraph.clear();
 }
 
 } //namespace ORB_SLAM
@@ -70,6 +70,34 @@ MapPoint::MapPoint(const cv::Mat &Pos, Map* pMap, Frame* pFrame, const int &idxF
     mnId=nNextId++;
 }
 
+void MapPoint::ResetFromFrame(const cv::Mat &Pos, Frame* pFrame, const int &idxF)
+{
+    mnFirstFrame = pFrame->mnId;
+    mbTrackInView = false;
+    mnTrackReferenceForFrame = 0;
+    mnLastFrameSeen = 0;
+
+    {
+        unique_lock<mutex> lock(mMutexFeatures);
+        mnVisible.store(1,memory_order_relaxed);
+        mnFound.store(1,memory_order_relaxed);
+        pFrame->mDescriptors.row(idxF).copyTo(mDescriptor);
+    }
+
+    unique_lock<mutex> lock(mMutexPos);
+    // Buffers are reused, the point keeps its id
+    Pos.copyTo(mWorldPos);
+    cv::subtract(mWorldPos,pFrame->GetCameraCenter(),mNormalVector);
+    const float dist = cv::norm(mNormalVector);
+    mNormalVector /= dist;
+
+    const int level = pFrame->mvKeysUn[idxF].octave;
+    const int nLevels = pFrame->mnScaleLevels;
+
+    mfMaxDistance = dist*pFrame->mvScaleFactors[level];
+    mfMinDistance = mfMaxDistance/pFrame->mvScaleFactors[nLevels-1];
+}
+
 void MapPoint::SetWorldPos(const cv::Mat &Pos)
 {
     unique_lock<mutex> lock2(mGlobalMutex);
@@ -103,9 +131,9 @@ void MapPoint::AddObservation(KeyFrame* pKF, size_t idx)
     mObservations[pKF]=idx;
 
     if(pKF->mvuRight[idx]>=0)
-        nObs+=2;
+        nObs.fetch_add(2,memory_order_relaxed);
     else
-        nObs++;
+        nObs.fetch_add(1,memory_order_relaxed);
 }
 
 void MapPoint::EraseObservation(KeyFrame* pKF)
@@ -117,9 +145,9 @@ void MapPoint::EraseObservation(KeyFrame* pKF)
         {
             int idx = mObservations[pKF];
             if(pKF->mvuRight[idx]>=0)
-                nObs-=2;
+                nObs.fetch_sub(2,memory_order_relaxed);
             else
-                nObs--;
+                nObs.fetch_sub(1,memory_order_relaxed);
 
             mObservations.erase(pKF);
 
@@ -127,7 +155,7 @@ void MapPoint::EraseObservation(KeyFrame* pKF)
                 mpRefKF=mObservations.begin()->first;
 
             // If only 2 observations or less, discard point
-            if(nObs<=2)
+            if(nObs.load(memory_order_relaxed)<=2)
                 bBad=true;
         }
     }
@@ -144,8 +172,7 @@ map<KeyFrame*, size_t> MapPoint::GetObservations()
 
 int MapPoint::Observations()
 {
-    unique_lock<mutex> lock(mMutexFeatures);
-    return nObs;
+    return nObs.load(memory_order_relaxed);
 }
 
 void MapPoint::SetBadFlag()
@@ -154,7 +181,7 @@ void MapPoint::SetBadFlag()
     {
         unique_lock<mutex> lock1(mMutexFeatures);
         unique_lock<mutex> lock2(mMutexPos);
-        mbBad=true;
+        mbBad.store(true,memory_order_release);
         obs = mObservations;
         mObservations.clear();
     }
@@ -186,9 +213,9 @@ void MapPoint::Replace(MapPoint* pMP)
         unique_lock<mutex> lock2(mMutexPos);
         obs=mObservations;
         mObservations.clear();
-        mbBad=true;
-        nvisible = mnVisible;
-        nfound = mnFound;
+        mbBad.store(true,memory_order_release);
+        nvisible = mnVisible.load(memory_order_relaxed);
+        nfound = mnFound.load(memory_order_relaxed);
         mpReplaced = pMP;
     }
 
@@ -216,27 +243,22 @@ void MapPoint::Replace(MapPoint* pMP)
 
 bool MapPoint::isBad()
 {
-    unique_lock<mutex> lock(mMutexFeatures);
-    unique_lock<mutex> lock2(mMutexPos);
-    return mbBad;
+    return mbBad.load(memory_order_acquire);
 }
 
 void MapPoint::IncreaseVisible(int n)
 {
-    unique_lock<mutex> lock(mMutexFeatures);
-    mnVisible+=n;
+    mnVisible.fetch_add(n,memory_order_relaxed);
 }
 
 void MapPoint::IncreaseFound(int n)
 {
-    unique_lock<mutex> lock(mMutexFeatures);
-    mnFound+=n;
+    mnFound.fetch_add(n,memory_order_relaxed);
 }
 
 float MapPoint::GetFoundRatio()
 {
-    unique_lock<mutex> lock(mMutexFeatures);
-    return static_cast<float>(mnFound)/mnVisible;
+    return static_cast<float>(mnFound.load(memory_order_relaxed))/mnVisible.load(memory_order_relaxed);
 }
 
 void MapPoint::ComputeDistinctiveDescriptors()
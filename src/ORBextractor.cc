@@ -61,6 +61,7 @@
 #include <vector>
 
 #include "ORBextractor.h"
+#include "Logger.h"
 
 
 using namespace cv;
@@ -410,7 +411,7 @@ static int bit_pattern_31_[256*4] =
 ORBextractor::ORBextractor(int _nfeatures, float _scaleFactor, int _nlevels,
          int _iniThFAST, int _minThFAST):
     nfeatures(_nfeatures), scaleFactor(_scaleFactor), nlevels(_nlevels),
-    iniThFAST(_iniThFAST), minThFAST(_minThFAST)
+    iniThFAST(_iniThFAST), minThFAST(_minThFAST), mbFrameMaskWarned(false)
 {
     mvScaleFactor.resize(nlevels);
     mvLevelSigma2.resize(nlevels);
@@ -478,6 +479,35 @@ static void computeOrientation(const Mat& image, vector<KeyPoint>& keypoints, co
     }
 }
 
+// Bounding box of the non zero pixels of a mask, empty if all pixels are zero
+static Rect maskBoundingBox(const Mat& mask)
+{
+    int minX = mask.cols, maxX = -1, minY = mask.rows, maxY = -1;
+    for(int v=0; v<mask.rows; v++)
+    {
+        const uchar* row = mask.ptr<uchar>(v);
+        int u0 = 0;
+        while(u0<mask.cols && !row[u0])
+            u0++;
+        if(u0==mask.cols)
+            continue;
+        int u1 = mask.cols-1;
+        while(!row[u1])
+            u1--;
+
+        minX = min(minX,u0);
+        maxX = max(maxX,u1);
+        if(minY>v)
+            minY = v;
+        maxY = v;
+    }
+
+    if(maxX<0)
+        return Rect();
+
+    return Rect(minX,minY,maxX-minX+1,maxY-minY+1);
+}
+
 void ExtractorNode::DivideNode(ExtractorNode &n1, ExtractorNode &n2, ExtractorNode &n3, ExtractorNode &n4)
 {
     const int halfX = ceil(static_cast<float>(UR.x-UL.x)/2);
@@ -540,7 +570,7 @@ vector<cv::KeyPoint> ORBextractor::DistributeOctTree(const vector<cv::KeyPoint>&
                                        const int &maxX, const int &minY, const int &maxY, const int &N, const int &level)
 {
     // Compute how many initial nodes   
-    const int nIni = round(static_cast<float>(maxX-minX)/(maxY-minY));
+    const int nIni = max(1,(int)round(static_cast<float>(maxX-minX)/(maxY-minY)));
 
     const float hX = static_cast<float>(maxX-minX)/nIni;
 
@@ -762,7 +792,7 @@ vector<cv::KeyPoint> ORBextractor::DistributeOctTree(const vector<cv::KeyPoint>&
     return vResultKeys;
 }
 
-void ORBextractor::ComputeKeyPointsOctTree(vector<vector<KeyPoint> >& allKeypoints)
+void ORBextractor::ComputeKeyPointsOctTree(vector<vector<KeyPoint> >& allKeypoints, const bool bOrientation)
 {
     allKeypoints.resize(nlevels);
 
@@ -770,10 +800,25 @@ void ORBextractor::ComputeKeyPointsOctTree(vector<vector<KeyPoint> >& allKeypoin
 
     for (int level = 0; level < nlevels; ++level)
     {
-        const int minBorderX = EDGE_THRESHOLD-3;
-        const int minBorderY = minBorderX;
-        const int maxBorderX = mvImagePyramid[level].cols-EDGE_THRESHOLD+3;
-        const int maxBorderY = mvImagePyramid[level].rows-EDGE_THRESHOLD+3;
+        int minBorderX = EDGE_THRESHOLD-3;
+        int minBorderY = minBorderX;
+        int maxBorderX = mvImagePyramid[level].cols-EDGE_THRESHOLD+3;
+        int maxBorderY = mvImagePyramid[level].rows-EDGE_THRESHOLD+3;
+
+        const cv::Mat mask = mvMaskPyramid.empty() ? cv::Mat() : mvMaskPyramid[level];
+        if(!mask.empty())
+        {
+            // Cells and octree nodes only cover the unmasked area, so the features of the
+            // level are distributed there
+            const cv::Rect roi = maskBoundingBox(mask);
+            minBorderX = max(minBorderX,roi.x-3);
+            minBorderY = max(minBorderY,roi.y-3);
+            maxBorderX = min(maxBorderX,roi.x+roi.width+3);
+            maxBorderY = min(maxBorderY,roi.y+roi.height+3);
+
+            if(maxBorderX-minBorderX<=6 || maxBorderY-minBorderY<=6)
+                continue;
+        }
 
         vector<cv::KeyPoint> vToDistributeKeys;
         vToDistributeKeys.reserve(nfeatures*10);
@@ -781,8 +826,8 @@ void ORBextractor::ComputeKeyPointsOctTree(vector<vector<KeyPoint> >& allKeypoin
         const float width = (maxBorderX-minBorderX);
         const float height = (maxBorderY-minBorderY);
 
-        const int nCols = width/W;
-        const int nRows = height/W;
+        const int nCols = max(1,(int)(width/W));
+        const int nRows = max(1,(int)(height/W));
         const int wCell = ceil(width/nCols);
         const int hCell = ceil(height/nRows);
 
@@ -805,6 +850,10 @@ void ORBextractor::ComputeKeyPointsOctTree(vector<vector<KeyPoint> >& allKeypoin
                 if(maxX>maxBorderX)
                     maxX = maxBorderX;
 
+                // Skip cells that are completely masked
+                if(!mask.empty() && countNonZero(mask.rowRange(iniY,maxY).colRange(iniX,maxX))==0)
+                    continue;
+
                 vector<cv::KeyPoint> vKeysCell;
                 FAST(mvImagePyramid[level].rowRange(iniY,maxY).colRange(iniX,maxX),
                      vKeysCell,iniThFAST,true);
@@ -819,6 +868,8 @@ void ORBextractor::ComputeKeyPointsOctTree(vector<vector<KeyPoint> >& allKeypoin
                 {
                     for(vector<cv::KeyPoint>::iterator vit=vKeysCell.begin(); vit!=vKeysCell.end();vit++)
                     {
+                        if(!mask.empty() && !mask.at<uchar>(cvRound(iniY+(*vit).pt.y),cvRound(iniX+(*vit).pt.x)))
+                            continue;
                         (*vit).pt.x+=j*wCell;
                         (*vit).pt.y+=i*hCell;
                         vToDistributeKeys.push_back(*vit);
@@ -847,6 +898,9 @@ void ORBextractor::ComputeKeyPointsOctTree(vector<vector<KeyPoint> >& allKeypoin
         }
     }
 
+    if(!bOrientation)
+        return;
+
     // compute orientations
     for (int level = 0; level < nlevels; ++level)
         computeOrientation(mvImagePyramid[level], allKeypoints[level], umax);
@@ -1051,6 +1105,7 @@ void ORBextractor::operator()( InputArray _image, InputArray _mask, vector<KeyPo
 
     // Pre-compute the scale pyramid
     ComputePyramid(image);
+    ComputeMaskPyramid(_mask.getMat());
 
     vector < vector<KeyPoint> > allKeypoints;
     ComputeKeyPointsOctTree(allKeypoints);
@@ -1104,6 +1159,70 @@ void ORBextractor::operator()( InputArray _image, InputArray _mask, vector<KeyPo
     }
 }
 
+void ORBextractor::DetectKeyPoints(InputArray _image, InputArray _mask, vector<KeyPoint>& _keypoints)
+{
+    _keypoints.clear();
+
+    if(_image.empty())
+        return;
+
+    Mat image = _image.getMat();
+    assert(image.type() == CV_8UC1 );
+
+    ComputePyramid(image);
+    ComputeMaskPyramid(_mask.getMat());
+
+    vector < vector<KeyPoint> > allKeypoints;
+    ComputeKeyPointsOctTree(allKeypoints,false);
+
+    int nkeypoints = 0;
+    for (int level = 0; level < nlevels; ++level)
+        nkeypoints += (int)allKeypoints[level].size();
+    _keypoints.reserve(nkeypoints);
+
+    for (int level = 0; level < nlevels; ++level)
+    {
+        vector<KeyPoint>& keypoints = allKeypoints[level];
+        if (level != 0)
+        {
+            float scale = mvScaleFactor[level];
+            for (vector<KeyPoint>::iterator keypoint = keypoints.begin(),
+                 keypointEnd = keypoints.end(); keypoint != keypointEnd; ++keypoint)
+                keypoint->pt *= scale;
+        }
+        _keypoints.insert(_keypoints.end(), keypoints.begin(), keypoints.end());
+    }
+}
+
+void ORBextractor::ComputeDescriptors(vector<KeyPoint>& keypoints, const vector<bool> &vbCompute, Mat &descriptors)
+{
+    descriptors = Mat::zeros((int)keypoints.size(), 32, CV_8UC1);
+
+    // Levels are only blurred if some of their keypoints is needed
+    vector<Mat> vBlurredPyramid(nlevels);
+
+    for (size_t i = 0; i < keypoints.size(); i++)
+    {
+        if(!vbCompute[i])
+            continue;
+
+        const int level = keypoints[i].octave;
+        if(vBlurredPyramid[level].empty())
+        {
+            vBlurredPyramid[level] = mvImagePyramid[level].clone();
+            GaussianBlur(vBlurredPyramid[level], vBlurredPyramid[level], Size(7, 7), 2, 2, BORDER_REFLECT_101);
+        }
+
+        // Keypoint in the coordinates of its level
+        KeyPoint kp = keypoints[i];
+        kp.pt *= mvInvScaleFactor[level];
+        kp.angle = IC_Angle(mvImagePyramid[level], kp.pt, umax);
+        keypoints[i].angle = kp.angle;
+
+        computeOrbDescriptor(kp, vBlurredPyramid[level], &pattern[0], descriptors.ptr((int)i));
+    }
+}
+
 void ORBextractor::ComputePyramid(cv::Mat image)
 {
     for (int level = 0; level < nlevels; ++level)
@@ -1131,4 +1250,60 @@ void ORBextractor::ComputePyramid(cv::Mat image)
 
 }
 
+bool ORBextractor::SetMask(const cv::Mat &mask, const cv::Size &imageSize)
+{
+    if(!mask.empty() && (mask.type()!=CV_8UC1 || (imageSize.area()>0 && mask.size()!=imageSize)))
+    {
+        ORB_LOG(ERROR) << "ORBextractor: rejecting mask of size " << mask.cols << "x" << mask.rows
+                       << " and type " << mask.type() << ", it must be CV_8UC1 and of the image size";
+        mMask = Mat();
+        return false;
+    }
+
+    mMask = mask.clone();
+    return true;
+}
+
+void ORBextractor::ComputeMaskPyramid(const cv::Mat &mask)
+{
+    mvMaskPyramid.clear();
+
+    // Masks that do not match the image would be read out of bounds. A static mask set without
+    // the image size is checked once against the first image and dropped if it does not fit.
+    if(!mMask.empty() && mMask.size()!=mvImagePyramid[0].size())
+    {
+        ORB_LOG(WARNING) << "ORBextractor: dropping mask of size " << mMask.cols << "x" << mMask.rows
+                         << ", the images are " << mvImagePyramid[0].cols << "x" << mvImagePyramid[0].rows;
+        mMask = Mat();
+    }
+
+    Mat frameMask = mask;
+    if(!frameMask.empty() && (frameMask.type()!=CV_8UC1 || frameMask.size()!=mvImagePyramid[0].size()))
+    {
+        if(!mbFrameMaskWarned)
+            ORB_LOG(WARNING) << "ORBextractor: ignoring frame masks of size " << frameMask.cols << "x" << frameMask.rows
+                             << " and type " << frameMask.type() << ", they must be CV_8UC1 and of the image size";
+        mbFrameMaskWarned = true;
+        frameMask = Mat();
+    }
+
+    const Mat &staticMask = mMask;
+
+    Mat fullMask;
+    if(!staticMask.empty() && !frameMask.empty())
+        bitwise_and(staticMask,frameMask,fullMask);
+    else if(!staticMask.empty())
+        fullMask = staticMask;
+    else
+        fullMask = frameMask;
+
+    if(fullMask.empty())
+        return;
+
+    mvMaskPyramid.resize(nlevels);
+    mvMaskPyramid[0] = fullMask;
+    for (int level = 1; level < nlevels; ++level)
+        resize(fullMask, mvMaskPyramid[level], mvImagePyramid[level].size(), 0, 0, INTER_NEAREST);
+}
+
 } //namespace ORB_SLAM
@@ -158,11 +158,22 @@ bool ORBmatcher::CheckDistEpipolarLine(const cv::KeyPoint &kp1,const cv::KeyPoin
 
 int ORBmatcher::SearchByBoW(KeyFrame* pKF,Frame &F, vector<MapPoint*> &vpMapPointMatches)
 {
-    const vector<MapPoint*> vpMapPointsKF = pKF->GetMapPointMatches();
+    F.ComputeFeatVec();
+
+    // Bad MapPoints are discarded once here instead of in the matching loop
+    vector<MapPoint*> vpMapPointsKF = pKF->GetMapPointMatches();
+    for(size_t i=0, iend=vpMapPointsKF.size(); i<iend; i++)
+        if(vpMapPointsKF[i] && vpMapPointsKF[i]->isBad())
+            vpMapPointsKF[i] = static_cast<MapPoint*>(NULL);
 
     vpMapPointMatches = vector<MapPoint*>(F.N,static_cast<MapPoint*>(NULL));
 
     const DBoW2::FeatureVector &vFeatVecKF = pKF->mFeatVec;
+    const DBoW2::FeatureVector &vFeatVecF = F.mFeatVec;
+
+    // Descriptors packed by node when the BoW was computed
+    const uint64_t* pDescriptorsKF = pKF->mBowDescriptors.ptr<uint64_t>();
+    const uint64_t* pDescriptorsF = F.mBowDescriptors.ptr<uint64_t>();
 
     int nmatches=0;
 
@@ -172,19 +183,27 @@ int ORBmatcher::SearchByBoW(KeyFrame* pKF,Frame &F, vector<MapPoint*> &vpMapPoin
     const float factor = 1.0f/HISTO_LENGTH;
 
     // We perform the matching over ORB that belong to the same vocabulary node (at a certain level)
-    DBoW2::FeatureVector::const_iterator KFit = vFeatVecKF.begin();
-    DBoW2::FeatureVector::const_iterator Fit = F.mFeatVec.begin();
-    DBoW2::FeatureVector::const_iterator KFend = vFeatVecKF.end();
-    DBoW2::FeatureVector::const_iterator Fend = F.mFeatVec.end();
+    // Both feature vectors are sorted by node id, so shared nodes are found with a linear merge
+    size_t KFit = 0;
+    size_t Fit = 0;
+    const size_t KFend = vFeatVecKF.size();
+    const size_t Fend = vFeatVecF.size();
 
     while(KFit != KFend && Fit != Fend)
     {
-        if(KFit->first == Fit->first)
-        {
-            const vector<unsigned int> vIndicesKF = KFit->second;
-            const vector<unsigned int> vIndicesF = Fit->second;
+        const DBoW2::NodeId KFnode = vFeatVecKF.nodeId(KFit);
+        const DBoW2::NodeId Fnode = vFeatVecF.nodeId(Fit);
 
-            for(size_t iKF=0; iKF<vIndicesKF.size(); iKF++)
+        if(KFnode == Fnode)
+        {
+            const unsigned int* vIndicesKF = vFeatVecKF.features(KFit);
+            const unsigned int nIndicesKF = vFeatVecKF.featureCount(KFit);
+            const unsigned int* vIndicesF = vFeatVecF.features(Fit);
+            const unsigned int nIndicesF = vFeatVecF.featureCount(Fit);
+            const uint64_t* pNodeKF = pDescriptorsKF+4*vFeatVecKF.featureOffset(KFit);
+            const uint64_t* pNodeF = pDescriptorsF+4*vFeatVecF.featureOffset(Fit);
+
+            for(size_t iKF=0; iKF<nIndicesKF; iKF++)
             {
                 const unsigned int realIdxKF = vIndicesKF[iKF];
 
@@ -193,25 +212,20 @@ int ORBmatcher::SearchByBoW(KeyFrame* pKF,Frame &F, vector<MapPoint*> &vpMapPoin
                 if(!pMP)
                     continue;
 
-                if(pMP->isBad())
-                    continue;                
-
-                const cv::Mat &dKF= pKF->mDescriptors.row(realIdxKF);
+                const uint64_t* dKF = pNodeKF+4*iKF;
 
                 int bestDist1=256;
                 int bestIdxF =-1 ;
                 int bestDist2=256;
 
-                for(size_t iF=0; iF<vIndicesF.size(); iF++)
+                for(size_t iF=0; iF<nIndicesF; iF++)
                 {
                     const unsigned int realIdxF = vIndicesF[iF];
 
                     if(vpMapPointMatches[realIdxF])
                         continue;
 
-                    const cv::Mat &dF = F.mDescriptors.row(realIdxF);
-
-                    const int dist =  DescriptorDistance(dKF,dF);
+                    const int dist =  DescriptorDistance(dKF,pNodeF+4*iF);
 
                     if(dist<bestDist1)
                     {
@@ -253,13 +267,13 @@ int ORBmatcher::SearchByBoW(KeyFrame* pKF,Frame &F, vector<MapPoint*> &vpMapPoin
             KFit++;
             Fit++;
         }
-        else if(KFit->first < Fit->first)
+        else if(KFnode < Fnode)
         {
-            KFit = vFeatVecKF.lower_bound(Fit->first);
+            KFit++;
         }
         else
         {
-            Fit = F.mFeatVec.lower_bound(KFit->first);
+            Fit++;
         }
     }
 
@@ -402,9 +416,17 @@ int ORBmatcher::SearchByProjection(KeyFrame* pKF, cv::Mat Scw, const vector<MapP
     return nmatches;
 }
 
-int ORBmatcher::SearchForInitialization(Frame &F1, Frame &F2, vector<cv::Point2f> &vbPrevMatched, vector<int> &vnMatches12, int windowSize)
+int ORBmatcher::SearchForInitialization(Frame &F1, Frame &F2, vector<cv::Point2f> &vbPrevMatched, vector<int> &vnMatches12, int windowSize, int windowSizeTracked)
 {
     int nmatches=0;
+
+    vector<bool> vbTracked(F1.mvKeysUn.size(),false);
+    if(windowSizeTracked>=0 && vnMatches12.size()==F1.mvKeysUn.size())
+    {
+        for(size_t i1=0, iend1=vnMatches12.size(); i1<iend1; i1++)
+            vbTracked[i1] = vnMatches12[i1]>=0;
+    }
+
     vnMatches12 = vector<int>(F1.mvKeysUn.size(),-1);
 
     vector<int> rotHist[HISTO_LENGTH];
@@ -422,7 +444,8 @@ int ORBmatcher::SearchForInitialization(Frame &F1, Frame &F2, vector<cv::Point2f
         if(level1>0)
             continue;
 
-        vector<size_t> vIndices2 = F2.GetFeaturesInArea(vbPrevMatched[i1].x,vbPrevMatched[i1].y, windowSize,level1,level1);
+        const int r = vbTracked[i1] ? windowSizeTracked : windowSize;
+        vector<size_t> vIndices2 = F2.GetFeaturesInArea(vbPrevMatched[i1].x,vbPrevMatched[i1].y, r,level1,level1);
 
         if(vIndices2.empty())
             continue;
@@ -523,13 +546,21 @@ int ORBmatcher::SearchByBoW(KeyFrame *pKF1, KeyFrame *pKF2, vector<MapPoint *> &
 {
     const vector<cv::KeyPoint> &vKeysUn1 = pKF1->mvKeysUn;
     const DBoW2::FeatureVector &vFeatVec1 = pKF1->mFeatVec;
-    const vector<MapPoint*> vpMapPoints1 = pKF1->GetMapPointMatches();
-    const cv::Mat &Descriptors1 = pKF1->mDescriptors;
+    vector<MapPoint*> vpMapPoints1 = pKF1->GetMapPointMatches();
+    const uint64_t* pDescriptors1 = pKF1->mBowDescriptors.ptr<uint64_t>();
 
     const vector<cv::KeyPoint> &vKeysUn2 = pKF2->mvKeysUn;
     const DBoW2::FeatureVector &vFeatVec2 = pKF2->mFeatVec;
-    const vector<MapPoint*> vpMapPoints2 = pKF2->GetMapPointMatches();
-    const cv::Mat &Descriptors2 = pKF2->mDescriptors;
+    vector<MapPoint*> vpMapPoints2 = pKF2->GetMapPointMatches();
+    const uint64_t* pDescriptors2 = pKF2->mBowDescriptors.ptr<uint64_t>();
+
+    // Bad MapPoints are discarded once here instead of in the matching loop
+    for(size_t i=0, iend=vpMapPoints1.size(); i<iend; i++)
+        if(vpMapPoints1[i] && vpMapPoints1[i]->isBad())
+            vpMapPoints1[i] = static_cast<MapPoint*>(NULL);
+    for(size_t i=0, iend=vpMapPoints2.size(); i<iend; i++)
+        if(vpMapPoints2[i] && vpMapPoints2[i]->isBad())
+            vpMapPoints2[i] = static_cast<MapPoint*>(NULL);
 
     vpMatches12 = vector<MapPoint*>(vpMapPoints1.size(),static_cast<MapPoint*>(NULL));
     vector<bool> vbMatched2(vpMapPoints2.size(),false);
@@ -542,46 +573,45 @@ int ORBmatcher::SearchByBoW(KeyFrame *pKF1, KeyFrame *pKF2, vector<MapPoint *> &
 
     int nmatches = 0;
 
-    DBoW2::FeatureVector::const_iterator f1it = vFeatVec1.begin();
-    DBoW2::FeatureVector::const_iterator f2it = vFeatVec2.begin();
-    DBoW2::FeatureVector::const_iterator f1end = vFeatVec1.end();
-    DBoW2::FeatureVector::const_iterator f2end = vFeatVec2.end();
+    size_t f1it = 0;
+    size_t f2it = 0;
+    const size_t f1end = vFeatVec1.size();
+    const size_t f2end = vFeatVec2.size();
 
     while(f1it != f1end && f2it != f2end)
     {
-        if(f1it->first == f2it->first)
+        const DBoW2::NodeId node1 = vFeatVec1.nodeId(f1it);
+        const DBoW2::NodeId node2 = vFeatVec2.nodeId(f2it);
+
+        if(node1 == node2)
         {
-            for(size_t i1=0, iend1=f1it->second.size(); i1<iend1; i1++)
+            const unsigned int* vIndices1 = vFeatVec1.features(f1it);
+            const unsigned int* vIndices2 = vFeatVec2.features(f2it);
+            const uint64_t* pNode1 = pDescriptors1+4*vFeatVec1.featureOffset(f1it);
+            const uint64_t* pNode2 = pDescriptors2+4*vFeatVec2.featureOffset(f2it);
+
+            for(size_t i1=0, iend1=vFeatVec1.featureCount(f1it); i1<iend1; i1++)
             {
-                const size_t idx1 = f1it->second[i1];
+                const size_t idx1 = vIndices1[i1];
 
                 MapPoint* pMP1 = vpMapPoints1[idx1];
                 if(!pMP1)
                     continue;
-                if(pMP1->isBad())
-                    continue;
 
-                const cv::Mat &d1 = Descriptors1.row(idx1);
+                const uint64_t* d1 = pNode1+4*i1;
 
                 int bestDist1=256;
                 int bestIdx2 =-1 ;
                 int bestDist2=256;
 
-                for(size_t i2=0, iend2=f2it->second.size(); i2<iend2; i2++)
+                for(size_t i2=0, iend2=vFeatVec2.featureCount(f2it); i2<iend2; i2++)
                 {
-                    const size_t idx2 = f2it->second[i2];
-
-                    MapPoint* pMP2 = vpMapPoints2[idx2];
-
-                    if(vbMatched2[idx2] || !pMP2)
-                        continue;
+                    const size_t idx2 = vIndices2[i2];
 
-                    if(pMP2->isBad())
+                    if(vbMatched2[idx2] || !vpMapPoints2[idx2])
                         continue;
 
-                    const cv::Mat &d2 = Descriptors2.row(idx2);
-
-                    int dist = DescriptorDistance(d1,d2);
+                    int dist = DescriptorDistance(d1,pNode2+4*i2);
 
                     if(dist<bestDist1)
                     {
@@ -621,13 +651,13 @@ int ORBmatcher::SearchByBoW(KeyFrame *pKF1, KeyFrame *pKF2, vector<MapPoint *> &
             f1it++;
             f2it++;
         }
-        else if(f1it->first < f2it->first)
+        else if(node1 < node2)
         {
-            f1it = vFeatVec1.lower_bound(f2it->first);
+            f1it++;
         }
         else
         {
-            f2it = vFeatVec2.lower_bound(f1it->first);
+            f2it++;
         }
     }
 
@@ -683,18 +713,24 @@ int ORBmatcher::SearchForTriangulation(KeyFrame *pKF1, KeyFrame *pKF2, cv::Mat F
 
     const float factor = 1.0f/HISTO_LENGTH;
 
-    DBoW2::FeatureVector::const_iterator f1it = vFeatVec1.begin();
-    DBoW2::FeatureVector::const_iterator f2it = vFeatVec2.begin();
-    DBoW2::FeatureVector::const_iterator f1end = vFeatVec1.end();
-    DBoW2::FeatureVector::const_iterator f2end = vFeatVec2.end();
+    size_t f1it = 0;
+    size_t f2it = 0;
+    const size_t f1end = vFeatVec1.size();
+    const size_t f2end = vFeatVec2.size();
 
     while(f1it!=f1end && f2it!=f2end)
     {
-        if(f1it->first == f2it->first)
+        const DBoW2::NodeId node1 = vFeatVec1.nodeId(f1it);
+        const DBoW2::NodeId node2 = vFeatVec2.nodeId(f2it);
+
+        if(node1 == node2)
         {
-            for(size_t i1=0, iend1=f1it->second.size(); i1<iend1; i1++)
+            const unsigned int* vIndices1 = vFeatVec1.features(f1it);
+            const unsigned int* vIndices2 = vFeatVec2.features(f2it);
+
+            for(size_t i1=0, iend1=vFeatVec1.featureCount(f1it); i1<iend1; i1++)
             {
-                const size_t idx1 = f1it->second[i1];
+                const size_t idx1 = vIndices1[i1];
                 
                 MapPoint* pMP1 = pKF1->GetMapPoint(idx1);
                 
@@ -715,9 +751,9 @@ int ORBmatcher::SearchForTriangulation(KeyFrame *pKF1, KeyFrame *pKF2, cv::Mat F
                 int bestDist = TH_LOW;
                 int bestIdx2 = -1;
                 
-                for(size_t i2=0, iend2=f2it->second.size(); i2<iend2; i2++)
+                for(size_t i2=0, iend2=vFeatVec2.featureCount(f2it); i2<iend2; i2++)
                 {
-                    size_t idx2 = f2it->second[i2];
+                    size_t idx2 = vIndices2[i2];
                     
                     MapPoint* pMP2 = pKF2->GetMapPoint(idx2);
                     
@@ -778,13 +814,13 @@ int ORBmatcher::SearchForTriangulation(KeyFrame *pKF1, KeyFrame *pKF2, cv::Mat F
             f1it++;
             f2it++;
         }
-        else if(f1it->first < f2it->first)
+        else if(node1 < node2)
         {
-            f1it = vFeatVec1.lower_bound(f2it->first);
+            f1it++;
         }
         else
         {
-            f2it = vFeatVec2.lower_bound(f1it->first);
+            f2it++;
         }
     }
 
@@ -1642,6 +1678,20 @@ void ORBmatcher::ComputeThreeMaxima(vector<int>* histo, const int L, int &ind1,
 }
 
 
+cv::Mat ORBmatcher::PackBowDescriptors(const DBoW2::FeatureVector &featVec, const cv::Mat &descriptors)
+{
+    const size_t nFeatures = featVec.totalFeatures();
+    cv::Mat packed(nFeatures,32,CV_8U);
+    if(nFeatures==0)
+        return packed;
+
+    const unsigned int* vIndices = featVec.features(0);
+    for(size_t i=0; i<nFeatures; i++)
+        memcpy(packed.ptr(i),descriptors.ptr(vIndices[i]),32);
+
+    return packed;
+}
+
 // Bit set count operation from
 // http://graphics.stanford.edu/~seander/bithacks.html#CountBitsSetParallel
 int ORBmatcher::DescriptorDistance(const cv::Mat &a, const cv::Mat &b)
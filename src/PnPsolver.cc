@@ -51,6 +51,7 @@
 #include <iostream>
 
 #include "PnPsolver.h"
+#include "Logger.h"
 
 #include <vector>
 #include <cmath>
@@ -628,9 +629,9 @@ void PnPsolver::estimate_R_and_t(double R[3][3], double t[3])
 
 void PnPsolver::print_pose(const double R[3][3], const double t[3])
 {
-  cout << R[0][0] << " " << R[0][1] << " " << R[0][2] << " " << t[0] << endl;
-  cout << R[1][0] << " " << R[1][1] << " " << R[1][2] << " " << t[1] << endl;
-  cout << R[2][0] << " " << R[2][1] << " " << R[2][2] << " " << t[2] << endl;
+  ORB_LOG(DEBUG) << R[0][0] << " " << R[0][1] << " " << R[0][2] << " " << t[0];
+  ORB_LOG(DEBUG) << R[1][0] << " " << R[1][1] << " " << R[1][2] << " " << t[1];
+  ORB_LOG(DEBUG) << R[2][0] << " " << R[2][1] << " " << R[2][2] << " " << t[2];
 }
 
 void PnPsolver::solve_for_sign(void)
@@ -886,7 +887,7 @@ void PnPsolver::qr_solve(CvMat * A, CvMat * b, CvMat * X)
 
     if (eta == 0) {
       A1[k] = A2[k] = 0.0;
-      cerr << "God damnit, A is singular, this shouldn't happen." << endl;
+      ORB_LOG(WARNING) << "God damnit, A is singular, this shouldn't happen.";
       return;
     } else {
       double * ppAik = ppAkk, sum = 0.0, inv_eta = 1. / eta;
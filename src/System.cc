@@ -22,6 +22,7 @@
 
 #include "System.h"
 #include "Converter.h"
+#include "Logger.h"
 #include <thread>
 #include <pangolin/pangolin.h>
 #include <iomanip>
@@ -35,47 +36,44 @@ namespace ORB_SLAM2
             mbDeactivateLocalizationMode(false)
     {
         // Output welcome message
-        cout << endl <<
+        ORB_LOG(INFO) <<
         "ORB-SLAM2 Copyright (C) 2014-2016 Raul Mur-Artal, University of Zaragoza." << endl <<
         "This program comes with ABSOLUTELY NO WARRANTY;" << endl  <<
         "This is free software, and you are welcome to redistribute it" << endl <<
-        "under certain conditions. See LICENSE.txt." << endl << endl;
-
-        cout << "Input sensor was set to: ";
+        "under certain conditions. See LICENSE.txt.";
 
         if(mSensor==MONOCULAR)
-            cout << "Monocular" << endl;
+            ORB_LOG(INFO) << "Input sensor was set to: Monocular";
         else if(mSensor==STEREO)
-            cout << "Stereo" << endl;
+            ORB_LOG(INFO) << "Input sensor was set to: Stereo";
         else if(mSensor==RGBD)
-            cout << "RGB-D" << endl;
+            ORB_LOG(INFO) << "Input sensor was set to: RGB-D";
 
         //Check settings file
         cv::FileStorage fsSettings(strSettingsFile.c_str(), cv::FileStorage::READ);
         if(!fsSettings.isOpened())
         {
-           cerr << "Failed to open settings file at: " << strSettingsFile << endl;
+           ORB_LOG(ERROR) << "Failed to open settings file at: " << strSettingsFile;
            exit(-1);
         }
 
-        float resolution = fsSettings["PointCloudMapping.Resolution"];
+        // Log file, messages are also echoed to the console
+        string strLogFile = fsSettings["Log.file"];
+        if(strLogFile.empty())
+            strLogFile = "ORB_SLAM2.log";
+        if(!Logger::Instance().Open(strLogFile))
+            ORB_LOG(WARNING) << "Failed to open log file at: " << strLogFile;
 
-        //Load ORB Vocabulary
-        cout << endl << "Loading ORB Vocabulary. This could take a while..." << endl;
+        float resolution = fsSettings["PointCloudMapping.Resolution"];
 
+        //Load ORB Vocabulary in the background, the rest of the system is built meanwhile
         mpVocabulary = new ORBVocabulary();
-        bool bVocLoad = mpVocabulary->loadFromTextFile(strVocFile);
-        if(!bVocLoad)
-        {
-            cerr << "Wrong path to vocabulary. " << endl;
-            cerr << "Falied to open at: " << strVocFile << endl;
-            exit(-1);
-        }
-        cout << "Vocabulary loaded!" << endl << endl;
 
-        //Create KeyFrame Database
+        //Create KeyFrame Database (sized when the vocabulary is loaded)
         mpKeyFrameDatabase = new KeyFrameDatabase(*mpVocabulary);
 
+        mReady = async(launch::async,&System::LoadVocabulary,this,strVocFile).share();
+
         //Create the Map
         mpMap = new Map();
 
@@ -100,7 +98,7 @@ namespace ORB_SLAM2
         //Initialize the Viewer thread and launch
         if(bUseViewer)
         {
-            cout<<"bUseViewer"<<endl;
+            ORB_LOG(DEBUG) << "bUseViewer";
             mpViewer = new Viewer(this, mpFrameDrawer,mpMapDrawer,mpTracker,strSettingsFile);
             mptViewer = new thread(&Viewer::Run, mpViewer);
             mpTracker->SetViewer(mpViewer);
@@ -129,14 +127,77 @@ namespace ORB_SLAM2
                                         0,0,0,1;
     }
 
-    cv::Mat System::TrackStereo(const cv::Mat &imLeft, const cv::Mat &imRight, const double &timestamp)
+    bool System::LoadVocabulary(const string &strVocFile)
+    {
+        ORB_LOG(INFO) << "Loading ORB Vocabulary. This could take a while...";
+
+        bool bVocLoad = mpVocabulary->loadFromTextFile(strVocFile);
+        if(!bVocLoad)
+        {
+            ORB_LOG(ERROR) << "Wrong path to vocabulary. ";
+            ORB_LOG(ERROR) << "Falied to open at: " << strVocFile;
+            return false;
+        }
+
+        // The database was created with the empty vocabulary
+        mpKeyFrameDatabase->clear();
+
+        ORB_LOG(INFO) << "Vocabulary loaded!";
+        return true;
+    }
+
+    bool System::IsReady()
+    {
+        return mReady.wait_for(chrono::seconds(0))==future_status::ready;
+    }
+
+    shared_future<bool> System::GetReadyFuture()
+    {
+        return mReady;
+    }
+
+    void System::WaitUntilReady()
+    {
+        if(!mReady.get())
+            exit(-1);
+    }
+
+    void System::BufferFrame(const cv::Mat &im1, const cv::Mat &im2, const double &timestamp, const cv::Mat &mask)
+    {
+        PendingFrame frame;
+        frame.mIm1 = im1.clone();
+        frame.mIm2 = im2.clone();
+        frame.mTimestamp = timestamp;
+        frame.mMask = mask.clone();
+        mlPendingFrames.push_back(frame);
+
+        while(mlPendingFrames.size()>MAX_PENDING_FRAMES)
+            mlPendingFrames.pop_front();
+    }
+
+    cv::Mat System::TrackStereo(const cv::Mat &imLeft, const cv::Mat &imRight, const double &timestamp, const cv::Mat &mask)
     {
         if(mSensor!=STEREO)
         {
-            cerr << "ERROR: you called TrackStereo but input sensor was not set to STEREO." << endl;
+            ORB_LOG(ERROR) << "ERROR: you called TrackStereo but input sensor was not set to STEREO.";
             exit(-1);
         }
 
+        // Frames received before the system is ready are tracked once it is
+        if(!IsReady())
+        {
+            BufferFrame(imLeft,imRight,timestamp,mask);
+            return cv::Mat();
+        }
+
+        if(!mlPendingFrames.empty())
+        {
+            list<PendingFrame> lPendingFrames;
+            lPendingFrames.swap(mlPendingFrames);
+            for(list<PendingFrame>::iterator lit=lPendingFrames.begin(), lend=lPendingFrames.end(); lit!=lend; lit++)
+                TrackStereo(lit->mIm1,lit->mIm2,lit->mTimestamp,lit->mMask);
+        }
+
         // Check mode change
         {
             unique_lock<mutex> lock(mMutexMode);
@@ -171,23 +232,35 @@ namespace ORB_SLAM2
         }
         }
 
-        cv::Mat Tcw = mpTracker->GrabImageStereo(imLeft,imRight,timestamp);
+        cv::Mat Tcw = mpTracker->GrabImageStereo(imLeft,imRight,timestamp,mask);
 
-        unique_lock<mutex> lock2(mMutexState);
-        mTrackingState = mpTracker->mState;
-        mTrackedMapPoints = mpTracker->mCurrentFrame.mvpMapPoints;
-        mTrackedKeyPointsUn = mpTracker->mCurrentFrame.mvKeysUn;
+        PublishTrackedFrame();
         return Tcw;
     }
 
-    cv::Mat System::TrackRGBD(const cv::Mat &im, const cv::Mat &depthmap, const double &timestamp)
+    cv::Mat System::TrackRGBD(const cv::Mat &im, const cv::Mat &depthmap, const double &timestamp, const cv::Mat &mask)
     {
         if(mSensor!=RGBD)
         {
-            cerr << "ERROR: you called TrackRGBD but input sensor was not set to RGBD." << endl;
+            ORB_LOG(ERROR) << "ERROR: you called TrackRGBD but input sensor was not set to RGBD.";
             exit(-1);
         }
 
+        // Frames received before the system is ready are tracked once it is
+        if(!IsReady())
+        {
+            BufferFrame(im,depthmap,timestamp,mask);
+            return cv::Mat();
+        }
+
+        if(!mlPendingFrames.empty())
+        {
+            list<PendingFrame> lPendingFrames;
+            lPendingFrames.swap(mlPendingFrames);
+            for(list<PendingFrame>::iterator lit=lPendingFrames.begin(), lend=lPendingFrames.end(); lit!=lend; lit++)
+                TrackRGBD(lit->mIm1,lit->mIm2,lit->mTimestamp,lit->mMask);
+        }
+
         // Check mode change
         {
             unique_lock<mutex> lock(mMutexMode);
@@ -222,12 +295,9 @@ namespace ORB_SLAM2
         }
         }
 
-        cv::Mat Tcw = mpTracker->GrabImageRGBD(im,depthmap,timestamp);
+        cv::Mat Tcw = mpTracker->GrabImageRGBD(im,depthmap,timestamp,mask);
 
-        unique_lock<mutex> lock2(mMutexState);
-        mTrackingState = mpTracker->mState;
-        mTrackedMapPoints = mpTracker->mCurrentFrame.mvpMapPoints;
-        mTrackedKeyPointsUn = mpTracker->mCurrentFrame.mvKeysUn;
+        PublishTrackedFrame();
         return Tcw;
     }
 
@@ -235,10 +305,12 @@ namespace ORB_SLAM2
     {
         if(mSensor!=RGBD)
         {
-            cerr << "ERROR: you called TrackRGBD but input sensor was not set to RGBD." << endl;
+            ORB_LOG(ERROR) << "ERROR: you called TrackRGBD but input sensor was not set to RGBD.";
             exit(-1);
         }
         //cout<<"trees: "<<trees.size()<<endl;
+        WaitUntilReady();
+
         // Check mode change
         {
             unique_lock<mutex> lock(mMutexMode);
@@ -275,29 +347,18 @@ namespace ORB_SLAM2
 
         cv::Mat Tcw = mpTracker->GrabImageRGBD(im,depthmap,timestamp);
 
-        unique_lock<mutex> lock2(mMutexState);
-        mTrackingState = mpTracker->mState;
-        mTrackedMapPoints = mpTracker->mCurrentFrame.mvpMapPoints;
-        mTrackedKeyPointsUn = mpTracker->mCurrentFrame.mvKeysUn;
-
-
-        if (!trees.empty())
-        {
-            treeDB = trees;
-            //cout<<"trees: "<<treeDB.size()<<endl;
-        }
-
-//        cout<<"Tcwsize: "<<Tcw.size()<<endl;
+        PublishTrackedFrame(&trees);
 
+        unique_lock<mutex> lock2(mMutexState);
         pose = Tcw;
         return Tcw;
     }
 
-    cv::Mat System::TrackMonocular(const cv::Mat &im, const double &timestamp)
+    cv::Mat System::TrackMonocular(const cv::Mat &im, const double &timestamp, const cv::Mat &mask)
     {
         if(mSensor!=MONOCULAR)
         {
-            cerr << "ERROR: you called TrackMonocular but input sensor was not set to Monocular." << endl;
+            ORB_LOG(ERROR) << "ERROR: you called TrackMonocular but input sensor was not set to Monocular.";
             exit(-1);
         }
 
@@ -335,12 +396,9 @@ namespace ORB_SLAM2
         }
         }
 
-        cv::Mat Tcw = mpTracker->GrabImageMonocular(im,timestamp);
+        cv::Mat Tcw = mpTracker->GrabImageMonocular(im,timestamp,mask);
 
-        unique_lock<mutex> lock2(mMutexState);
-        mTrackingState = mpTracker->mState;
-        mTrackedMapPoints = mpTracker->mCurrentFrame.mvpMapPoints;
-        mTrackedKeyPointsUn = mpTracker->mCurrentFrame.mvKeysUn;
+        PublishTrackedFrame();
 
         return Tcw;
     }
@@ -378,6 +436,8 @@ namespace ORB_SLAM2
 
     void System::Shutdown()
     {
+        mReady.wait();
+
         mpLocalMapper->RequestFinish();
         mpLoopCloser->RequestFinish();
 
@@ -402,6 +462,8 @@ namespace ORB_SLAM2
             usleep(5000);
         }
 
+        Logger::Instance().Flush();
+
         if(mpViewer)
             pangolin::BindToContext("ORB-SLAM2: Map Viewer");
             
@@ -410,10 +472,10 @@ namespace ORB_SLAM2
 
     void System::SaveTrajectoryTUM(const string &filename)
     {
-        cout << endl << "Saving camera trajectory to " << filename << " ..." << endl;
+        ORB_LOG(INFO) << "Saving camera trajectory to " << filename << " ...";
         if(mSensor==MONOCULAR)
         {
-            cerr << "ERROR: SaveTrajectoryTUM cannot be used for monocular." << endl;
+            ORB_LOG(ERROR) << "ERROR: SaveTrajectoryTUM cannot be used for monocular.";
             return;
         }
 
@@ -466,13 +528,13 @@ namespace ORB_SLAM2
               << " " << twc.at<float>(2) << " " << q[0] << " " << q[1] << " " << q[2] << " " << q[3] << endl;
         }
         f.close();
-        cout << endl << "trajectory saved!" << endl;
+        ORB_LOG(INFO) << "trajectory saved!";
     }
 
 
     void System::SaveKeyFrameTrajectoryTUM(const string &filename)
     {
-        cout << endl << "Saving keyframe trajectory to " << filename << " ..." << endl;
+        ORB_LOG(INFO) << "Saving keyframe trajectory to " << filename << " ...";
 
         vector<KeyFrame*> vpKFs = mpMap->GetAllKeyFrames();
         sort(vpKFs.begin(),vpKFs.end(),KeyFrame::lId);
@@ -503,15 +565,15 @@ namespace ORB_SLAM2
         }
 
         f.close();
-        cout << endl << "trajectory saved!" << endl;
+        ORB_LOG(INFO) << "trajectory saved!";
     }
 
     void System::SaveTrajectoryKITTI(const string &filename)
     {
-        cout << endl << "Saving camera trajectory to " << filename << " ..." << endl;
+        ORB_LOG(INFO) << "Saving camera trajectory to " << filename << " ...";
         if(mSensor==MONOCULAR)
         {
-            cerr << "ERROR: SaveTrajectoryKITTI cannot be used for monocular." << endl;
+            ORB_LOG(ERROR) << "ERROR: SaveTrajectoryKITTI cannot be used for monocular.";
             return;
         }
 
@@ -559,25 +621,55 @@ namespace ORB_SLAM2
                  Rwc.at<float>(2,0) << " " << Rwc.at<float>(2,1)  << " " << Rwc.at<float>(2,2) << " "  << twc.at<float>(2) << endl;
         }
         f.close();
-        cout << endl << "trajectory saved!" << endl;
+        ORB_LOG(INFO) << "trajectory saved!";
+    }
+
+    void System::PublishTrackedFrame(vector<Tree>* pvTrees)
+    {
+        shared_ptr<TrackedFrame> pTF = make_shared<TrackedFrame>();
+        pTF->mState = mpTracker->mState;
+
+        // Matches and keypoints are moved, not copied
+        mpTracker->ReleaseCurrentFrame(pTF->mvpMapPoints,pTF->mvKeysUn);
+
+        // Trees are kept from the last frame that provided them
+        if(pvTrees && !pvTrees->empty())
+        {
+            shared_ptr<vector<Tree> > pvNewTrees = make_shared<vector<Tree> >();
+            pvNewTrees->swap(*pvTrees);
+            pTF->mpvTrees = pvNewTrees;
+        }
+        else
+        {
+            shared_ptr<const TrackedFrame> pLastTF = atomic_load(&mpTrackedFrame);
+            if(pLastTF)
+                pTF->mpvTrees = pLastTF->mpvTrees;
+        }
+
+        atomic_store(&mpTrackedFrame,shared_ptr<const TrackedFrame>(pTF));
+    }
+
+    shared_ptr<const TrackedFrame> System::GetTrackedFrame()
+    {
+        return atomic_load(&mpTrackedFrame);
     }
 
     int System::GetTrackingState()
     {
-        unique_lock<mutex> lock(mMutexState);
-        return mTrackingState;
+        shared_ptr<const TrackedFrame> pTF = GetTrackedFrame();
+        return pTF ? pTF->mState : Tracking::NO_IMAGES_YET;
     }
 
     vector<MapPoint*> System::GetTrackedMapPoints()
     {
-        unique_lock<mutex> lock(mMutexState);
-        return mTrackedMapPoints;
+        shared_ptr<const TrackedFrame> pTF = GetTrackedFrame();
+        return pTF ? pTF->mvpMapPoints : vector<MapPoint*>();
     }
 
     vector<cv::KeyPoint> System::GetTrackedKeyPointsUn()
     {
-        unique_lock<mutex> lock(mMutexState);
-        return mTrackedKeyPointsUn;
+        shared_ptr<const TrackedFrame> pTF = GetTrackedFrame();
+        return pTF ? pTF->mvKeysUn : vector<cv::KeyPoint>();
     }
 
     shared_ptr<PointCloudMapping> System::GetPointCloudMapping()
@@ -594,8 +686,10 @@ namespace ORB_SLAM2
 
     std::vector<Tree> System::GetTrees()
     {
-        unique_lock<mutex> lock(mMutexState);
-        return treeDB;
+        shared_ptr<const TrackedFrame> pTF = GetTrackedFrame();
+        if(!pTF || !pTF->mpvTrees)
+            return vector<Tree>();
+        return *pTF->mpvTrees;
     }
 
     void System::setPose(cv::Mat thePose)
@@ -23,6 +23,8 @@
 
 #include<opencv2/core/core.hpp>
 #include<opencv2/features2d/features2d.hpp>
+#include<opencv2/highgui/highgui.hpp>
+#include<opencv2/imgproc/imgproc.hpp>
 
 #include"ORBmatcher.h"
 #include"FrameDrawer.h"
@@ -32,6 +34,7 @@
 
 #include"Optimizer.h"
 #include"PnPsolver.h"
+#include"Logger.h"
 
 #include "pointcloudmapping.h"
 
@@ -47,18 +50,32 @@ namespace ORB_SLAM2
 
 Tracking::Tracking(System *pSys, ORBVocabulary* pVoc, FrameDrawer *pFrameDrawer, MapDrawer *pMapDrawer,
                    Map *pMap, shared_ptr<PointCloudMapping> pPointCloud, KeyFrameDatabase* pKFDB, const string &strSettingPath, const int sensor):
-    mState(NO_IMAGES_YET), mSensor(sensor), mbOnlyTracking(false), mbVO(false), mpORBVocabulary(pVoc), 
+    mState(NO_IMAGES_YET), mSensor(sensor), mfIniFlow(0), mnIniGatedFrames(0), mbOnlyTracking(false), mbVO(false), mpORBVocabulary(pVoc), 
     mpKeyFrameDB(pKFDB), mpInitializer(static_cast<Initializer*>(NULL)), mpSystem(pSys), mpViewer(NULL),
-    mpFrameDrawer(pFrameDrawer), mpMapDrawer(pMapDrawer), mpMap(pMap), mpPointCloudMapping( pPointCloud ), mnLastRelocFrameId(0)
+    mpFrameDrawer(pFrameDrawer), mpMapDrawer(pMapDrawer), mpMap(pMap), mpPointCloudMapping( pPointCloud ), mnLastRelocFrameId(0),
+    mnRelocInterval(1), mnRelocMaxInterval(16), mnNextRelocFrameId(0), mbSpawnMapOnLoss(false),
+    mfStaticDiffTh(2.0f), mnStaticMinFrames(5), mnStaticFrames(0), mfDownscale(1.0f), mnTemporalPoints(0)
 {
     // Load camera parameters from settings file
 
     cv::FileStorage fSettings(strSettingPath, cv::FileStorage::READ);
+
+    // Features are detected on the images reduced by this factor
+    cv::FileNode nodeDownscale = fSettings["ORBextractor.downscale"];
+    if(!nodeDownscale.empty() && (float)nodeDownscale>1.0f)
+        mfDownscale = nodeDownscale;
+
     float fx = fSettings["Camera.fx"];
     float fy = fSettings["Camera.fy"];
     float cx = fSettings["Camera.cx"];
     float cy = fSettings["Camera.cy"];
 
+    // Calibration of the downscaled images (pixel centers are preserved)
+    fx /= mfDownscale;
+    fy /= mfDownscale;
+    cx = (cx+0.5f)/mfDownscale-0.5f;
+    cy = (cy+0.5f)/mfDownscale-0.5f;
+
     cv::Mat K = cv::Mat::eye(3,3,CV_32F);
     K.at<float>(0,0) = fx;
     K.at<float>(1,1) = fy;
@@ -80,6 +97,7 @@ Tracking::Tracking(System *pSys, ORBVocabulary* pVoc, FrameDrawer *pFrameDrawer,
     DistCoef.copyTo(mDistCoef);
 
     mbf = fSettings["Camera.bf"];
+    mbf /= mfDownscale;
 
     float fps = fSettings["Camera.fps"];
     if(fps==0)
@@ -89,27 +107,27 @@ Tracking::Tracking(System *pSys, ORBVocabulary* pVoc, FrameDrawer *pFrameDrawer,
     mMinFrames = 0;
     mMaxFrames = fps;
 
-    cout << endl << "Camera Parameters: " << endl;
-    cout << "- fx: " << fx << endl;
-    cout << "- fy: " << fy << endl;
-    cout << "- cx: " << cx << endl;
-    cout << "- cy: " << cy << endl;
-    cout << "- k1: " << DistCoef.at<float>(0) << endl;
-    cout << "- k2: " << DistCoef.at<float>(1) << endl;
+    ORB_LOG(INFO) << "Camera Parameters: ";
+    ORB_LOG(INFO) << "- fx: " << fx;
+    ORB_LOG(INFO) << "- fy: " << fy;
+    ORB_LOG(INFO) << "- cx: " << cx;
+    ORB_LOG(INFO) << "- cy: " << cy;
+    ORB_LOG(INFO) << "- k1: " << DistCoef.at<float>(0);
+    ORB_LOG(INFO) << "- k2: " << DistCoef.at<float>(1);
     if(DistCoef.rows==5)
-        cout << "- k3: " << DistCoef.at<float>(4) << endl;
-    cout << "- p1: " << DistCoef.at<float>(2) << endl;
-    cout << "- p2: " << DistCoef.at<float>(3) << endl;
-    cout << "- fps: " << fps << endl;
+        ORB_LOG(INFO) << "- k3: " << DistCoef.at<float>(4);
+    ORB_LOG(INFO) << "- p1: " << DistCoef.at<float>(2);
+    ORB_LOG(INFO) << "- p2: " << DistCoef.at<float>(3);
+    ORB_LOG(INFO) << "- fps: " << fps;
 
 
     int nRGB = fSettings["Camera.RGB"];
     mbRGB = nRGB;
 
     if(mbRGB)
-        cout << "- color order: RGB (ignored if grayscale)" << endl;
+        ORB_LOG(INFO) << "- color order: RGB (ignored if grayscale)";
     else
-        cout << "- color order: BGR (ignored if grayscale)" << endl;
+        ORB_LOG(INFO) << "- color order: BGR (ignored if grayscale)";
 
     // Load ORB parameters
 
@@ -127,17 +145,90 @@ Tracking::Tracking(System *pSys, ORBVocabulary* pVoc, FrameDrawer *pFrameDrawer,
     if(sensor==System::MONOCULAR)
         mpIniORBextractor = new ORBextractor(2*nFeatures,fScaleFactor,nLevels,fIniThFAST,fMinThFAST);
 
-    cout << endl  << "ORB Extractor Parameters: " << endl;
-    cout << "- Number of Features: " << nFeatures << endl;
-    cout << "- Scale Levels: " << nLevels << endl;
-    cout << "- Scale Factor: " << fScaleFactor << endl;
-    cout << "- Initial Fast Threshold: " << fIniThFAST << endl;
-    cout << "- Minimum Fast Threshold: " << fMinThFAST << endl;
+    ORB_LOG(INFO) << "ORB Extractor Parameters: ";
+    ORB_LOG(INFO) << "- Number of Features: " << nFeatures;
+    ORB_LOG(INFO) << "- Scale Levels: " << nLevels;
+    ORB_LOG(INFO) << "- Scale Factor: " << fScaleFactor;
+    ORB_LOG(INFO) << "- Initial Fast Threshold: " << fIniThFAST;
+    ORB_LOG(INFO) << "- Minimum Fast Threshold: " << fMinThFAST;
+    if(mfDownscale>1.0f)
+        ORB_LOG(INFO) << "- Downscale: " << mfDownscale;
+
+    // Static masks of the regions where features are detected (e.g. excluding the vehicle or the sky)
+    string strMask = fSettings["ORBextractor.mask"];
+    string strMaskRight = fSettings["ORBextractor.maskRight"];
+    if(strMaskRight.empty())
+        strMaskRight = strMask;
+
+    // Masks are checked against the image size if it is in the settings, otherwise the extractors
+    // check them on the first image
+    const cv::Size imageSize((int)fSettings["Camera.width"],(int)fSettings["Camera.height"]);
+
+    if(!strMask.empty())
+    {
+        cv::Mat mask = cv::imread(strMask,CV_LOAD_IMAGE_GRAYSCALE);
+        if(mask.empty())
+        {
+            ORB_LOG(ERROR) << "Failed to open mask at: " << strMask;
+            exit(-1);
+        }
+        if(imageSize.area()>0 && mask.size()!=imageSize)
+        {
+            ORB_LOG(ERROR) << "Mask " << strMask << " is " << mask.cols << "x" << mask.rows
+                           << ", the images are " << imageSize.width << "x" << imageSize.height;
+            exit(-1);
+        }
+        mask = Downscale(mask,cv::INTER_NEAREST);
+        if(!mpORBextractorLeft->SetMask(mask) || (sensor==System::MONOCULAR && !mpIniORBextractor->SetMask(mask)))
+            exit(-1);
+        ORB_LOG(INFO) << "- Mask: " << strMask;
+    }
+
+    if(sensor==System::STEREO && !strMaskRight.empty())
+    {
+        cv::Mat mask = cv::imread(strMaskRight,CV_LOAD_IMAGE_GRAYSCALE);
+        if(mask.empty())
+        {
+            ORB_LOG(ERROR) << "Failed to open mask at: " << strMaskRight;
+            exit(-1);
+        }
+        if(imageSize.area()>0 && mask.size()!=imageSize)
+        {
+            ORB_LOG(ERROR) << "Mask " << strMaskRight << " is " << mask.cols << "x" << mask.rows
+                           << ", the images are " << imageSize.width << "x" << imageSize.height;
+            exit(-1);
+        }
+        if(!mpORBextractorRight->SetMask(Downscale(mask,cv::INTER_NEAREST)))
+            exit(-1);
+        ORB_LOG(INFO) << "- Right Mask: " << strMaskRight;
+    }
+
+    // Behaviour when tracking is lost
+    cv::FileNode nodeReloc = fSettings["Tracking.relocMaxInterval"];
+    if(!nodeReloc.empty())
+        mnRelocMaxInterval = max((int)nodeReloc,1);
+    cv::FileNode nodeSpawn = fSettings["Tracking.spawnMapOnLoss"];
+    if(!nodeSpawn.empty())
+        mbSpawnMapOnLoss = (int)nodeSpawn!=0;
+
+    // Stationary camera detection, disabled with a non positive threshold
+    cv::FileNode nodeStaticTh = fSettings["Tracking.staticDiffTh"];
+    if(!nodeStaticTh.empty())
+        mfStaticDiffTh = nodeStaticTh;
+    cv::FileNode nodeStaticFrames = fSettings["Tracking.staticFrames"];
+    if(!nodeStaticFrames.empty())
+        mnStaticMinFrames = max((int)nodeStaticFrames,1);
+
+    ORB_LOG(INFO) << "Tracking Parameters: ";
+    ORB_LOG(INFO) << "- Max. Relocalization Interval: " << mnRelocMaxInterval;
+    ORB_LOG(INFO) << "- Spawn Map On Loss: " << mbSpawnMapOnLoss;
+    ORB_LOG(INFO) << "- Stationary Image Difference: " << mfStaticDiffTh;
+    ORB_LOG(INFO) << "- Stationary Frames: " << mnStaticMinFrames;
 
     if(sensor==System::STEREO || sensor==System::RGBD)
     {
         mThDepth = mbf*(float)fSettings["ThDepth"]/fx;
-        cout << endl << "Depth Threshold (Close/Far Points): " << mThDepth << endl;
+        ORB_LOG(INFO) << "Depth Threshold (Close/Far Points): " << mThDepth;
     }
 
     if(sensor==System::RGBD)
@@ -151,6 +242,16 @@ Tracking::Tracking(System *pSys, ORBVocabulary* pVoc, FrameDrawer *pFrameDrawer,
 
 }
 
+void Tracking::ReleaseCurrentFrame(vector<MapPoint*> &vpMapPoints, vector<cv::KeyPoint> &vKeysUn)
+{
+    vpMapPoints.swap(mCurrentFrame.mvpMapPoints);
+    vKeysUn.swap(mCurrentFrame.mvKeysUn);
+
+    // Nothing of the current frame is left half moved
+    mCurrentFrame = Frame();
+    mCurrentFrame.N = 0;
+}
+
 void Tracking::SetLocalMapper(LocalMapping *pLocalMapper)
 {
     mpLocalMapper=pLocalMapper;
@@ -167,7 +268,7 @@ void Tracking::SetViewer(Viewer *pViewer)
 }
 
 
-cv::Mat Tracking::GrabImageStereo(const cv::Mat &imRectLeft, const cv::Mat &imRectRight, const double &timestamp)
+cv::Mat Tracking::GrabImageStereo(const cv::Mat &imRectLeft, const cv::Mat &imRectRight, const double &timestamp, const cv::Mat &mask)
 {
     mImGray = imRectLeft;
     cv::Mat imGrayRight = imRectRight;
@@ -199,7 +300,20 @@ cv::Mat Tracking::GrabImageStereo(const cv::Mat &imRectLeft, const cv::Mat &imRe
         }
     }
 
-    mCurrentFrame = Frame(mImGray,imGrayRight,timestamp,mpORBextractorLeft,mpORBextractorRight,mpORBVocabulary,mK,mDistCoef,mbf,mThDepth);
+    if(mfDownscale>1.0f)
+    {
+        mImGrayFull = mImGray;
+        mImGray = Downscale(mImGray,cv::INTER_AREA);
+        imGrayRight = Downscale(imGrayRight,cv::INTER_AREA);
+    }
+
+    if(CheckStationary(mImGray))
+    {
+        TrackStationary(timestamp);
+        return mCurrentFrame.mTcw.clone();
+    }
+
+    mCurrentFrame = Frame(mImGray,imGrayRight,timestamp,mpORBextractorLeft,mpORBextractorRight,mpORBVocabulary,mK,mDistCoef,mbf,mThDepth,Downscale(mask,cv::INTER_NEAREST));
 
     Track();
 
@@ -207,7 +321,7 @@ cv::Mat Tracking::GrabImageStereo(const cv::Mat &imRectLeft, const cv::Mat &imRe
 }
 
 
-cv::Mat Tracking::GrabImageRGBD(const cv::Mat &imRGB,const cv::Mat &imD, const double &timestamp)
+cv::Mat Tracking::GrabImageRGBD(const cv::Mat &imRGB,const cv::Mat &imD, const double &timestamp, const cv::Mat &mask)
 {
     mImRGB = imRGB;
     mImGray = imRGB;
@@ -229,10 +343,25 @@ cv::Mat Tracking::GrabImageRGBD(const cv::Mat &imRGB,const cv::Mat &imD, const d
             cvtColor(mImGray,mImGray,CV_BGRA2GRAY);
     }
 
+    if(mfDownscale>1.0f)
+    {
+        // Depth is not interpolated across object boundaries
+        mImGrayFull = mImGray;
+        mImGray = Downscale(mImGray,cv::INTER_AREA);
+        mImRGB = Downscale(mImRGB,cv::INTER_AREA);
+        mImDepth = Downscale(mImDepth,cv::INTER_NEAREST);
+    }
+
+    if(CheckStationary(mImGray))
+    {
+        TrackStationary(timestamp);
+        return mCurrentFrame.mTcw.clone();
+    }
+
     if((fabs(mDepthMapFactor-1.0f)>1e-5) || mImDepth.type()!=CV_32F)
         mImDepth.convertTo(mImDepth,CV_32F,mDepthMapFactor);
 
-    mCurrentFrame = Frame(mImGray,mImDepth,timestamp,mpORBextractorLeft,mpORBVocabulary,mK,mDistCoef,mbf,mThDepth);
+    mCurrentFrame = Frame(mImGray,mImDepth,timestamp,mpORBextractorLeft,mpORBVocabulary,mK,mDistCoef,mbf,mThDepth,Downscale(mask,cv::INTER_NEAREST));
 
     Track();
 
@@ -240,7 +369,7 @@ cv::Mat Tracking::GrabImageRGBD(const cv::Mat &imRGB,const cv::Mat &imD, const d
 }
 
 
-cv::Mat Tracking::GrabImageMonocular(const cv::Mat &im, const double &timestamp)
+cv::Mat Tracking::GrabImageMonocular(const cv::Mat &im, const double &timestamp, const cv::Mat &mask)
 {
     mImGray = im;
 
@@ -259,10 +388,22 @@ cv::Mat Tracking::GrabImageMonocular(const cv::Mat &im, const double &timestamp)
             cvtColor(mImGray,mImGray,CV_BGRA2GRAY);
     }
 
+    if(mfDownscale>1.0f)
+    {
+        mImGrayFull = mImGray;
+        mImGray = Downscale(mImGray,cv::INTER_AREA);
+    }
+
+    if(CheckStationary(mImGray))
+    {
+        TrackStationary(timestamp);
+        return mCurrentFrame.mTcw.clone();
+    }
+
     if(mState==NOT_INITIALIZED || mState==NO_IMAGES_YET)
-        mCurrentFrame = Frame(mImGray,timestamp,mpIniORBextractor,mpORBVocabulary,mK,mDistCoef,mbf,mThDepth);
+        mCurrentFrame = Frame(mImGray,timestamp,mpIniORBextractor,mpORBVocabulary,mK,mDistCoef,mbf,mThDepth,Downscale(mask,cv::INTER_NEAREST));
     else
-        mCurrentFrame = Frame(mImGray,timestamp,mpORBextractorLeft,mpORBVocabulary,mK,mDistCoef,mbf,mThDepth);
+        mCurrentFrame = Frame(mImGray,timestamp,mpORBextractorLeft,mpORBVocabulary,mK,mDistCoef,mbf,mThDepth,Downscale(mask,cv::INTER_NEAREST));
 
     Track();
 
@@ -450,13 +591,8 @@ void Tracking::Track()
                     }
             }
 
-            // Delete temporal MapPoints
-            for(list<MapPoint*>::iterator lit = mlpTemporalPoints.begin(), lend =  mlpTemporalPoints.end(); lit!=lend; lit++)
-            {
-                MapPoint* pMP = *lit;
-                delete pMP;
-            }
-            mlpTemporalPoints.clear();
+            // Release temporal MapPoints, they are recycled in the next UpdateLastFrame
+            mnTemporalPoints = 0;
 
             // Check if we need to insert a new keyframe
             if(NeedNewKeyFrame())
@@ -478,7 +614,7 @@ void Tracking::Track()
         {
             if(mpMap->KeyFramesInMap()<=5)
             {
-                cout << "Track lost soon after initialisation, reseting..." << endl;
+                ORB_LOG(INFO) << "Track lost soon after initialisation, reseting...";
                 mpSystem->Reset();
                 return;
             }
@@ -508,11 +644,16 @@ void Tracking::Track()
         mlbLost.push_back(mState==LOST);
     }
 
+    // Instead of waiting for a relocalization, a new map is initialized from the next frame
+    if(mState==LOST && mbSpawnMapOnLoss && !mbOnlyTracking)
+        SpawnMap();
 }
 
 
 void Tracking::StereoInitialization()
 {
+    mpSystem->WaitUntilReady();
+
     if(mCurrentFrame.N>500)
     {
         // Set Frame pose to the origin
@@ -520,6 +661,7 @@ void Tracking::StereoInitialization()
 
         // Create KeyFrame
         KeyFrame* pKFini = new KeyFrame(mCurrentFrame,mpMap,mpKeyFrameDB);
+        pKFini->SetOrigin(true);
 
         // Insert KeyFrame in the map
         mpMap->AddKeyFrame(pKFini);
@@ -542,7 +684,10 @@ void Tracking::StereoInitialization()
             }
         }
 
-        cout << "New map created with " << mpMap->MapPointsInMap() << " points" << endl;
+        // Previous maps may still be there if this one was spawned after tracking was lost
+        const set<MapPoint*> spMPs = pKFini->GetMapPoints();
+
+        ORB_LOG(INFO) << "New map created with " << spMPs.size() << " points";
 
         mpLocalMapper->InsertKeyFrame(pKFini);
 
@@ -551,7 +696,7 @@ void Tracking::StereoInitialization()
         mpLastKeyFrame = pKFini;
 
         mvpLocalKeyFrames.push_back(pKFini);
-        mvpLocalMapPoints=mpMap->GetAllMapPoints();
+        mvpLocalMapPoints=vector<MapPoint*>(spMPs.begin(),spMPs.end());
         mpReferenceKF = pKFini;
         mCurrentFrame.mpReferenceKF = pKFini;
 
@@ -585,6 +730,8 @@ void Tracking::MonocularInitialization()
             mpInitializer =  new Initializer(mCurrentFrame,1.0,200);
 
             fill(mvIniMatches.begin(),mvIniMatches.end(),-1);
+            mfIniFlow = 0;
+            mnIniGatedFrames = 0;
 
             return;
         }
@@ -600,9 +747,13 @@ void Tracking::MonocularInitialization()
             return;
         }
 
-        // Find correspondences
+        // Find correspondences. The reference keypoints matched in the last frame are searched
+        // around their last match in a window adapted to the motion, the rest in the wide window.
+        const vector<cv::Point2f> vPrevMatched = mvbPrevMatched;
+        const vector<int> vPrevIniMatches = mvIniMatches;
+        const int windowTracked = min(100,max(15,cvRound(2.0f*mfIniFlow)+10));
         ORBmatcher matcher(0.9,true);
-        int nmatches = matcher.SearchForInitialization(mInitialFrame,mCurrentFrame,mvbPrevMatched,mvIniMatches,100);
+        int nmatches = matcher.SearchForInitialization(mInitialFrame,mCurrentFrame,mvbPrevMatched,mvIniMatches,100,windowTracked);
 
         // Check if there are enough correspondences
         if(nmatches<100)
@@ -612,6 +763,41 @@ void Tracking::MonocularInitialization()
             return;
         }
 
+        // Motion since the last frame of the keypoints matched in both, and their displacement from the reference
+        vector<float> vFlow;
+        vector<float> vDisplacement;
+        vFlow.reserve(nmatches);
+        vDisplacement.reserve(nmatches);
+        for(size_t i=0, iend=mvIniMatches.size(); i<iend; i++)
+        {
+            if(mvIniMatches[i]<0)
+                continue;
+            const cv::Point2f &pt = mCurrentFrame.mvKeysUn[mvIniMatches[i]].pt;
+            vDisplacement.push_back(cv::norm(pt-mInitialFrame.mvKeysUn[i].pt));
+            if(i<vPrevIniMatches.size() && vPrevIniMatches[i]>=0)
+                vFlow.push_back(cv::norm(pt-vPrevMatched[i]));
+        }
+
+        if(!vFlow.empty())
+        {
+            nth_element(vFlow.begin(),vFlow.begin()+vFlow.size()/2,vFlow.end());
+            mfIniFlow = vFlow[vFlow.size()/2];
+        }
+        else
+            mfIniFlow = 100;
+
+        // The reconstruction needs parallax above 1 degree for the 50 best triangulated points. With
+        // a mostly translating camera that means image displacements of about that angle, so smaller
+        // displacements skip the costly H/F model selection and keep the reference. A rotation can
+        // cancel the displacement of a translation (e.g. orbiting the scene), which gives parallax
+        // without displacement, so the selection is still tried every few gated frames.
+        const size_t idx = min<size_t>(50,vDisplacement.size()-1);
+        nth_element(vDisplacement.begin(),vDisplacement.begin()+idx,vDisplacement.end(),greater<float>());
+        const float minDisplacement = 0.75f*mK.at<float>(0,0)*tan(CV_PI/180.0);
+        if(vDisplacement[idx]<minDisplacement && ++mnIniGatedFrames<5)
+            return;
+        mnIniGatedFrames = 0;
+
         cv::Mat Rcw; // Current Camera Rotation
         cv::Mat tcw; // Current Camera Translation
         vector<bool> vbTriangulated; // Triangulated Correspondences (mvIniMatches)
@@ -641,10 +827,13 @@ void Tracking::MonocularInitialization()
 
 void Tracking::CreateInitialMapMonocular()
 {
+    // The initialization runs while the vocabulary is loading, it is first needed here
+    mpSystem->WaitUntilReady();
+
     // Create KeyFrames
     KeyFrame* pKFini = new KeyFrame(mInitialFrame,mpMap,mpKeyFrameDB);
     KeyFrame* pKFcur = new KeyFrame(mCurrentFrame,mpMap,mpKeyFrameDB);
-
+    pKFini->SetOrigin(true);
 
     pKFini->ComputeBoW();
     pKFcur->ComputeBoW();
@@ -685,10 +874,16 @@ void Tracking::CreateInitialMapMonocular()
     pKFini->UpdateConnections();
     pKFcur->UpdateConnections();
 
-    // Bundle Adjustment
-    cout << "New Map created with " << mpMap->MapPointsInMap() << " points" << endl;
+    // Bundle Adjustment. Previous maps may still be there if this one was spawned after tracking was lost.
+    vector<KeyFrame*> vpIniKFs;
+    vpIniKFs.push_back(pKFini);
+    vpIniKFs.push_back(pKFcur);
+    const set<MapPoint*> spIniMPs = pKFcur->GetMapPoints();
+    const vector<MapPoint*> vpIniMPs(spIniMPs.begin(),spIniMPs.end());
+
+    ORB_LOG(INFO) << "New Map created with " << vpIniMPs.size() << " points";
 
-    Optimizer::GlobalBundleAdjustemnt(mpMap,20);
+    Optimizer::BundleAdjustment(vpIniKFs,vpIniMPs,20);
 
     // Set median depth to 1
     float medianDepth = pKFini->ComputeSceneMedianDepth(2);
@@ -696,8 +891,25 @@ void Tracking::CreateInitialMapMonocular()
 
     if(medianDepth<0 || pKFcur->TrackedMapPoints(1)<100)
     {
-        cout << "Wrong initialization, reseting..." << endl;
-        Reset();
+        if(mpMap->mvpKeyFrameOrigins.empty())
+        {
+            ORB_LOG(INFO) << "Wrong initialization, reseting...";
+            Reset();
+        }
+        else
+        {
+            // Keep the previous maps, only this attempt is discarded
+            ORB_LOG(INFO) << "Wrong initialization, discarding the new map...";
+            for(size_t i=0; i<vpIniMPs.size(); i++)
+                vpIniMPs[i]->SetBadFlag();
+
+            // Unlink both keyframes from the covisibility graph, the spanning tree and the
+            // essential graph. The child first, so that the origin is left without children.
+            pKFini->SetOrigin(false);
+            pKFcur->SetBadFlag();
+            pKFini->SetBadFlag();
+            SpawnMap();
+        }
         return;
     }
 
@@ -726,7 +938,7 @@ void Tracking::CreateInitialMapMonocular()
 
     mvpLocalKeyFrames.push_back(pKFcur);
     mvpLocalKeyFrames.push_back(pKFini);
-    mvpLocalMapPoints=mpMap->GetAllMapPoints();
+    mvpLocalMapPoints=vpIniMPs;
     mpReferenceKF = pKFcur;
     mCurrentFrame.mpReferenceKF = pKFcur;
 
@@ -852,11 +1064,21 @@ void Tracking::UpdateLastFrame()
         if(bCreateNew)
         {
             cv::Mat x3D = mLastFrame.UnprojectStereo(i);
-            MapPoint* pNewMP = new MapPoint(x3D,mpMap,&mLastFrame,i);
+            MapPoint* pNewMP;
+            if(mnTemporalPoints<mvpTemporalPoints.size())
+            {
+                pNewMP = mvpTemporalPoints[mnTemporalPoints];
+                pNewMP->ResetFromFrame(x3D,&mLastFrame,i);
+            }
+            else
+            {
+                pNewMP = new MapPoint(x3D,mpMap,&mLastFrame,i);
+                mvpTemporalPoints.push_back(pNewMP);
+            }
+            mnTemporalPoints++;
 
             mLastFrame.mvpMapPoints[i]=pNewMP;
 
-            mlpTemporalPoints.push_back(pNewMP);
             nPoints++;
         }
         else
@@ -941,11 +1163,16 @@ bool Tracking::TrackLocalMap()
 
     SearchLocalPoints();
 
+    RefineKeyPoints();
+
     // Optimize Pose
     Optimizer::PoseOptimization(&mCurrentFrame);
     mnMatchesInliers = 0;
 
     // Update MapPoints Statistics
+    for(size_t i=0, iend=mvpVisibleMapPoints.size(); i<iend; i++)
+        mvpVisibleMapPoints[i]->IncreaseVisible();
+
     for(int i=0; i<mCurrentFrame.N; i++)
     {
         if(mCurrentFrame.mvpMapPoints[i])
@@ -988,6 +1215,10 @@ bool Tracking::NeedNewKeyFrame()
     if(mpLocalMapper->isStopped() || mpLocalMapper->stopRequested())
         return false;
 
+    // Do not insert keyframes of the same view while the camera stands still
+    if(mnStaticFrames>0)
+        return false;
+
     const int nKFs = mpMap->KeyFramesInMap();
 
     // Do not insert keyframes if not enough frames have passed from last relocalisation
@@ -1149,6 +1380,9 @@ void Tracking::CreateNewKeyFrame()
 
 void Tracking::SearchLocalPoints()
 {
+    // Visibility counters are increased in a single pass at the end of TrackLocalMap
+    mvpVisibleMapPoints.clear();
+
     // Do not search map points already matched
     for(vector<MapPoint*>::iterator vit=mCurrentFrame.mvpMapPoints.begin(), vend=mCurrentFrame.mvpMapPoints.end(); vit!=vend; vit++)
     {
@@ -1161,7 +1395,7 @@ void Tracking::SearchLocalPoints()
             }
             else
             {
-                pMP->IncreaseVisible();
+                mvpVisibleMapPoints.push_back(pMP);
                 pMP->mnLastFrameSeen = mCurrentFrame.mnId;
                 pMP->mbTrackInView = false;
             }
@@ -1181,7 +1415,7 @@ void Tracking::SearchLocalPoints()
         // Project (this fills MapPoint variables for matching)
         if(mCurrentFrame.isInFrustum(pMP,0.5))
         {
-            pMP->IncreaseVisible();
+            mvpVisibleMapPoints.push_back(pMP);
             nToMatch++;
         }
     }
@@ -1347,6 +1581,10 @@ void Tracking::UpdateLocalKeyFrames()
 
 bool Tracking::Relocalization()
 {
+    // Attempts are spaced out while the camera looks at unmapped territory
+    if(mCurrentFrame.mnId<mnNextRelocFrameId)
+        return false;
+
     // Compute Bag of Words Vector
     mCurrentFrame.ComputeBoW();
 
@@ -1355,7 +1593,10 @@ bool Tracking::Relocalization()
     vector<KeyFrame*> vpCandidateKFs = mpKeyFrameDB->DetectRelocalizationCandidates(&mCurrentFrame);
 
     if(vpCandidateKFs.empty())
+    {
+        ScheduleRelocalization(0);
         return false;
+    }
 
     const int nKFs = vpCandidateKFs.size();
 
@@ -1373,6 +1614,7 @@ bool Tracking::Relocalization()
     vbDiscarded.resize(nKFs);
 
     int nCandidates=0;
+    int nBestMatches=0;
 
     for(int i=0; i<nKFs; i++)
     {
@@ -1382,6 +1624,7 @@ bool Tracking::Relocalization()
         else
         {
             int nmatches = matcher.SearchByBoW(pKF,mCurrentFrame,vvpMapPointMatches[i]);
+            nBestMatches = max(nBestMatches,nmatches);
             if(nmatches<15)
             {
                 vbDiscarded[i] = true;
@@ -1498,41 +1741,170 @@ bool Tracking::Relocalization()
 
     if(!bMatch)
     {
+        ScheduleRelocalization(nBestMatches);
         return false;
     }
     else
     {
         mnLastRelocFrameId = mCurrentFrame.mnId;
+        mnRelocInterval = 1;
+        mnNextRelocFrameId = 0;
         return true;
     }
 
 }
 
+void Tracking::ScheduleRelocalization(const int nBestMatches)
+{
+    // With no candidate worth a PnP RANSAC the wait doubles, a promising candidate halves it
+    if(nBestMatches>=15)
+        mnRelocInterval = max(mnRelocInterval/2,1);
+    else
+        mnRelocInterval = min(2*mnRelocInterval,mnRelocMaxInterval);
+
+    mnNextRelocFrameId = mCurrentFrame.mnId+mnRelocInterval;
+}
+
+bool Tracking::CheckStationary(const cv::Mat &imGray)
+{
+    if(mfStaticDiffTh<=0)
+        return false;
+
+    cv::Mat thumb;
+    cv::resize(imGray,thumb,cv::Size(max(imGray.cols/8,1),max(imGray.rows/8,1)),0,0,cv::INTER_AREA);
+
+    // Compare with the last tracked image and check the camera did not move in the last tracked frames
+    bool bStatic = mState==OK && !mVelocity.empty() && thumb.size()==mStaticThumb.size();
+    if(bStatic)
+    {
+        const float diff = cv::norm(thumb,mStaticThumb,cv::NORM_L1)/thumb.total();
+        const cv::Mat R = mVelocity.rowRange(0,3).colRange(0,3);
+        const float cosAngle = 0.5f*(R.at<float>(0,0)+R.at<float>(1,1)+R.at<float>(2,2)-1.0f);
+        const float t = cv::norm(mVelocity.rowRange(0,3).col(3));
+        bStatic = diff<mfStaticDiffTh && cosAngle>0.99999f && t<0.005f;
+    }
+
+    if(!bStatic)
+    {
+        mnStaticFrames = 0;
+        mStaticThumb = thumb;
+        return false;
+    }
+
+    // While idle the thumbnail is not updated, so that slow motion adds up until it is detected
+    if(++mnStaticFrames<mnStaticMinFrames)
+    {
+        mStaticThumb = thumb;
+        return false;
+    }
+
+    return true;
+}
+
+void Tracking::TrackStationary(const double &timestamp)
+{
+    // Same features and pose as the last frame, nothing is extracted, tracked or mapped
+    mCurrentFrame = Frame(mLastFrame);
+    mCurrentFrame.mTimeStamp = timestamp;
+
+    mlRelativeFramePoses.push_back(mlRelativeFramePoses.back());
+    mlpReferences.push_back(mlpReferences.back());
+    mlFrameTimes.push_back(timestamp);
+    mlbLost.push_back(false);
+}
+
+cv::Mat Tracking::Downscale(const cv::Mat &im, const int interpolation) const
+{
+    if(mfDownscale<=1.0f || im.empty())
+        return im;
+
+    cv::Mat imDown;
+    cv::resize(im,imDown,cv::Size(cvRound(im.cols/mfDownscale),cvRound(im.rows/mfDownscale)),0,0,interpolation);
+    return imDown;
+}
+
+void Tracking::RefineKeyPoints()
+{
+    if(mfDownscale<=1.0f || mImGrayFull.empty())
+        return;
+
+    // Only the finest octave is refined, coarser keypoints are not more accurate at full resolution
+    vector<int> vIndices;
+    vector<cv::Point2f> vPoints;
+    for(int i=0; i<mCurrentFrame.N; i++)
+    {
+        if(!mCurrentFrame.mvpMapPoints[i] || mCurrentFrame.mvKeys[i].octave!=0)
+            continue;
+
+        const cv::Point2f &pt = mCurrentFrame.mvKeys[i].pt;
+        vIndices.push_back(i);
+        vPoints.push_back(cv::Point2f(mfDownscale*(pt.x+0.5f)-0.5f,mfDownscale*(pt.y+0.5f)-0.5f));
+    }
+
+    if(vPoints.empty())
+        return;
+
+    vector<cv::Point2f> vRefined = vPoints;
+    const int w = max(cvRound(mfDownscale),2);
+    cv::cornerSubPix(mImGrayFull,vRefined,cv::Size(w,w),cv::Size(-1,-1),
+                     cv::TermCriteria(cv::TermCriteria::COUNT+cv::TermCriteria::EPS,10,0.01));
+
+    for(size_t j=0; j<vIndices.size(); j++)
+    {
+        const float dx = (vRefined[j].x-vPoints[j].x)/mfDownscale;
+        const float dy = (vRefined[j].y-vPoints[j].y)/mfDownscale;
+
+        // The corner moved to another feature
+        if(dx*dx+dy*dy>1.0f)
+            continue;
+
+        // Keypoints near a cell border can move to the next cell
+        mCurrentFrame.ShiftKeyPoint(vIndices[j],dx,dy);
+    }
+}
+
+void Tracking::SpawnMap()
+{
+    ORB_LOG(INFO) << "Track lost, starting a new map. The previous one is kept until a loop closes with it";
+
+    if(mpInitializer)
+    {
+        delete mpInitializer;
+        mpInitializer = static_cast<Initializer*>(NULL);
+    }
+
+    mVelocity = cv::Mat();
+    mvpLocalKeyFrames.clear();
+    mvpLocalMapPoints.clear();
+    mnTemporalPoints = 0;
+
+    mnRelocInterval = 1;
+    mnNextRelocFrameId = 0;
+
+    mState = NOT_INITIALIZED;
+}
+
 void Tracking::Reset()
 {
 
-    cout << "System Reseting" << endl;
+    ORB_LOG(INFO) << "System Reseting";
     if(mpViewer)
     {
         mpViewer->RequestStop();
-        while(!mpViewer->isStopped())
-            usleep(3000);
+        mpViewer->WaitUntilStopped();
     }
 
     // Reset Local Mapping
-    cout << "Reseting Local Mapper...";
+    ORB_LOG(INFO) << "Reseting Local Mapper...";
     mpLocalMapper->RequestReset();
-    cout << " done" << endl;
 
     // Reset Loop Closing
-    cout << "Reseting Loop Closing...";
+    ORB_LOG(INFO) << "Reseting Loop Closing...";
     mpLoopClosing->RequestReset();
-    cout << " done" << endl;
 
     // Clear BoW Database
-    cout << "Reseting Database...";
+    ORB_LOG(INFO) << "Reseting Database...";
     mpKeyFrameDB->clear();
-    cout << " done" << endl;
 
     // Clear Map (this erase MapPoints and KeyFrames)
     mpMap->clear();
@@ -1552,6 +1924,12 @@ void Tracking::Reset()
     mlFrameTimes.clear();
     mlbLost.clear();
 
+    mnRelocInterval = 1;
+    mnNextRelocFrameId = 0;
+
+    mnStaticFrames = 0;
+    mStaticThumb.release();
+
     if(mpViewer)
         mpViewer->Release();
 }
@@ -1564,6 +1942,11 @@ void Tracking::ChangeCalibration(const string &strSettingPath)
     float cx = fSettings["Camera.cx"];
     float cy = fSettings["Camera.cy"];
 
+    fx /= mfDownscale;
+    fy /= mfDownscale;
+    cx = (cx+0.5f)/mfDownscale-0.5f;
+    cy = (cy+0.5f)/mfDownscale-0.5f;
+
     cv::Mat K = cv::Mat::eye(3,3,CV_32F);
     K.at<float>(0,0) = fx;
     K.at<float>(1,1) = fy;
@@ -1585,6 +1968,7 @@ void Tracking::ChangeCalibration(const string &strSettingPath)
     DistCoef.copyTo(mDistCoef);
 
     mbf = fSettings["Camera.bf"];
+    mbf /= mfDownscale;
 
     Frame::mbInitialComputations = true;
 }
@@ -20,6 +20,7 @@
 
 #include "Viewer.h"
 #include <pangolin/pangolin.h>
+#include "Logger.h"
 
 
 #include <mutex>
@@ -240,10 +241,9 @@ namespace ORB_SLAM2
 
             if(Stop())
             {
-                while(isStopped())
-                {
-                    usleep(3000);
-                }
+                unique_lock<mutex> lock(mMutexStop);
+                while(mbStopped)
+                    mcvStop.wait(lock);
             }
 
             if(CheckFinish())
@@ -333,7 +333,7 @@ namespace ORB_SLAM2
             if (treePosition > 220 && treePosition < 420)
             {
                 //toward
-                cout<<"toward: "<<sqrt((xtree*xtree)+(ytree*ytree))<<endl;
+                ORB_LOG(DEBUG) << "toward: "<<sqrt((xtree*xtree)+(ytree*ytree));
 
                 if (sqrt((xtree*xtree)+(ytree*ytree)) < 0.8)
                 {
@@ -389,14 +389,15 @@ namespace ORB_SLAM2
      */
     Tree Viewer::findClosestTree()
     {
-        Tree closestTree = mpSystem->GetTrees()[0];
+        const std::vector<Tree> vTrees = mpSystem->GetTrees();
+        Tree closestTree = vTrees[0];
 
 
-        for (size_t i = 0; i < mpSystem->GetTrees().size(); i++)
+        for (size_t i = 0; i < vTrees.size(); i++)
         {
 
-            float x1 = mpSystem->GetTrees()[i].center.x;
-            float y1 = mpSystem->GetTrees()[i].center.y;
+            float x1 = vTrees[i].center.x;
+            float y1 = vTrees[i].center.y;
             float disTreeCamera = sqrt( (x0-x1)*(x0-x1)+(y0-y1)*(y0-y1) );
 
             float closest_x1 = closestTree.center.x;
@@ -405,7 +406,7 @@ namespace ORB_SLAM2
 
             if (disTreeCamera < closest_disTreeCamera)
             {
-                closestTree = mpSystem->GetTrees()[i];
+                closestTree = vTrees[i];
 
             }
         }
@@ -597,16 +598,17 @@ namespace ORB_SLAM2
     {
 
 
-        cout<<"absTheta: "<<absTheta<<endl;
-        for (size_t i = 0 ; i < mpSystem->GetTrees().size(); i++)
+        ORB_LOG(DEBUG) << "absTheta: "<<absTheta;
+        const std::vector<Tree> vTrees = mpSystem->GetTrees();
+        for (size_t i = 0 ; i < vTrees.size(); i++)
         {
-            cout<<"tree: "<<i<<endl<<mpSystem->GetTrees()[i].center<<"------"<<mpSystem->GetTrees()[i].radius<<endl;
+            ORB_LOG(DEBUG) << "tree: "<<i<<" "<<vTrees[i].center<<"------"<<vTrees[i].radius;
 
-            Tree tree = mpSystem->GetTrees()[i];
+            const Tree &tree = vTrees[i];
 
             float treePosiX = getTreePosition(tree);
 
-            cout<<"treePosiX: "<< treePosiX <<endl;
+            ORB_LOG(DEBUG) << "treePosiX: "<< treePosiX;
 
             float ux = getCamVectorX();
             float uy = getCamVectorY();
@@ -618,13 +620,12 @@ namespace ORB_SLAM2
 
                 float realRadius = getRealRadius(tree);
 
-                cout<<"realRadius: "<<realRadius<<endl;
+                ORB_LOG(DEBUG) << "realRadius: "<<realRadius;
 
                 cv::rectangle(im,cv::Point(treePosiX-realRadius,20),cv::Point(treePosiX+realRadius, 300),cv::Scalar(255,0,0), 3);
             }
         }
 
-        cout<<endl<<endl;
 
     }
 
@@ -753,8 +754,10 @@ namespace ORB_SLAM2
 
     void Viewer::SetFinish()
     {
-        unique_lock<mutex> lock(mMutexFinish);
+        unique_lock<mutex> lock(mMutexStop);
+        unique_lock<mutex> lock2(mMutexFinish);
         mbFinished = true;
+        mcvStop.notify_all();
     }
 
     bool Viewer::isFinished()
@@ -787,6 +790,7 @@ namespace ORB_SLAM2
         {
             mbStopped = true;
             mbStopRequested = false;
+            mcvStop.notify_all();
             return true;
         }
 
@@ -794,10 +798,25 @@ namespace ORB_SLAM2
 
     }
 
+    void Viewer::WaitUntilStopped()
+    {
+        unique_lock<mutex> lock(mMutexStop);
+        while(!mbStopped)
+        {
+            {
+                unique_lock<mutex> lock2(mMutexFinish);
+                if(mbFinished)
+                    return;
+            }
+            mcvStop.wait(lock);
+        }
+    }
+
     void Viewer::Release()
     {
         unique_lock<mutex> lock(mMutexStop);
         mbStopped = false;
+        mcvStop.notify_all();
     }
 
 }